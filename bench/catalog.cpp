@@ -0,0 +1,62 @@
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <string_view>
+
+#include "bench/common.hpp"
+#include "common/catalog.hpp"
+
+// Fills a catalog with generated products and times ranking queries over it.
+// See docs/benchmarks.md
+
+constexpr size_t DEFAULT_PRODUCTS = 200000;
+constexpr size_t DEFAULT_ROUNDS = 50;
+constexpr uint64_t DEFAULT_SEED = 1;
+
+int main(int argc, char** argv)
+{
+    size_t products = DEFAULT_PRODUCTS, rounds = DEFAULT_ROUNDS;
+    uint64_t seed = DEFAULT_SEED;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string_view arg = argv[i];
+        if (arg == "--products") products = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (arg == "--rounds") rounds = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (arg == "--seed") seed = std::strtoull(argv[i + 1], nullptr, 10);
+    }
+
+    std::mt19937_64 rng(seed);
+    Catalog catalog { products };
+
+    BenchClock::time_point start = BenchClock::now();
+    for (size_t i = 0; i < products; ++i)
+        catalog.Put(GenerateProduct(rng, i));
+    std::chrono::duration<double, std::milli> fill_time = BenchClock::now() - start;
+
+    CatalogFilter per_kg { .unit = Unit::Kilogrammes };
+    CatalogFilter per_kg_two_stores {
+        .unit = Unit::Kilogrammes,
+        .stores = StoreID::TESCO | StoreID::ALDI,
+        .max_price = 2000
+    };
+
+    json report = {
+        { "products", catalog.Size() },
+        { "fill-ms", fill_time.count() },
+        { "top-10-per-kg-us", TimeRounds(rounds, [&] {
+            return catalog.TopK(per_kg, PriceColumn::EFFECTIVE, 10).size();
+        }).us_per_round },
+        { "top-10-per-kg-filtered-us", TimeRounds(rounds, [&] {
+            return catalog.TopK(per_kg_two_stores, PriceColumn::EFFECTIVE, 10).size();
+        }).us_per_round },
+        { "top-1000-member-us", TimeRounds(rounds, [&] {
+            return catalog.TopK({}, PriceColumn::MEMBER, 1000).size();
+        }).us_per_round },
+        { "cheapest-per-unit-us", TimeRounds(rounds, [&] {
+            return catalog.CheapestPerUnit({}, PriceColumn::UNIT).size();
+        }).us_per_round }
+    };
+    tb::print("{}\n", report.dump(2));
+
+    return 0;
+}
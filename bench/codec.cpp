@@ -0,0 +1,121 @@
+#include <array>
+#include <cstdlib>
+#include <random>
+#include <string_view>
+#include <vector>
+
+#include "bench/common.hpp"
+#include "common/codec.hpp"
+
+// Checks that products sent in query-result messages through the MessagePack codec read
+// back as they were written, then times writing and reading those messages with the
+// codec against going through json. See docs/benchmarks.md
+
+constexpr size_t DEFAULT_PRODUCTS = 40;
+constexpr size_t DEFAULT_ROUNDS = 2000;
+constexpr uint64_t DEFAULT_SEED = 1;
+
+// The content of a query-result message, as SendQuery wrote it before the codec
+static json LegacyContent(const std::vector<PMRProduct>& products)
+{
+    json items = json::array();
+    for (const PMRProduct& product : products)
+        items.push_back(product);
+
+    return { { "items", std::move(items) }, { "term", "bench" }, { "request-id", 0 },
+             { "stale-stores", 0 } };
+}
+
+static json CodecContent(const std::vector<PMRProduct>& products)
+{
+    ByteBuffer items;
+    items.reserve(products.size() * ENCODED_PRODUCT_SIZE_HINT);
+    EncodeProductArrayHeader(items, products.size());
+    for (const PMRProduct& product : products)
+        EncodeProduct(items, product);
+
+    return { { "items", json::binary(std::move(items)) }, { "term", "bench" },
+             { "request-id", 0 }, { "stale-stores", 0 } };
+}
+
+static std::vector<Product> LegacyRead(const std::vector<uint8_t>& message)
+{
+    json content = json::from_msgpack(message);
+
+    std::vector<Product> products;
+    products.reserve(content["items"].size());
+    for (const json& j : content["items"])
+        products.emplace_back(j.get<Product>());
+    return products;
+}
+
+static std::vector<Product> CodecRead(const std::vector<uint8_t>& message)
+{
+    json content = json::from_msgpack(message);
+    return DecodeProducts(content["items"].get_binary())
+        .value_or(std::vector<Product> {});
+}
+
+int main(int argc, char** argv)
+{
+    size_t product_count = DEFAULT_PRODUCTS, rounds = DEFAULT_ROUNDS;
+    uint64_t seed = DEFAULT_SEED;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string_view arg = argv[i];
+        if (arg == "--products") product_count = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (arg == "--rounds") rounds = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (arg == "--seed") seed = std::strtoull(argv[i + 1], nullptr, 10);
+    }
+
+    std::mt19937_64 rng(seed);
+    std::vector<PMRProduct> products;
+    products.reserve(product_count);
+    for (size_t i = 0; i < product_count; ++i)
+        products.push_back(GenerateProduct(rng, i));
+
+    std::vector<uint8_t> legacy_message = json::to_msgpack(LegacyContent(products));
+    std::vector<uint8_t> codec_message = json::to_msgpack(CodecContent(products));
+
+    // Products must read back as they were written
+    std::vector<Product> read_back = CodecRead(codec_message);
+    size_t mismatches = read_back.size() == products.size() ? 0 : 1;
+    for (size_t i = 0; i < read_back.size() && i < products.size(); ++i) {
+        if (json(read_back[i]) != json(products[i])) {
+            Log(LogLevel::WARNING, "Product {} read back differently", i);
+            ++mismatches;
+        }
+    }
+
+    Timing legacy_write = TimeRounds(rounds, [&] {
+        return json::to_msgpack(LegacyContent(products)).size();
+    });
+    Timing codec_write = TimeRounds(rounds, [&] {
+        return json::to_msgpack(CodecContent(products)).size();
+    });
+    Timing legacy_read = TimeRounds(rounds, [&] {
+        return LegacyRead(legacy_message).size();
+    });
+    Timing codec_read = TimeRounds(rounds, [&] {
+        return CodecRead(codec_message).size();
+    });
+
+    json report = {
+        { "products", product_count },
+        { "mismatches", mismatches },
+        { "legacy-message-bytes", legacy_message.size() },
+        { "message-bytes", codec_message.size() }
+    };
+
+    for (auto [name, timing] : std::to_array<std::pair<std::string_view, Timing>>({
+        { "legacy-write", legacy_write }, { "write", codec_write },
+        { "legacy-read", legacy_read }, { "read", codec_read }
+    })) {
+        report[std::format("{}-us", name)] = timing.us_per_round;
+        report[std::format("{}-allocations", name)] = timing.allocations_per_round;
+    }
+
+    tb::print("{}\n", report.dump(2));
+
+    return mismatches ? 1 : 0;
+}
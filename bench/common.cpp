@@ -0,0 +1,81 @@
+#include "bench/common.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <new>
+
+constexpr auto STORE_IDS = std::to_array<StoreID>({
+    StoreID::SUPERVALU, StoreID::TESCO, StoreID::ALDI, StoreID::DUNNES_STORES
+});
+
+// Allocation counting
+
+static std::atomic<size_t> allocations = 0;
+
+void* operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+size_t AllocationCount() { return allocations.load(std::memory_order_relaxed); }
+
+void CountAllocation() { allocations.fetch_add(1, std::memory_order_relaxed); }
+
+// Inputs
+
+std::optional<std::string> ReadFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        Log(LogLevel::WARNING, "Failed to open '{}'", path);
+        return {};
+    }
+
+    return std::string(std::istreambuf_iterator<char>(file), {});
+}
+
+Product GenerateProduct(std::mt19937_64& rng, size_t index)
+{
+    auto pick = [&rng] (uint64_t n) {
+        return std::uniform_int_distribution<uint64_t>(0, n - 1)(rng);
+    };
+
+    StoreID store = STORE_IDS[pick(STORE_IDS.size())];
+    Unit unit = static_cast<Unit>(1 + pick(static_cast<uint64_t>(Unit::Metres)));
+    unsigned price = 50 + static_cast<unsigned>(pick(2000));
+    unsigned per_unit = price * (1 + static_cast<unsigned>(pick(4)));
+
+    Product product {
+        .name = std::format("Generated Product {} Pack {}g & More", index, 100 * pick(10)),
+        .description = pick(2) ? std::string(pick(400), 'd') : std::string(),
+        .image_url = std::format("{}/{}.jpg", pick(1000000), index),
+        .url = std::format("generated-product-{}-id-{}", index, pick(1000000)),
+        .id = std::format("{}{}", GetStorePrefix(store), index),
+        .item_price = { Currency::EUR, price },
+        .price_per_unit = { { Currency::EUR, per_unit }, unit },
+        .store = store,
+        .timestamp = Now(),
+        .full_info = pick(2) == 0
+    };
+
+    if (pick(3) == 0) {
+        product.offers.push_back({
+            .text = "buy 2 for less",
+            .price = { Currency::EUR, price * 3 / 2 },
+            .bulk_amount = 2,
+            .type = OfferType::MULTIPLE_FOR_REDUCED_PRICE,
+            .membership_only = pick(2) == 0
+        });
+    }
+
+    product.effective_prices = ComputeEffectivePrices(product);
+    return product;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <string>
+
+#include "common/product.hpp"
+#include "common/util.hpp"
+
+// Shared by the benchmarks under bench/. See docs/benchmarks.md
+
+using BenchClock = std::chrono::steady_clock;
+
+// Heap allocations made since startup. bench/common.cpp replaces operator new to count
+// them; allocators that bypass it, such as lexbor's, call CountAllocation.
+size_t AllocationCount();
+void CountAllocation();
+
+// Logs and returns nothing if the file can't be read
+std::optional<std::string> ReadFile(const std::string& path);
+
+// A listing of a random store with a unique ID for each index, a name that needs
+// escaping, relative URLs, and sometimes a description and a multi-buy offer
+Product GenerateProduct(std::mt19937_64& rng, size_t index);
+
+struct Timing
+{
+    double us_per_round;
+    double allocations_per_round;
+};
+
+// Runs `work` `rounds` times. Its results are summed so that it is not optimised away.
+template<typename Work>
+Timing TimeRounds(size_t rounds, Work&& work)
+{
+    size_t sink = 0, allocations_before = AllocationCount();
+    BenchClock::time_point start = BenchClock::now();
+
+    for (size_t round = 0; round < rounds; ++round)
+        sink += work();
+
+    std::chrono::duration<double, std::micro> elapsed = BenchClock::now() - start;
+    size_t allocated = AllocationCount() - allocations_before;
+
+    if (sink == 1) tb::print("");
+
+    return { elapsed.count() / rounds, static_cast<double>(allocated) / rounds };
+}
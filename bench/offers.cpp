@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <optional>
+#include <ranges>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bench/common.hpp"
+#include "webscraper/stores.hpp"
+
+// Checks the offers read from a corpus of promotion badge texts against their
+// expected values, then times Offer::FromString against the matcher it replaced.
+// See docs/benchmarks.md
+
+constexpr std::string_view DEFAULT_CORPUS = "bench/corpus/offers.json";
+constexpr size_t DEFAULT_ROUNDS = 20000;
+
+struct StoreGrammar
+{
+    std::string_view prefix;
+    OfferGrammar grammar;
+};
+
+// Stores not listed use OFFER_GRAMMAR
+constexpr auto STORE_GRAMMARS = std::to_array<StoreGrammar>({
+    { "SV", SV_OFFER_GRAMMAR }
+});
+
+constexpr auto OFFER_TYPE_NAMES = std::to_array<std::pair<std::string_view, OfferType>>({
+    { "multiple",   OfferType::MULTIPLE_FOR_REDUCED_PRICE },
+    { "any",        OfferType::MULTIPLE_HETEROGENEOUS_FOR_REDUCED_PRICE },
+    { "absolute",   OfferType::REDUCED_PRICE_ABSOLUTE },
+    { "percentage", OfferType::REDUCED_PRICE_PERCENTAGE },
+    { "deduction",  OfferType::REDUCED_PRICE_DEDUCTION }
+});
+
+// The previous implementation of Offer::FromString, kept as a reference for timing.
+// Its "any" branch read the result of the "buy" match; that is corrected here.
+static auto LegacyFromString(std::string_view view) -> std::optional<Offer>
+{
+    auto text = view | std::views::transform(tolower) | tb::range_to<std::string>();
+
+    if (auto x_for_y = tb::try_match<unsigned, Price>(text, "{} for {}")) {
+        auto [count, price] = x_for_y->object;
+        return Offer { .text = text, .price = price, .bulk_amount = count,
+                       .type = OfferType::MULTIPLE_FOR_REDUCED_PRICE };
+    } else if (auto x_for_y = tb::try_match<unsigned, Price>(text, "buy {} for {}")) {
+        auto [count, price] = x_for_y->object;
+        return Offer { .text = text, .price = price, .bulk_amount = count,
+                       .type = OfferType::MULTIPLE_FOR_REDUCED_PRICE };
+    } else if (auto any = tb::try_match<unsigned, Price>(text, "any {} for {}")) {
+        auto [count, price] = any->object;
+        return Offer { .text = text, .price = price, .bulk_amount = count,
+                       .type = OfferType::MULTIPLE_HETEROGENEOUS_FOR_REDUCED_PRICE };
+    } else if (auto reduced = tb::try_match<Price>(text, "only {}")) {
+        return Offer { .text = text, .price = std::get<Price>(reduced->object),
+                       .bulk_amount = 1, .type = OfferType::REDUCED_PRICE_ABSOLUTE,
+                       .membership_only = text.find("real rewards") != std::string::npos };
+    } else if (auto tesco_clubcard = tb::try_match<Price>(text, "{} clubcard price")) {
+        return Offer { .text = text, .price = std::get<Price>(tesco_clubcard->object),
+                       .bulk_amount = 1, .type = OfferType::REDUCED_PRICE_ABSOLUTE,
+                       .membership_only = true };
+    } else if (auto save_pc = tb::try_match<float>(text, "save {}%")) {
+        return Offer { .text = text, .type = OfferType::REDUCED_PRICE_PERCENTAGE,
+            .price_reduction_multiplier = 1 - (std::get<float>(save_pc->object) * .01f) };
+    } else if (auto save_amnt = tb::try_match<Price>(text, "save {}")) {
+        return Offer { .text = text, .price = std::get<Price>(save_amnt->object),
+                       .bulk_amount = 1, .type = OfferType::REDUCED_PRICE_DEDUCTION };
+    } else if (text.starts_with("half price")) {
+        return Offer { .text = text, .type = OfferType::REDUCED_PRICE_PERCENTAGE,
+                       .price_reduction_multiplier = 0.5f };
+    }
+
+    return std::nullopt;
+}
+
+struct OfferCase
+{
+    std::string text;
+    OfferGrammar grammar;
+    json expect;
+};
+
+static std::optional<std::vector<OfferCase>> LoadCorpus(const std::string& path)
+{
+    std::optional<std::string> data = ReadFile(path);
+    if (!data) return {};
+
+    json corpus;
+    try {
+        corpus = json::parse(data.value());
+    } catch (const json::parse_error& e) {
+        Log(LogLevel::WARNING, "Failed to parse offer corpus: {}", e.what());
+        return {};
+    }
+
+    std::vector<OfferCase> cases;
+    for (const json& entry : corpus["cases"]) {
+        std::string_view prefix = entry["store"].get<std::string_view>();
+        OfferGrammar grammar = OFFER_GRAMMAR;
+        for (const StoreGrammar& store : STORE_GRAMMARS) {
+            if (store.prefix == prefix) grammar = store.grammar;
+        }
+
+        cases.push_back({ .text = entry["text"], .grammar = grammar, .expect = entry });
+    }
+
+    return cases;
+}
+
+static std::vector<std::string> Check(const OfferCase& c)
+{
+    std::vector<std::string> errors;
+    std::optional<Offer> offer = Offer::FromString(c.text, nullptr, c.grammar);
+
+    if (!c.expect.contains("type")) {
+        if (offer)
+            errors.push_back(std::format("expected no offer, got '{}'", offer->ToString()));
+        return errors;
+    }
+
+    if (!offer) {
+        errors.push_back("expected an offer, got none");
+        return errors;
+    }
+
+    auto type = std::find_if(OFFER_TYPE_NAMES.begin(), OFFER_TYPE_NAMES.end(),
+        [&] (const auto& name) { return name.second == offer->type; });
+    std::string_view type_name = type != OFFER_TYPE_NAMES.end() ? type->first : "other";
+
+    auto check = [&] (const char* key, const json& value) {
+        if (c.expect.contains(key) && c.expect[key] != value) {
+            errors.push_back(std::format("{}: expected {}, got {}", key,
+                                         c.expect[key].dump(), value.dump()));
+        }
+    };
+
+    check("type", type_name);
+    check("count", offer->bulk_amount);
+    check("price", offer->price.ToString());
+    if (c.expect.value("membership", false) != offer->membership_only)
+        errors.push_back(std::format("membership: got {}", offer->membership_only));
+    if (c.expect.contains("multiplier") && std::abs(c.expect["multiplier"].get<float>()
+                                           - offer->price_reduction_multiplier) > 1e-4f) {
+        errors.push_back(std::format("multiplier: expected {}, got {}",
+            c.expect["multiplier"].dump(), offer->price_reduction_multiplier));
+    }
+
+    return errors;
+}
+
+int main(int argc, char** argv)
+{
+    std::string corpus_path(DEFAULT_CORPUS);
+    size_t rounds = DEFAULT_ROUNDS;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string_view arg = argv[i];
+        if (arg == "--corpus") corpus_path = argv[i + 1];
+        else if (arg == "--rounds") rounds = std::strtoull(argv[i + 1], nullptr, 10);
+    }
+
+    std::optional<std::vector<OfferCase>> cases = LoadCorpus(corpus_path);
+    if (!cases || cases->empty()) return 1;
+
+    size_t failures = 0;
+    for (const OfferCase& c : cases.value()) {
+        std::vector<std::string> errors = Check(c);
+        for (const std::string& error : errors)
+            Log(LogLevel::WARNING, "'{}': {}", c.text, error);
+        failures += !errors.empty();
+    }
+
+    auto parse_all = [&cases] (auto&& parser) {
+        return [&cases, parser] {
+            size_t sum = 0;
+            for (const OfferCase& c : cases.value()) {
+                if (auto offer = parser(c)) sum += offer->bulk_amount;
+            }
+            return sum;
+        };
+    };
+
+    Timing legacy = TimeRounds(rounds, parse_all([] (const OfferCase& c) {
+        return LegacyFromString(c.text);
+    }));
+    Timing current = TimeRounds(rounds, parse_all([] (const OfferCase& c) {
+        return Offer::FromString(c.text, nullptr, c.grammar);
+    }));
+
+    double count = static_cast<double>(cases->size());
+    json report = {
+        { "cases", cases->size() },
+        { "failures", failures },
+        { "legacy-ns-per-parse", legacy.us_per_round * 1000 / count },
+        { "ns-per-parse", current.us_per_round * 1000 / count },
+        { "legacy-allocations-per-parse", legacy.allocations_per_round / count },
+        { "allocations-per-parse", current.allocations_per_round / count }
+    };
+    tb::print("{}\n", report.dump(2));
+
+    return failures ? 1 : 0;
+}
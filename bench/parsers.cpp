@@ -0,0 +1,506 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <future>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <lexbor/core/lexbor.h>
+
+#include <nlohmann/json.hpp>
+
+#include "bench/common.hpp"
+#include "webscraper/app.hpp"
+#include "webscraper/curldriver.hpp"
+#include "webscraper/html.hpp"
+#include "webscraper/parsearena.hpp"
+#include "webscraper/stores.hpp"
+
+// Runs every store parser over the saved responses listed in a corpus manifest,
+// checks the products they extract and reports throughput and memory use as JSON.
+// See docs/benchmarks.md
+
+using Arena = tb::thread_safe_memory_arena;
+
+constexpr size_t DEFAULT_ITERATIONS = 500;
+constexpr size_t WARMUP_ITERATIONS = 10;
+constexpr double DEFAULT_TOLERANCE = 0.1;
+constexpr size_t RESULTS_ARENA_SIZE = 4 * 1024 * 1024;
+
+// Allocation counting. Lexbor's allocations are counted along with operator new's,
+// unless parse arenas are enabled.
+
+static void* CountingMalloc(size_t size)
+{
+    CountAllocation();
+    return std::malloc(size);
+}
+
+static void* CountingCalloc(size_t count, size_t size)
+{
+    CountAllocation();
+    return std::calloc(count, size);
+}
+
+static void* CountingRealloc(void* ptr, size_t size)
+{
+    CountAllocation();
+    return std::realloc(ptr, size);
+}
+
+static void* CountingFree(void* ptr)
+{
+    std::free(ptr);
+    return nullptr;
+}
+
+// Cases
+
+using SearchParser = ArenaProductList* (*)(std::string_view, Arena&, size_t);
+using ProductParser = ArenaProduct* (*)(const HTML&, Arena&);
+
+struct BenchCase
+{
+    std::string name;
+    SearchParser search = nullptr;
+    ProductParser product = nullptr;
+    std::string data;
+    json expect;
+};
+
+struct Extracted
+{
+    std::string id, name, description, url, image, price, price_per;
+    size_t offers;
+};
+
+struct Measurement
+{
+    size_t iterations = 0, bytes = 0, products = 0, allocations = 0;
+    size_t peak_arena_bytes = 0;
+    BenchClock::duration elapsed {};
+    HTMLPoolStats pool {};
+};
+
+static std::string_view Trim(std::string_view str)
+{
+    constexpr std::string_view WHITESPACE = " \t\r\n";
+    size_t begin = str.find_first_not_of(WHITESPACE);
+    if (begin == std::string_view::npos) return {};
+    return str.substr(begin, str.find_last_not_of(WHITESPACE) - begin + 1);
+}
+
+template<typename P>
+static Extracted Extract(const P& product)
+{
+    return {
+        .id { product.id.begin(), product.id.end() },
+        .name = std::string(Trim({ product.name.data(), product.name.size() })),
+        .description = std::string(
+            Trim({ product.description.data(), product.description.size() })),
+        .url = product.FullURL(),
+        .image = product.FullImageURL(),
+        .price = product.item_price.ToString(),
+        .price_per = product.price_per_unit.ToString(),
+        .offers = product.offers.size()
+    };
+}
+
+static std::optional<std::vector<BenchCase>> LoadCorpus(const std::string& corpus_dir)
+{
+    std::optional<std::string> manifest_data = ReadFile(corpus_dir + "/manifest.json");
+    if (!manifest_data) return {};
+
+    json manifest;
+    try {
+        manifest = json::parse(manifest_data.value());
+    } catch (const json::parse_error& e) {
+        Log(LogLevel::WARNING, "Failed to parse corpus manifest: {}", e.what());
+        return {};
+    }
+
+    std::vector<BenchCase> cases;
+    for (const json& entry : manifest["cases"]) {
+        std::string name = entry["name"], prefix = entry["store"], parser = entry["parser"];
+
+        auto store = std::ranges::find_if(stores::ALL, [&] (const Store* s) {
+            return s->prefix == prefix;
+        });
+        if (store == stores::ALL.end()) {
+            Log(LogLevel::WARNING, "Unknown store '{}' in case {}", prefix, name);
+            return {};
+        }
+
+        std::optional<std::string> data = ReadFile(
+            std::format("{}/{}", corpus_dir, entry["file"].get<std::string_view>()));
+        if (!data) return {};
+
+        if (parser == "search") {
+            cases.push_back({ .name = name + "/dom", .search = (*store)->ParseProductSearch,
+                              .data = data.value(), .expect = entry["expect"] });
+            if ((*store)->StreamProductSearch) {
+                cases.push_back({ .name = name + "/stream",
+                                  .search = (*store)->StreamProductSearch,
+                                  .data = std::move(data.value()),
+                                  .expect = entry["expect"] });
+            }
+        } else if (parser == "product" && (*store)->GetProductAtURL) {
+            cases.push_back({ .name = name + "/dom", .product = (*store)->GetProductAtURL,
+                              .data = std::move(data.value()), .expect = entry["expect"] });
+        } else {
+            Log(LogLevel::WARNING, "No '{}' parser for {}, skipping case {}", parser,
+                (*store)->name, name);
+        }
+    }
+
+    return cases;
+}
+
+// Returns the number of products extracted, adding them to `out` if given
+static size_t RunOnce(const BenchCase& c, Arena& arena, std::vector<Extracted>* out)
+{
+    if (c.search) {
+        ArenaProductList* list = c.search(c.data, arena, SEARCH_DEPTH_INDEFINITE);
+        if (!list) return 0;
+
+        if (out) {
+            for (const auto& [product, _] : list->products)
+                out->push_back(std::visit([] (const auto& p) { return Extract(p); }, product));
+        }
+        return list->products.size();
+    }
+
+    std::optional<HTML> html = HTML::FromString(c.data);
+    if (!html) return 0;
+
+    ArenaProduct* product = c.product(html.value(), arena);
+    if (!product) return 0;
+
+    if (out) out->push_back(Extract(*product));
+    return 1;
+}
+
+static std::vector<std::string> Check(const BenchCase& c, Arena& arena)
+{
+    std::vector<Extracted> products;
+    arena.reset();
+    RunOnce(c, arena, &products);
+
+    std::vector<std::string> errors;
+    if (products.size() != c.expect.size()) {
+        errors.push_back(std::format("expected {} products, got {}", c.expect.size(),
+                                     products.size()));
+        return errors;
+    }
+
+    for (size_t i = 0; i < products.size(); ++i) {
+        const Extracted& product = products[i];
+        const json& expected = c.expect[i];
+
+        auto check = [&] (const char* key, const auto& value) {
+            if (!expected.contains(key)) return;
+            if (expected[key] != value) {
+                errors.push_back(std::format("product #{} {}: expected {}, got {}", i, key,
+                                             expected[key].dump(), json(value).dump()));
+            }
+        };
+
+        check("id", product.id);
+        check("name", product.name);
+        check("description", product.description);
+        check("url", product.url);
+        check("image", product.image);
+        check("price", product.price);
+        check("price-per", product.price_per);
+        check("offers", product.offers);
+    }
+
+    return errors;
+}
+
+static Measurement Measure(const BenchCase& c, Arena& arena, size_t iterations)
+{
+    for (size_t i = 0; i < WARMUP_ITERATIONS; ++i) {
+        arena.reset();
+        RunOnce(c, arena, nullptr);
+    }
+
+    Measurement m { .iterations = iterations, .bytes = c.data.size() * iterations };
+
+    if (ParseArenasEnabled()) ThreadParseArena().ResetHighWaterMark();
+    HTMLPoolStats pool_before = GetThreadHTMLPoolStats();
+    size_t allocations_before = AllocationCount();
+    BenchClock::time_point start = BenchClock::now();
+
+    for (size_t i = 0; i < iterations; ++i) {
+        arena.reset();
+        m.products += RunOnce(c, arena, nullptr);
+    }
+
+    m.elapsed = BenchClock::now() - start;
+    m.allocations = AllocationCount() - allocations_before;
+    if (ParseArenasEnabled()) m.peak_arena_bytes = ThreadParseArena().HighWaterMark();
+
+    HTMLPoolStats pool_after = GetThreadHTMLPoolStats();
+    m.pool = {
+        .documents_created = pool_after.documents_created - pool_before.documents_created,
+        .documents_reused = pool_after.documents_reused - pool_before.documents_reused,
+        .collections_created
+            = pool_after.collections_created - pool_before.collections_created,
+        .collections_reused
+            = pool_after.collections_reused - pool_before.collections_reused
+    };
+
+    return m;
+}
+
+static json Report(const Measurement& m)
+{
+    double seconds = std::chrono::duration<double>(m.elapsed).count();
+    double pages = static_cast<double>(m.iterations);
+
+    return {
+        { "mb-per-s", m.bytes / seconds / (1024 * 1024) },
+        { "products-per-s", m.products / seconds },
+        { "us-per-page", seconds * 1e6 / pages },
+        { "allocations-per-page", m.allocations / pages },
+        { "peak-arena-bytes", m.peak_arena_bytes },
+        { "documents-created", m.pool.documents_created },
+        { "documents-reused", m.pool.documents_reused }
+    };
+}
+
+// Returns the number of regressions beyond `tolerance`
+static size_t CompareToBaseline(const json& results, const json& baseline, double tolerance)
+{
+    size_t regressions = 0;
+    for (const auto& [name, base] : baseline["results"].items()) {
+        if (!results.contains(name)) {
+            Log(LogLevel::WARNING, "Case {} is in the baseline but was not run", name);
+            continue;
+        }
+
+        const json& current = results[name];
+        double throughput = current["mb-per-s"], base_throughput = base["mb-per-s"];
+        double allocs = current["allocations-per-page"],
+               base_allocs = base["allocations-per-page"];
+
+        if (throughput < base_throughput * (1 - tolerance)) {
+            Log(LogLevel::WARNING, "{}: throughput fell from {:.2f} to {:.2f} MB/s", name,
+                base_throughput, throughput);
+            ++regressions;
+        }
+
+        // Allocation counts are deterministic, so any growth is reported
+        if (allocs > base_allocs + 0.5) {
+            Log(LogLevel::WARNING, "{}: allocations per page rose from {:.1f} to {:.1f}",
+                name, base_allocs, allocs);
+            ++regressions;
+        }
+    }
+
+    return regressions;
+}
+
+// Capture
+
+// Fetches the first search results page of every store for `query` into `corpus_dir`,
+// the way the webscraper does, and prints a manifest entry for each with the products
+// the parsers read from it. Entries are checked by hand before they go in the manifest.
+static bool Capture(const std::string& corpus_dir, std::string_view query)
+{
+    CURLDriver::GlobalInit();
+    tb::scoped_guard cleanup = [] { CURLDriver::GlobalCleanup(); };
+
+    CURLDriver driver;
+    driver.Init(stores::ALL.size(), AppConfig {}.curl_useragent);
+
+    std::vector<std::byte> arena_memory(RESULTS_ARENA_SIZE);
+    Arena arena = std::span { arena_memory.begin(), arena_memory.end() };
+
+    json entries = json::array();
+    bool captured_all = true;
+    for (const Store* store : stores::ALL) {
+        std::promise<std::optional<std::string>> response;
+        driver.PerformTransfer(store->GetProductSearchURL(query, 0),
+        [&response] (std::string_view data, std::string_view, CURLcode code) {
+            response.set_value(code == CURLE_OK ? std::optional<std::string>(data)
+                                                : std::nullopt);
+        }, store->GetProductSearchCURLOptions(query));
+
+        std::optional<std::string> data = response.get_future().get();
+        if (!data) {
+            Log(LogLevel::WARNING, "Failed to fetch the search page of {}", store->name);
+            captured_all = false;
+            continue;
+        }
+
+        std::string name = std::format("{}-search", store->prefix);
+        std::ranges::transform(name, name.begin(), [] (unsigned char c) {
+            return static_cast<char>(tolower(c));
+        });
+        bool is_json = data->find_first_not_of(" \t\r\n") == data->find_first_of("{[");
+        std::string file = std::format("{}.{}", name, is_json ? "json" : "html");
+        std::ofstream(std::format("{}/{}", corpus_dir, file), std::ios::binary) << *data;
+
+        BenchCase c {
+            .search = store->ParseProductSearch, .data = std::move(data.value())
+        };
+        std::vector<Extracted> products;
+        arena.reset();
+        RunOnce(c, arena, &products);
+        if (products.empty()) {
+            Log(LogLevel::WARNING, "No products read from {}, check the page", file);
+            captured_all = false;
+        }
+
+        json expect = json::array();
+        for (const Extracted& product : products) {
+            expect.push_back({
+                { "id", product.id }, { "name", product.name }, { "url", product.url },
+                { "image", product.image }, { "price", product.price },
+                { "price-per", product.price_per }, { "offers", product.offers }
+            });
+        }
+
+        entries.push_back({
+            { "name", name }, { "store", store->prefix }, { "parser", "search" },
+            { "file", file }, { "expect", std::move(expect) }
+        });
+    }
+
+    tb::print("{}\n", entries.dump(2));
+    return captured_all;
+}
+
+static void Usage()
+{
+    tb::print(
+        "Usage: fitsch-bench-parsers [options]\n"
+        "  --corpus DIR            Corpus directory (default: bench/corpus)\n"
+        "  --iterations N          Timed runs per case (default: {})\n"
+        "  --output FILE           Write the report to FILE (default: stdout)\n"
+        "  --baseline FILE         Compare against a previous report\n"
+        "  --write-baseline FILE   Also write the report to FILE\n"
+        "  --tolerance F           Allowed throughput loss vs. baseline (default: {})\n"
+        "  --parse-arena           Back lexbor with parse arenas, as lexbor-parse-arena\n"
+        "  --capture QUERY         Save each store's search page for QUERY to the corpus\n"
+        "                          directory and print manifest entries for them\n",
+        DEFAULT_ITERATIONS, DEFAULT_TOLERANCE);
+}
+
+int main(int argc, char** argv)
+{
+    std::string corpus_dir = "bench/corpus", output_path, baseline_path, write_baseline_path;
+    std::optional<std::string> capture_query;
+    size_t iterations = DEFAULT_ITERATIONS;
+    double tolerance = DEFAULT_TOLERANCE;
+    bool parse_arena = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--parse-arena") {
+            parse_arena = true;
+        } else if (arg == "--corpus" && has_value) {
+            corpus_dir = argv[++i];
+        } else if (arg == "--iterations" && has_value) {
+            iterations = std::max<size_t>(1, std::strtoull(argv[++i], nullptr, 10));
+        } else if (arg == "--output" && has_value) {
+            output_path = argv[++i];
+        } else if (arg == "--baseline" && has_value) {
+            baseline_path = argv[++i];
+        } else if (arg == "--write-baseline" && has_value) {
+            write_baseline_path = argv[++i];
+        } else if (arg == "--tolerance" && has_value) {
+            tolerance = std::strtod(argv[++i], nullptr);
+        } else if (arg == "--capture" && has_value) {
+            capture_query = argv[++i];
+        } else {
+            Usage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    // Must happen before lexbor is first used by a parse
+    if (parse_arena)
+        EnableParseArenas();
+    else
+        lexbor_memory_setup(CountingMalloc, CountingRealloc, CountingCalloc, CountingFree);
+
+    if (capture_query)
+        return Capture(corpus_dir, *capture_query) ? 0 : 1;
+
+    std::optional<std::vector<BenchCase>> cases = LoadCorpus(corpus_dir);
+    if (!cases) {
+        Log(LogLevel::SEVERE, "Couldn't load corpus from '{}'", corpus_dir);
+        return 1;
+    }
+
+    std::vector<std::byte> arena_memory(RESULTS_ARENA_SIZE);
+    Arena arena = std::span { arena_memory.begin(), arena_memory.end() };
+
+    json report = {
+        { "iterations", iterations },
+        { "parse-arena", parse_arena },
+        { "results", json::object() }
+    };
+
+    size_t failures = 0;
+    for (const BenchCase& c : cases.value()) {
+        std::vector<std::string> errors = Check(c, arena);
+        for (const std::string& error : errors)
+            Log(LogLevel::WARNING, "{}: {}", c.name, error);
+
+        json result = Report(Measure(c, arena, iterations));
+        result["correct"] = errors.empty();
+        failures += !errors.empty();
+
+        Log(LogLevel::INFO, "{}: {:.2f} MB/s, {:.0f} products/s, {:.1f} allocations/page",
+            c.name, result["mb-per-s"].get<double>(),
+            result["products-per-s"].get<double>(),
+            result["allocations-per-page"].get<double>());
+
+        report["results"][c.name] = std::move(result);
+    }
+
+    size_t regressions = 0;
+    if (!baseline_path.empty()) {
+        std::optional<std::string> baseline_data = ReadFile(baseline_path);
+        if (baseline_data) {
+            try {
+                regressions = CompareToBaseline(report["results"],
+                    json::parse(baseline_data.value()), tolerance);
+            } catch (const json::exception& e) {
+                Log(LogLevel::WARNING, "Invalid baseline: {}", e.what());
+                ++regressions;
+            }
+        } else {
+            ++regressions;
+        }
+        report["regressions"] = regressions;
+    }
+
+    std::string report_text = report.dump(2);
+    if (output_path.empty()) {
+        tb::print("{}\n", report_text);
+    } else {
+        std::ofstream(output_path) << report_text << '\n';
+    }
+
+    if (!write_baseline_path.empty())
+        std::ofstream(write_baseline_path) << report_text << '\n';
+
+    if (failures || regressions) {
+        Log(LogLevel::WARNING, "{} cases failed their checks, {} regressions", failures,
+            regressions);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "bench/common.hpp"
+
+// Checks Price::Match against the parser it replaced over generated price strings,
+// then times both. See docs/benchmarks.md
+
+constexpr size_t DEFAULT_CASES = 100000;
+constexpr size_t DEFAULT_ROUNDS = 20;
+constexpr uint64_t DEFAULT_SEED = 1;
+
+// The previous implementation of tb::try_match_single<Price>, kept as a reference
+
+static const std::unordered_map<std::string_view, std::pair<Currency, float>>
+LEGACY_CURRENCY_MULTIPLIERS = {
+    { "€", { Currency::EUR, 1 } },
+    { "c", { Currency::EUR, 0.01 } }
+};
+
+static auto LegacyMatch(std::string_view view) -> std::optional<tb::match_result<Price>>
+{
+    std::string str(view);
+
+    size_t characters_consumed = 0;
+    if (size_t comma = str.find(','); comma != std::string::npos) {
+        str.erase(comma, 1);
+        ++characters_consumed;
+    }
+
+    Price price;
+    float price_multiplier = 1;
+    for (const auto& [symbol, curr_multiplier] : LEGACY_CURRENCY_MULTIPLIERS) {
+        if (size_t currency_pos = str.find(symbol); currency_pos != std::string::npos) {
+            price.currency = std::get<Currency>(curr_multiplier);
+            price_multiplier = std::get<float>(curr_multiplier);
+            str.erase(currency_pos, symbol.size());
+            characters_consumed += symbol.size();
+            break;
+        }
+    }
+
+    view = str;
+    size_t ss_point = view.find('.');
+    if (ss_point != std::string::npos) {
+        auto parts = tb::try_match<unsigned, unsigned>(view, "{}.{}");
+        if (!parts)
+            return std::nullopt;
+
+        auto [int_part, frac_part] = parts->object;
+        price.value = (int_part * 100) + frac_part;
+        characters_consumed += parts->characters_matched;
+    } else {
+        auto int_part = tb::try_match_single<unsigned>(view.substr(0, ss_point));
+        if (!int_part)
+            return std::nullopt;
+        price.value = int_part->object * 100;
+        characters_consumed += int_part->characters_matched;
+    }
+
+    return tb::match_result<Price> {
+        .object = price * price_multiplier,
+        .characters_matched = characters_consumed
+    };
+}
+
+// Inputs
+
+// Prices as the stores write them, on which both parsers must agree: "€1.10",
+// "€1,234.56", "€3", "75c", optionally followed by the rest of a price per unit.
+// Single-digit cents are left out, as the old parser read "€1.5" as €1.05.
+static std::string CanonicalPrice(std::mt19937_64& rng)
+{
+    constexpr auto TRAILERS = std::to_array<std::string_view>({
+        "", "/kg", "/l", " per", "/100g", " off"
+    });
+
+    auto pick = [&rng] (uint64_t n) {
+        return std::uniform_int_distribution<uint64_t>(0, n - 1)(rng);
+    };
+
+    std::string result;
+    if (pick(8) == 0) {
+        result = std::format("{}c", pick(100));
+    } else {
+        unsigned units = static_cast<unsigned>(pick(4) == 0 ? pick(100000) : pick(100));
+        result = "€";
+        if (units >= 1000 && pick(2))
+            result += std::format("{},{:03}", units / 1000, units % 1000);
+        else
+            result += std::to_string(units);
+        if (pick(4))
+            result += std::format(".{:02}", pick(100));
+    }
+
+    result += TRAILERS[pick(TRAILERS.size())];
+    return result;
+}
+
+// Arbitrary strings over the characters prices are made of, half of them starting
+// with a price as the stores write it
+static std::string MutatedPrice(std::mt19937_64& rng)
+{
+    constexpr std::string_view ALPHABET = "0123456789.,c/kg €€";
+    std::uniform_int_distribution<size_t> length(0, 12),
+                                          character(0, ALPHABET.size() - 1);
+
+    std::string result = rng() % 2 ? CanonicalPrice(rng) : std::string();
+    for (size_t i = length(rng); i > 0; --i)
+        result += ALPHABET[character(rng)];
+    return result;
+}
+
+static bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+// The allow-list for arbitrary inputs. The old parser searched its whole input for a
+// comma to drop, a currency sign and a decimal point, and read any number of digits
+// after the point, so Price::Match may read such input differently. It must agree on
+// the rest: an optional leading "€", up to seven digits, optionally '.' and exactly
+// two digits, then ASCII text with none of '.', ',' or 'c'.
+static bool DifferenceAllowed(std::string_view input)
+{
+    constexpr std::string_view EURO = "€";
+    if (input.starts_with(EURO)) input.remove_prefix(EURO.size());
+
+    size_t digits = 0;
+    while (digits < input.size() && IsDigit(input[digits])) ++digits;
+    if (digits == 0 || digits > 7) return true;
+    input.remove_prefix(digits);
+
+    if (input.starts_with('.')) {
+        if (input.size() < 3 || !IsDigit(input[1]) || !IsDigit(input[2])) return true;
+        input.remove_prefix(3);
+        if (!input.empty() && IsDigit(input[0])) return true;
+    }
+
+    return input.find_first_of(".,c") != std::string_view::npos
+        || std::ranges::any_of(input, [] (char c) { return c & 0x80; });
+}
+
+static bool SameMatch(const std::optional<tb::match_result<Price>>& a,
+                      const std::optional<tb::match_result<Price>>& b)
+{
+    if (a.has_value() != b.has_value()) return false;
+    if (!a) return true;
+    return a->object.value == b->object.value && a->object.currency == b->object.currency
+        && a->characters_matched == b->characters_matched;
+}
+
+static std::string Describe(const std::optional<tb::match_result<Price>>& match)
+{
+    if (!match) return "no match";
+    return std::format("{} ({} chars)", match->object.ToString(),
+                       match->characters_matched);
+}
+
+int main(int argc, char** argv)
+{
+    size_t cases = DEFAULT_CASES, rounds = DEFAULT_ROUNDS;
+    uint64_t seed = DEFAULT_SEED;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string_view arg = argv[i];
+        if (arg == "--cases") cases = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (arg == "--rounds") rounds = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (arg == "--seed") seed = std::strtoull(argv[i + 1], nullptr, 10);
+    }
+
+    std::mt19937_64 rng(seed);
+
+    std::vector<std::string> canonical;
+    canonical.reserve(cases);
+    size_t mismatches = 0;
+    for (size_t i = 0; i < cases; ++i) {
+        std::string input = CanonicalPrice(rng);
+        auto expected = LegacyMatch(input), actual = Price::Match(input);
+        if (!SameMatch(expected, actual) && mismatches++ < 10) {
+            Log(LogLevel::WARNING, "'{}': expected {}, got {}", input, Describe(expected),
+                Describe(actual));
+        }
+        canonical.push_back(std::move(input));
+    }
+
+    size_t differences = 0;
+    for (size_t i = 0; i < cases; ++i) {
+        std::string input = MutatedPrice(rng);
+        auto expected = LegacyMatch(input), actual = Price::Match(input);
+        if (actual && actual->characters_matched > input.size()) {
+            Log(LogLevel::WARNING, "'{}': matched past the end of the input", input);
+            ++mismatches;
+        }
+
+        if (SameMatch(expected, actual)) continue;
+        if (DifferenceAllowed(input)) {
+            ++differences;
+        } else if (mismatches++ < 10) {
+            Log(LogLevel::WARNING, "'{}': expected {}, got {}", input, Describe(expected),
+                Describe(actual));
+        }
+    }
+
+    auto parse_all = [&canonical] (auto&& parser) {
+        return [&canonical, parser] {
+            size_t sum = 0;
+            for (const std::string& input : canonical) {
+                if (auto match = parser(input)) sum += match->object.value;
+            }
+            return sum;
+        };
+    };
+
+    Timing legacy = TimeRounds(rounds, parse_all(LegacyMatch));
+    Timing current = TimeRounds(rounds, parse_all(Price::Match));
+
+    json report = {
+        { "seed", seed },
+        { "cases", cases },
+        { "mismatches", mismatches },
+        { "allowed-differences", differences },
+        { "legacy-ns-per-parse", legacy.us_per_round * 1000 / cases },
+        { "ns-per-parse", current.us_per_round * 1000 / cases },
+        { "legacy-allocations-per-parse", legacy.allocations_per_round / cases },
+        { "allocations-per-parse", current.allocations_per_round / cases }
+    };
+    tb::print("{}\n", report.dump(2));
+
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,88 @@
+#include <cstdlib>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+
+#include "bench/common.hpp"
+#include "common/codec.hpp"
+#include "webserver/results.hpp"
+
+// Times serving a search the way the webserver does, from the encoded products in a
+// query-result message to the rendered results page, and counts the heap allocations
+// made along the way. See docs/benchmarks.md
+
+constexpr size_t DEFAULT_PRODUCTS = 40;
+constexpr size_t DEFAULT_ROUNDS = 2000;
+constexpr uint64_t DEFAULT_SEED = 1;
+constexpr size_t ARENA_SIZE = 4 * 1024 * 1024;
+
+int main(int argc, char** argv)
+{
+    size_t product_count = DEFAULT_PRODUCTS, rounds = DEFAULT_ROUNDS;
+    uint64_t seed = DEFAULT_SEED;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string_view arg = argv[i];
+        if (arg == "--products") product_count = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (arg == "--rounds") rounds = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (arg == "--seed") seed = std::strtoull(argv[i + 1], nullptr, 10);
+    }
+
+    std::optional<std::string> page_source = ReadFile("templates/results.html"),
+                               listing_source = ReadFile("templates/listing.html");
+    std::optional<ResultsTemplates> templates;
+    if (page_source && listing_source)
+        templates = ResultsTemplates::Compile(*page_source, *listing_source);
+    if (!templates) {
+        Log(LogLevel::SEVERE, "Failed to compile templates, run from the repository root");
+        return 1;
+    }
+
+    std::mt19937_64 rng(seed);
+    ByteBuffer items;
+    items.reserve(product_count * ENCODED_PRODUCT_SIZE_HINT);
+    EncodeProductArrayHeader(items, product_count);
+    for (size_t i = 0; i < product_count; ++i)
+        EncodeProduct(items, GenerateProduct(rng, i));
+
+    tb::dynamically_allocated_array<std::byte, ARENA_SIZE> memory {};
+    tb::thread_safe_memory_arena arena = std::span { memory.begin(), memory.end() };
+
+    // The page must list every product
+    size_t page_bytes = 0, listed = 0;
+    {
+        std::optional<tb::arena_vector<ArenaProduct>> products
+            = DecodeProducts(items, arena);
+        if (products) {
+            std::string_view page = RenderResults(arena, *templates, "bench", *products);
+            page_bytes = page.size();
+            for (size_t at = page.find("item-listing"); at != std::string_view::npos;
+                 at = page.find("item-listing", at + 1))
+                ++listed;
+        }
+    }
+    arena.reset();
+
+    Timing request = TimeRounds(rounds, [&] {
+        size_t page_size;
+        {
+            std::optional<tb::arena_vector<ArenaProduct>> products
+                = DecodeProducts(items, arena);
+            page_size = RenderResults(arena, *templates, "bench", *products).size();
+        }
+        arena.reset();
+        return page_size;
+    });
+
+    json report = {
+        { "products", product_count },
+        { "listed", listed },
+        { "page-bytes", page_bytes },
+        { "request-us", request.us_per_round },
+        { "request-allocations", request.allocations_per_round }
+    };
+    tb::print("{}\n", report.dump(2));
+
+    return listed == product_count ? 0 : 1;
+}
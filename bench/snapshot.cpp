@@ -0,0 +1,145 @@
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <list>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "bench/common.hpp"
+#include "common/snapshot.hpp"
+
+// Fills the product and query databases' worth of snapshot entries with generated
+// products, then times writing full and incremental snapshots and loading them back,
+// and checks that what loads is what was written last. See docs/benchmarks.md
+
+constexpr size_t DEFAULT_CHANGED = 200;
+constexpr size_t DEFAULT_ADDED = 100;
+constexpr uint64_t DEFAULT_SEED = 1;
+
+template<typename Work>
+static double Milliseconds(Work&& work)
+{
+    BenchClock::time_point start = BenchClock::now();
+    work();
+    return std::chrono::duration<double, std::milli>(BenchClock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+    size_t changed = DEFAULT_CHANGED, added = DEFAULT_ADDED;
+    uint64_t seed = DEFAULT_SEED;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string_view arg = argv[i];
+        if (arg == "--changed") changed = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (arg == "--added") added = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (arg == "--seed") seed = std::strtoull(argv[i + 1], nullptr, 10);
+    }
+
+    std::filesystem::path directory
+        = std::filesystem::temp_directory_path() / "fitsch-bench-snapshot";
+    std::filesystem::remove_all(directory);
+
+    std::mt19937_64 rng(seed);
+    SnapshotWriter writer(directory.string());
+    size_t product_count = GetDatabaseInfo(SnapshotStore::PRODUCTS).capacity;
+    size_t query_count = GetDatabaseInfo(SnapshotStore::QUERIES).capacity;
+
+    // What the terminal's databases would hold, by key, and the order the writer forgets
+    // products in to stay within capacity
+    std::unordered_map<std::string, Product> expected;
+    std::list<std::string> recency;
+
+    auto put_product = [&] (const std::string& key, Product product) {
+        writer.RecordProduct(key, product);
+        if (!expected.insert_or_assign(key, std::move(product)).second)
+            recency.remove(key);
+        recency.push_back(key);
+
+        if (expected.size() > product_count) {
+            expected.erase(recency.front());
+            recency.pop_front();
+        }
+    };
+
+    auto put_new_product = [&] (size_t index) {
+        Product product = GenerateProduct(rng, index);
+        put_product(product.Key().ToHex(), std::move(product));
+    };
+
+    for (size_t i = 0; i < product_count; ++i) put_new_product(i);
+    std::vector<std::string> keys(recency.begin(), recency.end());
+    for (size_t i = 0; i < query_count; ++i) {
+        QueryTemplate query {
+            .query_string = std::format("query {}", i),
+            .stores = StoreID::TESCO | StoreID::ALDI,
+            .timestamp = Now(),
+            .depth = 10
+        };
+        for (const auto& [key, _] : expected) {
+            if (query.results.size() == 10) break;
+            query.results.emplace(*ProductKey::FromString(key),
+                QueryResultInfo { .relevance = query.results.size() });
+        }
+        writer.RecordQuery(query.query_string, query);
+    }
+
+    double full_ms = Milliseconds([&] { writer.WriteFull(); });
+
+    // Changes give existing products new prices, and added products make the writer
+    // forget the least recently changed
+    for (size_t i = 0; i < changed; ++i) {
+        const std::string& key = keys[i % keys.size()];
+        Product product = expected.at(key);
+        product.item_price.value += 1;
+        product.effective_prices = ComputeEffectivePrices(product);
+        product.timestamp = Now();
+        put_product(key, std::move(product));
+    }
+    for (size_t i = 0; i < added; ++i) put_new_product(product_count + i);
+    double incremental_ms = Milliseconds([&] { writer.WriteIncremental(); });
+
+    std::optional<LoadedSnapshot> snapshot;
+    double map_ms = Milliseconds([&] { snapshot = LoadSnapshot(directory.string()); });
+
+    size_t restored_products = 0, restored_queries = 0, mismatches = 0;
+    double decode_ms = Milliseconds([&] {
+        if (!snapshot) return;
+        auto products = DecodeProductEntries(*snapshot);
+        auto queries = DecodeQueryEntries(*snapshot);
+        restored_products = products.size();
+        restored_queries = queries.size();
+
+        for (const auto& [key, product] : products) {
+            auto iter = expected.find(std::string(key));
+            if (iter == expected.end() || json(iter->second) != json(product)) {
+                Log(LogLevel::WARNING, "Product {} restored differently", key);
+                ++mismatches;
+            }
+        }
+    });
+
+    bool complete = restored_products == expected.size() && restored_queries == query_count;
+
+    json report = {
+        { "products", restored_products },
+        { "queries", restored_queries },
+        { "mismatches", mismatches },
+        { "full-snapshot-bytes",
+            std::filesystem::file_size(directory / FULL_SNAPSHOT_NAME) },
+        { "incremental-snapshot-bytes",
+            std::filesystem::file_size(directory / INCREMENTAL_SNAPSHOT_NAME) },
+        { "full-write-ms", full_ms },
+        { "incremental-write-ms", incremental_ms },
+        { "map-ms", map_ms },
+        { "decode-ms", decode_ms }
+    };
+    tb::print("{}\n", report.dump(2));
+
+    std::filesystem::remove_all(directory);
+
+    return complete && mismatches == 0 ? 0 : 1;
+}
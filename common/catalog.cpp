@@ -0,0 +1,244 @@
+#include "common/catalog.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+#include <mutex>
+
+// StringTable
+
+StringTable::ID StringTable::Intern(std::string_view str)
+{
+    if (auto iter = index.find(str); iter != index.end())
+        return iter->second;
+
+    if (chunks.empty() || chunk_used + str.size() > CHUNK_SIZE) {
+        chunks.emplace_back(new char[std::max(str.size(), CHUNK_SIZE)]);
+        chunk_used = 0;
+    }
+
+    char* data = chunks.back().get() + chunk_used;
+    std::memcpy(data, str.data(), str.size());
+    // A string longer than a chunk fills its own
+    chunk_used = str.size() > CHUNK_SIZE ? CHUNK_SIZE : chunk_used + str.size();
+
+    ID id = static_cast<ID>(strings.size());
+    std::string_view stored { data, str.size() };
+    strings.push_back(stored);
+    index.emplace(stored, id);
+
+    return id;
+}
+
+std::string_view StringTable::Get(ID id) const { return strings[id]; }
+
+size_t StringTable::Size() const { return strings.size(); }
+
+// CatalogEntry
+
+void to_json(json& j, const CatalogEntry& entry)
+{
+    j = {
+        { "id", entry.id },
+        { "name", entry.name },
+        { "url", entry.url },
+        { "image-url", entry.image_url },
+        { "item-price", entry.item_price },
+        { "unit-price", entry.unit_price },
+        { "effective-price", entry.effective_price },
+        { "member-price", entry.member_price },
+        { "unit", entry.unit },
+        { "store", entry.store },
+        { "timestamp", entry.timestamp }
+    };
+}
+
+// Catalog
+
+// Interned strings referenced by each row
+constexpr size_t STRINGS_PER_ROW = 4;
+
+Catalog::Catalog(size_t capacity) : capacity(std::max<size_t>(capacity, 1)) {}
+
+template<typename AATypes>
+void Catalog::Put(const BasicProduct<AATypes>& product)
+{
+    std::unique_lock lock { mutex };
+
+    ProductKey key = product.Key();
+    Row row;
+
+    if (auto iter = rows_by_key.find(key); iter != rows_by_key.end()) {
+        row = iter->second;
+        recency.splice(recency.end(), recency, recency_of_rows[row]);
+    } else if (ids.size() < capacity) {
+        row = static_cast<Row>(ids.size());
+        for (auto* column : { &item_prices, &unit_prices, &effective_prices,
+                              &member_prices })
+            column->emplace_back();
+        units.emplace_back();
+        stores.emplace_back();
+        timestamps.emplace_back();
+        keys.push_back(key);
+        recency_of_rows.push_back(recency.insert(recency.end(), row));
+        ids.push_back(strings.Intern(product.id));
+        names.emplace_back();
+        urls.emplace_back();
+        image_urls.emplace_back();
+        rows_by_key.emplace(key, row);
+    } else {
+        row = recency.front();
+        recency.splice(recency.end(), recency, recency.begin());
+        rows_by_key.erase(keys[row]);
+        keys[row] = key;
+        ids[row] = strings.Intern(product.id);
+        rows_by_key.emplace(key, row);
+    }
+
+    const EffectivePrices& prices = product.effective_prices;
+    item_prices[row] = product.item_price.value;
+    unit_prices[row] = prices.normal;
+    effective_prices[row] = prices.bulk;
+    member_prices[row] = prices.member;
+    units[row] = static_cast<uint8_t>(prices.unit);
+    stores[row] = static_cast<uint8_t>(product.store);
+    timestamps[row] = product.timestamp.time_since_epoch().count();
+    names[row] = strings.Intern(product.name);
+    urls[row] = strings.Intern(product.url);
+    image_urls[row] = strings.Intern(product.image_url);
+
+    // Replaced names and URLs and evicted products leave strings behind. Dropping them
+    // once the table holds twice as many as the rows can use keeps the cost per put
+    // constant.
+    if (strings.Size() > 2 * STRINGS_PER_ROW * ids.size())
+        CompactStrings();
+}
+
+template void Catalog::Put(const Product& product);
+template void Catalog::Put(const ArenaProduct& product);
+
+size_t Catalog::Size() const
+{
+    std::shared_lock lock { mutex };
+    return ids.size();
+}
+
+void Catalog::CompactStrings()
+{
+    StringTable compacted;
+    for (auto* column : { &ids, &names, &urls, &image_urls }) {
+        for (StringTable::ID& id : *column)
+            id = compacted.Intern(strings.Get(id));
+    }
+
+    strings = std::move(compacted);
+}
+
+const std::vector<unsigned>& Catalog::Column(PriceColumn column) const
+{
+    switch (column) {
+    case PriceColumn::ITEM: return item_prices;
+    case PriceColumn::UNIT: return unit_prices;
+    case PriceColumn::EFFECTIVE: return effective_prices;
+    default: return member_prices;
+    }
+}
+
+std::vector<Catalog::Row> Catalog::Select(const CatalogFilter& filter,
+    PriceColumn column) const
+{
+    const unsigned* prices = Column(column).data();
+    const uint8_t* unit_column = units.data();
+    const uint8_t* store_column = stores.data();
+    const int64_t* timestamp_column = timestamps.data();
+
+    const uint8_t unit = static_cast<uint8_t>(filter.unit.value_or(Unit::None));
+    const uint8_t unit_mask = filter.unit ? 0xFF : 0;
+    const uint8_t store_mask = filter.stores
+        ? static_cast<uint8_t>(filter.stores._enum_field) : 0xFF;
+    const unsigned max_price = filter.max_price;
+    const int64_t newer_than = filter.newer_than.time_since_epoch().count();
+
+    // Every row is tested without branching and its index written unconditionally,
+    // advancing past it only if it passed, so that the loop vectorises
+    const size_t size = ids.size();
+    std::vector<Row> selected(size);
+    Row* out = selected.data();
+    size_t count = 0;
+
+    for (size_t i = 0; i < size; ++i) {
+        bool keep = (((unit_column[i] ^ unit) & unit_mask) == 0)
+                  & ((store_column[i] & store_mask) != 0)
+                  & (prices[i] <= max_price)
+                  & (timestamp_column[i] >= newer_than);
+        out[count] = static_cast<Row>(i);
+        count += keep;
+    }
+
+    selected.resize(count);
+    return selected;
+}
+
+CatalogEntry Catalog::Entry(Row row) const
+{
+    return {
+        .id = std::string(strings.Get(ids[row])),
+        .name = std::string(strings.Get(names[row])),
+        .url = std::string(strings.Get(urls[row])),
+        .image_url = std::string(strings.Get(image_urls[row])),
+        .item_price = item_prices[row],
+        .unit_price = unit_prices[row],
+        .effective_price = effective_prices[row],
+        .member_price = member_prices[row],
+        .unit = static_cast<Unit>(units[row]),
+        .store = static_cast<StoreID>(stores[row]),
+        .timestamp = TimePoint { std::chrono::seconds { timestamps[row] } }
+    };
+}
+
+std::vector<CatalogEntry> Catalog::TopK(const CatalogFilter& filter, PriceColumn column,
+    size_t count) const
+{
+    std::shared_lock lock { mutex };
+
+    std::vector<Row> rows = Select(filter, column);
+    const std::vector<unsigned>& prices = Column(column);
+
+    count = std::min(count, rows.size());
+    std::partial_sort(rows.begin(), rows.begin() + count, rows.end(),
+        [&prices] (Row a, Row b) {
+            return prices[a] < prices[b] || (prices[a] == prices[b] && a < b);
+        });
+
+    std::vector<CatalogEntry> result;
+    result.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+        result.push_back(Entry(rows[i]));
+
+    return result;
+}
+
+std::vector<CatalogEntry> Catalog::CheapestPerUnit(const CatalogFilter& filter,
+    PriceColumn column) const
+{
+    std::shared_lock lock { mutex };
+
+    const std::vector<unsigned>& prices = Column(column);
+    constexpr Row NONE = std::numeric_limits<Row>::max();
+    std::array<Row, static_cast<size_t>(Unit::Metres) + 1> cheapest;
+    cheapest.fill(NONE);
+
+    for (Row row : Select(filter, column)) {
+        Row& best = cheapest[units[row]];
+        if (best == NONE || prices[row] < prices[best])
+            best = row;
+    }
+
+    std::vector<CatalogEntry> result;
+    for (Row row : cheapest) {
+        if (row != NONE) result.push_back(Entry(row));
+    }
+
+    return result;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <list>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "common/product.hpp"
+#include "common/util.hpp"
+
+// Interned strings, stored back to back in large chunks. Strings are never removed,
+// so views of them stay valid for the lifetime of the table; to drop strings no longer
+// used, intern the ones still used into a new table.
+class StringTable
+{
+public:
+    using ID = uint32_t;
+
+    ID Intern(std::string_view str);
+    std::string_view Get(ID id) const;
+    size_t Size() const;
+
+private:
+    constexpr static size_t CHUNK_SIZE = 256 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> chunks;
+    size_t chunk_used = CHUNK_SIZE;
+    std::vector<std::string_view> strings;
+    std::unordered_map<std::string_view, ID> index;
+};
+
+enum class PriceColumn
+{
+    ITEM,
+    UNIT,      // EffectivePrices::normal
+    EFFECTIVE, // EffectivePrices::bulk
+    MEMBER     // EffectivePrices::member
+};
+
+struct CatalogEntry
+{
+    std::string id, name, url, image_url;
+    unsigned item_price, unit_price, effective_price, member_price;
+    Unit unit;
+    StoreID store;
+    TimePoint timestamp;
+};
+
+void to_json(json& j, const CatalogEntry& entry);
+
+struct CatalogFilter
+{
+    std::optional<Unit> unit;
+    StoreSelection stores {}; // All stores if empty
+    // Compared against the column being ranked by
+    unsigned max_price = std::numeric_limits<unsigned>::max();
+    TimePoint newer_than {};
+};
+
+constexpr size_t DEFAULT_CATALOG_CAPACITY = 200'000;
+
+// Products held column by column, so that ranking by price only reads the columns it
+// needs. Names, URLs and IDs are interned. Products are keyed by ProductKey; putting
+// a product already present replaces its row. Once `capacity` products are held, a new
+// one takes the row of the least recently put. Thread-safe.
+class Catalog
+{
+public:
+    explicit Catalog(size_t capacity = DEFAULT_CATALOG_CAPACITY);
+
+    template<typename AATypes>
+    void Put(const BasicProduct<AATypes>& product);
+
+    size_t Size() const;
+    // The `count` cheapest products by `column` that pass `filter`, cheapest first
+    std::vector<CatalogEntry> TopK(const CatalogFilter& filter, PriceColumn column,
+                                   size_t count) const;
+    // The cheapest product by `column` that passes `filter` for each unit
+    std::vector<CatalogEntry> CheapestPerUnit(const CatalogFilter& filter,
+                                              PriceColumn column) const;
+
+private:
+    using Row = uint32_t;
+
+    const std::vector<unsigned>& Column(PriceColumn column) const;
+    // Rows passing `filter`, in row order
+    std::vector<Row> Select(const CatalogFilter& filter, PriceColumn column) const;
+    CatalogEntry Entry(Row row) const;
+    // Re-interns the strings of every row into a new table, dropping those of
+    // replaced products
+    void CompactStrings();
+
+    mutable std::shared_mutex mutex;
+
+    size_t capacity;
+    StringTable strings;
+    std::unordered_map<ProductKey, Row> rows_by_key;
+    // Least recently put first
+    std::list<Row> recency;
+    std::vector<ProductKey> keys;
+    std::vector<std::list<Row>::iterator> recency_of_rows;
+
+    std::vector<unsigned> item_prices, unit_prices, effective_prices, member_prices;
+    std::vector<uint8_t> units, stores;
+    std::vector<int64_t> timestamps;
+    std::vector<StringTable::ID> ids, names, urls, image_urls;
+};
@@ -0,0 +1,619 @@
+#include "common/codec.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <concepts>
+#include <limits>
+#include <type_traits>
+#include <variant>
+
+// MessagePack type tags
+
+constexpr uint8_t MP_FIXMAP = 0x80, MP_FIXARRAY = 0x90, MP_FIXSTR = 0xa0;
+constexpr uint8_t MP_NIL = 0xc0, MP_FALSE = 0xc2, MP_TRUE = 0xc3;
+constexpr uint8_t MP_BIN8 = 0xc4, MP_BIN16 = 0xc5, MP_BIN32 = 0xc6;
+constexpr uint8_t MP_EXT8 = 0xc7, MP_EXT16 = 0xc8, MP_EXT32 = 0xc9;
+constexpr uint8_t MP_FLOAT32 = 0xca, MP_FLOAT64 = 0xcb;
+constexpr uint8_t MP_UINT8 = 0xcc, MP_UINT16 = 0xcd, MP_UINT32 = 0xce, MP_UINT64 = 0xcf;
+constexpr uint8_t MP_INT8 = 0xd0, MP_INT16 = 0xd1, MP_INT32 = 0xd2, MP_INT64 = 0xd3;
+constexpr uint8_t MP_FIXEXT1 = 0xd4, MP_FIXEXT16 = 0xd8;
+constexpr uint8_t MP_STR8 = 0xd9, MP_STR16 = 0xda, MP_STR32 = 0xdb;
+constexpr uint8_t MP_ARRAY16 = 0xdc, MP_ARRAY32 = 0xdd, MP_MAP16 = 0xde, MP_MAP32 = 0xdf;
+constexpr uint8_t MP_NEGATIVE_FIXINT = 0xe0;
+
+// MsgpackWriter
+
+class MsgpackWriter
+{
+public:
+    explicit MsgpackWriter(ByteBuffer& out) : out(out) {}
+
+    void Bool(bool value) { out.push_back(value ? MP_TRUE : MP_FALSE); }
+
+    void UInt(uint64_t value)
+    {
+        if (value < MP_FIXMAP) out.push_back(static_cast<uint8_t>(value));
+        else if (value <= UINT8_MAX) BigEndian(MP_UINT8, static_cast<uint8_t>(value));
+        else if (value <= UINT16_MAX) BigEndian(MP_UINT16, static_cast<uint16_t>(value));
+        else if (value <= UINT32_MAX) BigEndian(MP_UINT32, static_cast<uint32_t>(value));
+        else BigEndian(MP_UINT64, value);
+    }
+
+    void Int(int64_t value)
+    {
+        if (value >= 0) UInt(static_cast<uint64_t>(value));
+        else if (value >= -32) out.push_back(static_cast<uint8_t>(value));
+        else if (value >= INT8_MIN) BigEndian(MP_INT8, static_cast<int8_t>(value));
+        else if (value >= INT16_MIN) BigEndian(MP_INT16, static_cast<int16_t>(value));
+        else if (value >= INT32_MIN) BigEndian(MP_INT32, static_cast<int32_t>(value));
+        else BigEndian(MP_INT64, value);
+    }
+
+    void Float(float value) { BigEndian(MP_FLOAT32, std::bit_cast<uint32_t>(value)); }
+
+    void String(std::string_view str)
+    {
+        size_t size = str.size();
+        if (size < 32) out.push_back(MP_FIXSTR | static_cast<uint8_t>(size));
+        else if (size <= UINT8_MAX) BigEndian(MP_STR8, static_cast<uint8_t>(size));
+        else if (size <= UINT16_MAX) BigEndian(MP_STR16, static_cast<uint16_t>(size));
+        else BigEndian(MP_STR32, static_cast<uint32_t>(size));
+        out.insert(out.end(), str.begin(), str.end());
+    }
+
+    void Array(size_t size) { Container(size, MP_FIXARRAY, MP_ARRAY16, MP_ARRAY32); }
+    void Map(size_t size) { Container(size, MP_FIXMAP, MP_MAP16, MP_MAP32); }
+
+private:
+    template<std::integral T>
+    void BigEndian(uint8_t tag, T value)
+    {
+        auto bits = static_cast<std::make_unsigned_t<T>>(value);
+        out.push_back(tag);
+        for (int shift = (sizeof(T) - 1) * 8; shift >= 0; shift -= 8)
+            out.push_back(static_cast<uint8_t>(bits >> shift));
+    }
+
+    void Container(size_t size, uint8_t fix_tag, uint8_t tag16, uint8_t tag32)
+    {
+        if (size < 16) out.push_back(fix_tag | static_cast<uint8_t>(size));
+        else if (size <= UINT16_MAX) BigEndian(tag16, static_cast<uint16_t>(size));
+        else BigEndian(tag32, static_cast<uint32_t>(size));
+    }
+
+    ByteBuffer& out;
+};
+
+// MsgpackReader
+
+// Reads values in order. A failed read leaves the position undefined, so decoding should
+// stop at the first failure.
+class MsgpackReader
+{
+public:
+    explicit MsgpackReader(std::span<const uint8_t> data,
+        tb::thread_safe_memory_arena* arena = nullptr) : arena(arena), data(data) {}
+
+    // Where objects read are allocated, if they are of arena types
+    tb::thread_safe_memory_arena* arena;
+
+    size_t Remaining() const { return data.size() - position; }
+
+    std::optional<bool> Bool();
+    std::optional<int64_t> Int();
+    std::optional<uint64_t> UInt();
+    std::optional<double> Float();
+    std::optional<std::string_view> String();
+    std::optional<size_t> Array()
+    {
+        return Container(MP_FIXARRAY, MP_ARRAY16, MP_ARRAY32);
+    }
+    std::optional<size_t> Map() { return Container(MP_FIXMAP, MP_MAP16, MP_MAP32); }
+    // Skips one value of any type, along with anything nested in it
+    bool Skip();
+
+private:
+    std::optional<uint8_t> Next();
+    template<std::integral T> std::optional<T> BigEndian();
+    std::optional<size_t> Container(uint8_t fix_tag, uint8_t tag16, uint8_t tag32);
+
+    std::span<const uint8_t> data;
+    size_t position = 0;
+};
+
+std::optional<uint8_t> MsgpackReader::Next()
+{
+    if (position == data.size()) return std::nullopt;
+    return data[position++];
+}
+
+template<std::integral T>
+std::optional<T> MsgpackReader::BigEndian()
+{
+    if (Remaining() < sizeof(T)) return std::nullopt;
+
+    uint64_t bits = 0;
+    for (size_t i = 0; i < sizeof(T); ++i)
+        bits = (bits << 8) | data[position++];
+    return static_cast<T>(static_cast<std::make_unsigned_t<T>>(bits));
+}
+
+std::optional<bool> MsgpackReader::Bool()
+{
+    std::optional<uint8_t> tag = Next();
+    if (tag == MP_TRUE) return true;
+    if (tag == MP_FALSE) return false;
+    return std::nullopt;
+}
+
+std::optional<int64_t> MsgpackReader::Int()
+{
+    std::optional<uint8_t> tag = Next();
+    if (!tag) return std::nullopt;
+    if (*tag < MP_FIXMAP) return *tag;
+    if (*tag >= MP_NEGATIVE_FIXINT) return static_cast<int8_t>(*tag);
+
+    switch (*tag) {
+    case MP_UINT8: return BigEndian<uint8_t>();
+    case MP_UINT16: return BigEndian<uint16_t>();
+    case MP_UINT32: return BigEndian<uint32_t>();
+    case MP_UINT64: {
+        std::optional<uint64_t> value = BigEndian<uint64_t>();
+        if (!value || *value > std::numeric_limits<int64_t>::max()) return std::nullopt;
+        return static_cast<int64_t>(*value);
+    }
+    case MP_INT8: return BigEndian<int8_t>();
+    case MP_INT16: return BigEndian<int16_t>();
+    case MP_INT32: return BigEndian<int32_t>();
+    case MP_INT64: return BigEndian<int64_t>();
+    default: return std::nullopt;
+    }
+}
+
+std::optional<uint64_t> MsgpackReader::UInt()
+{
+    if (position < data.size() && data[position] == MP_UINT64) {
+        ++position;
+        return BigEndian<uint64_t>();
+    }
+
+    std::optional<int64_t> value = Int();
+    if (!value || *value < 0) return std::nullopt;
+    return static_cast<uint64_t>(*value);
+}
+
+std::optional<double> MsgpackReader::Float()
+{
+    if (position < data.size() && data[position] == MP_FLOAT32) {
+        ++position;
+        std::optional<uint32_t> bits = BigEndian<uint32_t>();
+        if (!bits) return std::nullopt;
+        return std::bit_cast<float>(*bits);
+    }
+
+    if (position < data.size() && data[position] == MP_FLOAT64) {
+        ++position;
+        std::optional<uint64_t> bits = BigEndian<uint64_t>();
+        if (!bits) return std::nullopt;
+        return std::bit_cast<double>(*bits);
+    }
+
+    // Whole numbers may have been written as integers
+    std::optional<int64_t> value = Int();
+    if (!value) return std::nullopt;
+    return static_cast<double>(*value);
+}
+
+std::optional<std::string_view> MsgpackReader::String()
+{
+    std::optional<uint8_t> tag = Next();
+    if (!tag) return std::nullopt;
+
+    std::optional<size_t> size;
+    if ((*tag & 0xe0) == MP_FIXSTR) size = *tag & 0x1f;
+    else if (*tag == MP_STR8) size = BigEndian<uint8_t>();
+    else if (*tag == MP_STR16) size = BigEndian<uint16_t>();
+    else if (*tag == MP_STR32) size = BigEndian<uint32_t>();
+
+    if (!size || *size > Remaining()) return std::nullopt;
+
+    std::string_view str { reinterpret_cast<const char*>(data.data() + position), *size };
+    position += *size;
+    return str;
+}
+
+std::optional<size_t> MsgpackReader::Container(uint8_t fix_tag, uint8_t tag16,
+    uint8_t tag32)
+{
+    std::optional<uint8_t> tag = Next();
+    if (!tag) return std::nullopt;
+
+    std::optional<size_t> size;
+    if ((*tag & 0xf0) == fix_tag) size = *tag & 0x0f;
+    else if (*tag == tag16) size = BigEndian<uint16_t>();
+    else if (*tag == tag32) size = BigEndian<uint32_t>();
+
+    // Every element takes at least a byte, so larger sizes are malformed
+    if (!size || *size > Remaining()) return std::nullopt;
+    return size;
+}
+
+bool MsgpackReader::Skip()
+{
+    // Every value read takes at least a byte, so this ends with the data
+    for (uint64_t pending = 1; pending > 0; --pending) {
+        std::optional<uint8_t> tag = Next();
+        if (!tag) return false;
+
+        std::optional<uint64_t> skip = 0, size;
+        if (*tag < MP_FIXMAP || *tag >= MP_NEGATIVE_FIXINT) {
+            skip = 0;
+        } else if ((*tag & 0xf0) == MP_FIXMAP) {
+            pending += 2 * (*tag & 0x0f);
+        } else if ((*tag & 0xf0) == MP_FIXARRAY) {
+            pending += *tag & 0x0f;
+        } else if ((*tag & 0xe0) == MP_FIXSTR) {
+            skip = *tag & 0x1f;
+        } else if (*tag >= MP_FIXEXT1 && *tag <= MP_FIXEXT16) {
+            skip = 1 + (1 << (*tag - MP_FIXEXT1));
+        } else {
+            switch (*tag) {
+            case MP_NIL: case MP_FALSE: case MP_TRUE: break;
+            case MP_UINT8: case MP_INT8: skip = 1; break;
+            case MP_UINT16: case MP_INT16: skip = 2; break;
+            case MP_UINT32: case MP_INT32: case MP_FLOAT32: skip = 4; break;
+            case MP_UINT64: case MP_INT64: case MP_FLOAT64: skip = 8; break;
+            case MP_STR8: case MP_BIN8: case MP_EXT8:
+                skip = BigEndian<uint8_t>(); break;
+            case MP_STR16: case MP_BIN16: case MP_EXT16:
+                skip = BigEndian<uint16_t>(); break;
+            case MP_STR32: case MP_BIN32: case MP_EXT32:
+                skip = BigEndian<uint32_t>(); break;
+            case MP_ARRAY16: case MP_MAP16: size = BigEndian<uint16_t>(); break;
+            case MP_ARRAY32: case MP_MAP32: size = BigEndian<uint32_t>(); break;
+            default: return false;
+            }
+        }
+
+        // Extension types have a type byte after their size
+        if (skip && (*tag == MP_EXT8 || *tag == MP_EXT16 || *tag == MP_EXT32))
+            ++*skip;
+
+        if (size) {
+            bool map = *tag == MP_MAP16 || *tag == MP_MAP32;
+            pending += map ? 2 * *size : *size;
+        } else if (*tag >= MP_ARRAY16 && *tag <= MP_MAP32) {
+            return false;
+        }
+
+        if (!skip || *skip > Remaining()) return false;
+        position += *skip;
+    }
+
+    return true;
+}
+
+// Encoding
+
+static void Write(MsgpackWriter& writer, const Price& price)
+{
+    writer.Array(2);
+    writer.UInt(static_cast<unsigned>(price.currency));
+    writer.UInt(price.value);
+}
+
+static void Write(MsgpackWriter& writer, const PricePU& price)
+{
+    writer.Array(2);
+    writer.UInt(static_cast<unsigned>(price.unit));
+    Write(writer, price.price);
+}
+
+static void Write(MsgpackWriter& writer, const EffectivePrices& prices)
+{
+    writer.Map(5);
+    writer.String("unit");
+    writer.UInt(static_cast<unsigned>(prices.unit));
+    writer.String("normal");
+    writer.UInt(prices.normal);
+    writer.String("single");
+    writer.UInt(prices.single);
+    writer.String("bulk");
+    writer.UInt(prices.bulk);
+    writer.String("member");
+    writer.UInt(prices.member);
+}
+
+template<typename AATypes>
+static void Write(MsgpackWriter& writer, const BasicOffer<AATypes>& offer)
+{
+    writer.Map(7);
+    writer.String("text");
+    writer.String(offer.text);
+    writer.String("price");
+    Write(writer, offer.price);
+    writer.String("bulk_amount");
+    writer.UInt(offer.bulk_amount);
+    writer.String("expiry");
+    writer.Int(offer.expiry.time_since_epoch().count());
+    writer.String("type");
+    writer.UInt(static_cast<unsigned>(offer.type));
+    writer.String("membership_only");
+    writer.Bool(offer.membership_only);
+    writer.String("price_reduction_multiplier");
+    writer.Float(offer.price_reduction_multiplier);
+}
+
+void EncodeProductArrayHeader(ByteBuffer& out, size_t count)
+{
+    MsgpackWriter { out }.Array(count);
+}
+
+template<typename AATypes>
+void EncodeProduct(ByteBuffer& out, const BasicProduct<AATypes>& product)
+{
+    MsgpackWriter writer { out };
+
+    writer.Map(12);
+    writer.String("name");
+    writer.String(product.name);
+    writer.String("offers");
+    writer.Array(product.offers.size());
+    for (const auto& offer : product.offers)
+        Write(writer, offer);
+    writer.String("description");
+    writer.String(product.description);
+    writer.String("image_url");
+    writer.String(product.image_url);
+    writer.String("url");
+    writer.String(product.url);
+    writer.String("id");
+    writer.String(product.id);
+    writer.String("item_price");
+    Write(writer, product.item_price);
+    writer.String("price_per_unit");
+    Write(writer, product.price_per_unit);
+    writer.String("effective_prices");
+    Write(writer, product.effective_prices);
+    writer.String("store");
+    writer.UInt(static_cast<unsigned>(product.store));
+    writer.String("timestamp");
+    writer.Int(product.timestamp.time_since_epoch().count());
+    writer.String("full_info");
+    writer.Bool(product.full_info);
+}
+
+template void EncodeProduct(ByteBuffer& out, const Product& product);
+template void EncodeProduct(ByteBuffer& out, const ArenaProduct& product);
+
+void EncodeProduct(ByteBuffer& out, const PMRProduct& product)
+{
+    std::visit([&out] (const auto& p) { EncodeProduct(out, p); }, product);
+}
+
+// Decoding
+
+// A default object, allocated in the reader's arena if it is of an arena type
+template<typename T>
+static T New(MsgpackReader& reader)
+{
+    if constexpr (requires { T::WithArena(*reader.arena); })
+        return T::WithArena(*reader.arena);
+    else
+        return T {};
+}
+
+template<typename Allocator>
+static bool Read(MsgpackReader& reader,
+    std::basic_string<char, std::char_traits<char>, Allocator>& str)
+{
+    std::optional<std::string_view> value = reader.String();
+    if (value) str.assign(value->data(), value->size());
+    return value.has_value();
+}
+
+static bool Read(MsgpackReader& reader, bool& flag)
+{
+    std::optional<bool> value = reader.Bool();
+    if (value) flag = *value;
+    return value.has_value();
+}
+
+template<std::unsigned_integral T>
+static bool Read(MsgpackReader& reader, T& number)
+{
+    std::optional<uint64_t> value = reader.UInt();
+    if (!value || *value > std::numeric_limits<T>::max()) return false;
+    number = static_cast<T>(*value);
+    return true;
+}
+
+// Whether a value read is one of the enum's, so that no other reaches a switch or
+// indexes a table by it
+constexpr bool IsEnumValue(StoreID store) { return !GetStorePrefix(store).empty(); }
+constexpr bool IsEnumValue(Currency currency) { return currency <= Currency::EUR; }
+constexpr bool IsEnumValue(Unit unit) { return unit <= Unit::Metres; }
+constexpr bool IsEnumValue(OfferType type)
+{
+    return type <= OfferType::MEMBERSHIP_DEAL_ONLY;
+}
+
+template<typename E> requires std::is_enum_v<E>
+static bool Read(MsgpackReader& reader, E& e)
+{
+    unsigned value;
+    if (!Read(reader, value) || !IsEnumValue(static_cast<E>(value))) return false;
+    e = static_cast<E>(value);
+    return true;
+}
+
+static bool Read(MsgpackReader& reader, float& number)
+{
+    std::optional<double> value = reader.Float();
+    if (value) number = static_cast<float>(*value);
+    return value.has_value();
+}
+
+static bool Read(MsgpackReader& reader, TimePoint& timepoint)
+{
+    std::optional<int64_t> value = reader.Int();
+    if (value) timepoint = TimePoint { std::chrono::seconds { *value } };
+    return value.has_value();
+}
+
+static bool Read(MsgpackReader& reader, Price& price)
+{
+    return reader.Array() == 2 && Read(reader, price.currency)
+        && Read(reader, price.value);
+}
+
+static bool Read(MsgpackReader& reader, PricePU& price)
+{
+    return reader.Array() == 2 && Read(reader, price.unit) && Read(reader, price.price);
+}
+
+// A key of a map, and how to read its value into an object
+template<typename T>
+struct Field
+{
+    std::string_view key;
+    bool (*read)(MsgpackReader&, T&);
+    bool required = false;
+};
+
+// Reads a map into `object`, checking each field's type. Unknown keys are skipped.
+template<typename T, size_t N>
+static bool ReadFields(MsgpackReader& reader, T& object,
+    const std::array<Field<T>, N>& fields)
+{
+    std::optional<size_t> size = reader.Map();
+    if (!size) return false;
+
+    std::array<bool, N> seen {};
+    for (size_t i = 0; i < *size; ++i) {
+        std::optional<std::string_view> key = reader.String();
+        if (!key) return false;
+
+        auto field = std::find_if(fields.begin(), fields.end(),
+            [&key] (const Field<T>& f) { return f.key == *key; });
+
+        if (field == fields.end()) {
+            if (!reader.Skip()) return false;
+            continue;
+        }
+
+        if (!field->read(reader, object)) return false;
+        seen[field - fields.begin()] = true;
+    }
+
+    for (size_t i = 0; i < N; ++i) {
+        if (fields[i].required && !seen[i]) return false;
+    }
+
+    return true;
+}
+
+// Reads an array of maps into `objects`, which must be empty
+template<typename Vector, size_t N>
+static bool ReadArray(MsgpackReader& reader, Vector& objects,
+    const std::array<Field<typename Vector::value_type>, N>& fields)
+{
+    std::optional<size_t> size = reader.Array();
+    if (!size) return false;
+
+    objects.reserve(*size);
+    for (size_t i = 0; i < *size; ++i) {
+        objects.push_back(New<typename Vector::value_type>(reader));
+        if (!ReadFields(reader, objects.back(), fields)) return false;
+    }
+
+    return true;
+}
+
+constexpr auto EFFECTIVE_PRICES_FIELDS = std::to_array<Field<EffectivePrices>>({
+    { "unit", [] (MsgpackReader& r, auto& p) { return Read(r, p.unit); } },
+    { "normal", [] (MsgpackReader& r, auto& p) { return Read(r, p.normal); } },
+    { "single", [] (MsgpackReader& r, auto& p) { return Read(r, p.single); } },
+    { "bulk", [] (MsgpackReader& r, auto& p) { return Read(r, p.bulk); } },
+    { "member", [] (MsgpackReader& r, auto& p) { return Read(r, p.member); } }
+});
+
+static bool Read(MsgpackReader& reader, EffectivePrices& prices)
+{
+    return ReadFields(reader, prices, EFFECTIVE_PRICES_FIELDS);
+}
+
+template<typename OfferT>
+constexpr auto OFFER_FIELDS = std::to_array<Field<OfferT>>({
+    { "text", [] (MsgpackReader& r, auto& o) { return Read(r, o.text); } },
+    { "price", [] (MsgpackReader& r, auto& o) { return Read(r, o.price); } },
+    { "bulk_amount", [] (MsgpackReader& r, auto& o) { return Read(r, o.bulk_amount); } },
+    { "expiry", [] (MsgpackReader& r, auto& o) { return Read(r, o.expiry); } },
+    { "type", [] (MsgpackReader& r, auto& o) { return Read(r, o.type); } },
+    { "membership_only", [] (MsgpackReader& r, auto& o) {
+        return Read(r, o.membership_only);
+    } },
+    { "price_reduction_multiplier", [] (MsgpackReader& r, auto& o) {
+        return Read(r, o.price_reduction_multiplier);
+    } }
+});
+
+template<typename ProductT>
+constexpr auto PRODUCT_FIELDS = std::to_array<Field<ProductT>>({
+    { "name", [] (MsgpackReader& r, auto& p) { return Read(r, p.name); } },
+    { "offers", [] (MsgpackReader& r, auto& p) {
+        using OfferT = typename std::remove_reference_t<decltype(p.offers)>::value_type;
+        return ReadArray(r, p.offers, OFFER_FIELDS<OfferT>);
+    } },
+    { "description", [] (MsgpackReader& r, auto& p) { return Read(r, p.description); } },
+    { "image_url", [] (MsgpackReader& r, auto& p) { return Read(r, p.image_url); } },
+    { "url", [] (MsgpackReader& r, auto& p) { return Read(r, p.url); } },
+    { "id", [] (MsgpackReader& r, auto& p) { return Read(r, p.id); }, true },
+    { "item_price", [] (MsgpackReader& r, auto& p) { return Read(r, p.item_price); } },
+    { "price_per_unit", [] (MsgpackReader& r, auto& p) {
+        return Read(r, p.price_per_unit);
+    } },
+    { "effective_prices", [] (MsgpackReader& r, auto& p) {
+        return Read(r, p.effective_prices);
+    } },
+    { "store", [] (MsgpackReader& r, auto& p) { return Read(r, p.store); }, true },
+    { "timestamp", [] (MsgpackReader& r, auto& p) { return Read(r, p.timestamp); } },
+    { "full_info", [] (MsgpackReader& r, auto& p) { return Read(r, p.full_info); } }
+});
+
+static_assert(PRODUCT_FIELDS<Product>.size() == 12 && OFFER_FIELDS<Offer>.size() == 7
+           && EFFECTIVE_PRICES_FIELDS.size() == 5,
+    "Every field encoded must be read back");
+
+std::optional<std::vector<Product>> DecodeProducts(std::span<const uint8_t> data)
+{
+    MsgpackReader reader { data };
+    std::vector<Product> products;
+
+    if (!ReadArray(reader, products, PRODUCT_FIELDS<Product>) || reader.Remaining() != 0)
+        return std::nullopt;
+    return products;
+}
+
+std::optional<Product> DecodeProduct(std::span<const uint8_t> data)
+{
+    MsgpackReader reader { data };
+    Product product;
+
+    if (!ReadFields(reader, product, PRODUCT_FIELDS<Product>) || reader.Remaining() != 0)
+        return std::nullopt;
+    return product;
+}
+
+std::optional<tb::arena_vector<ArenaProduct>> DecodeProducts(
+    std::span<const uint8_t> data, tb::thread_safe_memory_arena& arena)
+{
+    MsgpackReader reader { data, &arena };
+    tb::arena_vector<ArenaProduct> products { arena };
+
+    if (!ReadArray(reader, products, PRODUCT_FIELDS<ArenaProduct>)
+        || reader.Remaining() != 0)
+        return std::nullopt;
+    return products;
+}
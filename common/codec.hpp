@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "common/product.hpp"
+
+// MessagePack encoding of products, written and read directly rather than through a
+// json DOM. Products are encoded as maps with the same keys and values as their JSON
+// form, so json::from_msgpack still reads them.
+
+// The type held by json::binary, so that encoded products can be sent without a copy
+using ByteBuffer = std::vector<uint8_t>;
+
+// Enough for most products, for reserving buffers ahead of encoding
+constexpr size_t ENCODED_PRODUCT_SIZE_HINT = 512;
+
+// Must be followed by `count` calls to EncodeProduct
+void EncodeProductArrayHeader(ByteBuffer& out, size_t count);
+
+template<typename AATypes>
+void EncodeProduct(ByteBuffer& out, const BasicProduct<AATypes>& product);
+void EncodeProduct(ByteBuffer& out, const PMRProduct& product);
+
+// Reads an array of products written as above. Unknown keys are skipped, but the whole
+// array is rejected if any product is not a map, lacks an ID or store, or has a field of
+// the wrong type or an enum field out of range.
+std::optional<std::vector<Product>> DecodeProducts(std::span<const uint8_t> data);
+// As above, with the products and everything in them allocated in `arena`
+std::optional<tb::arena_vector<ArenaProduct>> DecodeProducts(
+    std::span<const uint8_t> data, tb::thread_safe_memory_arena& arena);
+// Reads a single product written by EncodeProduct
+std::optional<Product> DecodeProduct(std::span<const uint8_t> data);
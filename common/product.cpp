@@ -1,7 +1,12 @@
 #include "common/product.hpp"
 
+#include <algorithm>
+#include <bit>
+#include <charconv>
 #include <iostream>
+#include <cstdint>
 #include <cstdlib>
+#include <limits>
 #include <ctime>
 #include <cctype>
 #include <ranges>
@@ -20,112 +25,204 @@ static_assert(util::is_sorted(PRICE_UNIT_SEPARATORS, [] (auto& a, auto& b) {
     return a.size() >= b.size();
 }), "Price unit separators array must be sorted from longest to shortest");
 
-const std::unordered_map<std::string_view, std::pair<Currency, float>>
-CURRENCY_MULTIPLIERS = {
-    { "€", { Currency::EUR, 1 } },
-    { "c", { Currency::EUR, 0.01 } }
-};
+// Written before an amount in whole units, as in €1.10
+constexpr auto CURRENCY_PREFIXES = std::to_array<std::pair<std::string_view, Currency>>({
+    { "€", Currency::EUR }
+});
 
-const std::unordered_map<Currency, std::string_view> CURRENCY_SYMBOLS {
-    { Currency::EUR, "€" }
-};
+static_assert(util::is_sorted(CURRENCY_PREFIXES, [] (auto& a, auto& b) {
+    return a.first.size() >= b.first.size();
+}), "Currency prefixes array must be sorted from longest to shortest");
+
+// Written after an amount in hundredths, as in 75c
+constexpr auto CURRENCY_SUFFIXES = std::to_array<std::pair<char, Currency>>({
+    { 'c', Currency::EUR }
+});
 
-const std::unordered_map<std::string_view, std::pair<Unit, float>>
-  UNIT_CONVERSIONS = {
-    { "kg",         { Unit::Kilogrammes, 1 } },
-    { "kg drained", { Unit::Kilogrammes, 1 } },   // FIXME: Treated the same for now
-    { "kg dr.wt",   { Unit::Kilogrammes, 1 } },
-    { "kne",        { Unit::Kilogrammes, 1 } },
-    { "g",          { Unit::Kilogrammes, 1000 } },
-    { "100g",       { Unit::Kilogrammes, 10 } },
-    { "75cl",       { Unit::Litres, 1 / 0.75f } },
-    { "cl",         { Unit::Litres, 1 / 0.75f } }, // ALDI 'CL' is always 75CL
-    { "750ml",      { Unit::Litres, 1 / 0.75f } },
-    { "70cl",       { Unit::Litres, 1 / 0.7f } },
-    { "l",          { Unit::Litres, 1 } },
-    { "litre",      { Unit::Litres, 1 } },
-    { "ml",         { Unit::Litres, 1000 } },
-    { "100ml",      { Unit::Litres, 10 } },
-    { "m²",         { Unit::SqMetres, 1 } },
-    { "each",       { Unit::Piece, 1 } },
-    { "ea",         { Unit::Piece, 1 } },
-    { "pac",        { Unit::Piece, 1 } },
-    { "100sht",     { Unit::Piece, 0.01f } },
-    { "100 sheets", { Unit::Piece, 0.01f } },
-    { "sht",        { Unit::Piece, 0.01f } }, // ALDI 'sht' is always 100 sheets
-    { "20 bag",     { Unit::Piece, 0.05f } },
-    { "metre",      { Unit::Metres, 1 } },
-    { "m",          { Unit::Metres, 1 } }
+// Indexed by Currency
+constexpr auto CURRENCY_SYMBOLS = std::to_array<std::string_view>({ "€" });
+
+static_assert(CURRENCY_SYMBOLS.size() == static_cast<size_t>(Currency::EUR) + 1,
+    "Currency symbols array must have an entry for each currency");
+
+namespace {
+
+struct UnitConversion
+{
+    std::string_view name;
+    Unit unit;
+    float factor;
 };
 
+// Sorted by name, for binary search
+constexpr auto UNIT_CONVERSIONS = std::to_array<UnitConversion>({
+    { "100 sheets", Unit::Piece,       0.01f },
+    { "100g",       Unit::Kilogrammes, 10 },
+    { "100ml",      Unit::Litres,      10 },
+    { "100sht",     Unit::Piece,       0.01f },
+    { "20 bag",     Unit::Piece,       0.05f },
+    { "70cl",       Unit::Litres,      1 / 0.7f },
+    { "750ml",      Unit::Litres,      1 / 0.75f },
+    { "75cl",       Unit::Litres,      1 / 0.75f },
+    { "cl",         Unit::Litres,      1 / 0.75f }, // ALDI 'CL' is always 75CL
+    { "ea",         Unit::Piece,       1 },
+    { "each",       Unit::Piece,       1 },
+    { "g",          Unit::Kilogrammes, 1000 },
+    { "kg",         Unit::Kilogrammes, 1 },
+    { "kg dr.wt",   Unit::Kilogrammes, 1 },
+    { "kg drained", Unit::Kilogrammes, 1 },        // FIXME: Treated the same for now
+    { "kne",        Unit::Kilogrammes, 1 },
+    { "l",          Unit::Litres,      1 },
+    { "litre",      Unit::Litres,      1 },
+    { "m",          Unit::Metres,      1 },
+    { "metre",      Unit::Metres,      1 },
+    { "ml",         Unit::Litres,      1000 },
+    { "m²",         Unit::SqMetres,    1 },
+    { "pac",        Unit::Piece,       1 },
+    { "sht",        Unit::Piece,       0.01f }     // ALDI 'sht' is always 100 sheets
+});
+
+constexpr char ToLowerASCII(char c) { return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c; }
+
+static_assert(util::is_sorted(UNIT_CONVERSIONS, [] (auto& a, auto& b) {
+    return a.name < b.name;
+}), "Unit conversions array must be sorted by name, without duplicates");
+
+static_assert(std::ranges::all_of(UNIT_CONVERSIONS, [] (const UnitConversion& u) {
+    return std::ranges::all_of(u.name, [] (char c) { return ToLowerASCII(c) == c; });
+}), "Unit conversion names must be lowercase");
+
+// Orders `str` against a lowercase `key`, ignoring the case of `str`. Bytes compare
+// as unsigned, like std::string_view.
+constexpr int CompareIgnoreCase(std::string_view key, std::string_view str)
+{
+    for (size_t i = 0; i < key.size() && i < str.size(); ++i) {
+        auto a = static_cast<unsigned char>(key[i]),
+             b = static_cast<unsigned char>(ToLowerASCII(str[i]));
+        if (a != b) return a < b ? -1 : 1;
+    }
+
+    return key.size() < str.size() ? -1 : key.size() > str.size();
+}
+
+constexpr const UnitConversion* FindUnitConversion(std::string_view name)
+{
+    auto iter = std::ranges::partition_point(UNIT_CONVERSIONS,
+        [name] (const UnitConversion& u) { return CompareIgnoreCase(u.name, name) < 0; });
+
+    if (iter == UNIT_CONVERSIONS.end() || CompareIgnoreCase(iter->name, name) != 0)
+        return nullptr;
+
+    return &*iter;
+}
+
+static_assert(FindUnitConversion("KG Dr.Wt")->unit == Unit::Kilogrammes
+           && FindUnitConversion("m²")->unit == Unit::SqMetres
+           && !FindUnitConversion("kgs"),
+    "Unit conversion lookup is broken");
+
+} // namespace
+
 // Price
 
 std::string Price::ToString() const
 {
-    std::string result = std::to_string(value);
+    std::array<char, MAX_STRING_SIZE> buffer;
+    return std::string(buffer.data(), ToChars(buffer));
+}
 
-    result.insert(0, CURRENCY_SYMBOLS.at(currency).data());
-    if (value >= 100)
-        result.insert(result.size() - 2, ".");
-    else if (value >= 10)
-        result.insert(result.size() - 2, "0.");
-    else
-        result.insert(result.size() - 1, "0.0");
+size_t Price::ToChars(std::span<char, MAX_STRING_SIZE> out) const
+{
+    std::string_view symbol = CURRENCY_SYMBOLS[static_cast<size_t>(currency)];
+    char* end = std::ranges::copy(symbol, out.data()).out;
+    end = std::to_chars(end, out.data() + out.size(), value / 100).ptr;
 
-    return result;
+    unsigned cents = value % 100;
+    *end++ = '.';
+    *end++ = static_cast<char>('0' + cents / 10);
+    *end++ = static_cast<char>('0' + cents % 10);
+
+    return end - out.data();
 }
 
-template<>
-auto tb::try_match_single(std::string_view view)
-    -> std::optional<tb::match_result<Price>>
-{
-    std::string str(view);
+static bool IsDigit(char c) { return c >= '0' && c <= '9'; }
 
-    size_t characters_consumed = 0;
-    if (size_t comma = str.find(','); comma != std::string::npos) {
-        str.erase(comma, 1);
-        ++characters_consumed;
-    }
+static bool IsAlpha(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
 
+auto Price::Match(std::string_view str) -> std::optional<tb::match_result<Price>>
+{
     Price price;
-    float price_multiplier = 1;
-    for (const auto& [symbol, curr_multiplier] : CURRENCY_MULTIPLIERS) {
-        if (size_t currency_pos = str.find(symbol); currency_pos != std::string::npos) {
-            price.currency = std::get<Currency>(curr_multiplier);
-            price_multiplier = std::get<float>(curr_multiplier);
-            str.erase(currency_pos, symbol.size());
-            characters_consumed += symbol.size();
+    size_t i = 0;
+    bool prefixed = false;
+
+    for (const auto& [symbol, currency] : CURRENCY_PREFIXES) {
+        if (str.starts_with(symbol)) {
+            price.currency = currency;
+            i = symbol.size();
+            prefixed = true;
             break;
         }
     }
 
-    view = str;
-    size_t ss_point = view.find('.');
-    if (ss_point != std::string::npos) {
-        auto parts = tb::try_match<unsigned, unsigned>(view, "{}.{}");
-        if (!parts)
-            return std::nullopt;
-
-        auto [int_part, frac_part] = parts->object;
-        price.value = (int_part * 100) + frac_part;
-        characters_consumed += parts->characters_matched;
-    } else {
-        auto int_part = tb::try_match_single<unsigned>(view.substr(0, ss_point));
-        if (!int_part)
-            return std::nullopt;
-        price.value = int_part->object * 100;
-        characters_consumed += int_part->characters_matched;
+    // Whole units, optionally with commas between groups of three digits
+    const size_t digits_start = i;
+    uint64_t units = 0;
+    while (i < str.size()) {
+        if (IsDigit(str[i])) {
+            units = units * 10 + (str[i++] - '0');
+            if (units > std::numeric_limits<unsigned>::max()) return std::nullopt;
+        } else if (str[i] == ',' && i > digits_start && i + 3 < str.size()
+                   && IsDigit(str[i + 1]) && IsDigit(str[i + 2]) && IsDigit(str[i + 3])
+                   && (i + 4 == str.size() || !IsDigit(str[i + 4]))) {
+            ++i;
+        } else {
+            break;
+        }
     }
 
-    return tb::match_result<Price> {
-        .object = price * price_multiplier,
-        .characters_matched = characters_consumed
-    };
+    if (i == digits_start) return std::nullopt;
+
+    if (!prefixed && i < str.size()) {
+        for (const auto& [symbol, currency] : CURRENCY_SUFFIXES) {
+            if (str[i] == symbol && (i + 1 == str.size() || !IsAlpha(str[i + 1]))) {
+                price.currency = currency;
+                price.value = static_cast<unsigned>(units);
+                return tb::match_result<Price> {
+                    .object = price,
+                    .characters_matched = i + 1
+                };
+            }
+        }
+    }
+
+    // Cents: one digit is tenths, digits past the second are dropped
+    uint64_t cents = 0;
+    if (i + 1 < str.size() && str[i] == '.' && IsDigit(str[i + 1])) {
+        cents = (str[i + 1] - '0') * 10;
+        i += 2;
+        if (i < str.size() && IsDigit(str[i]))
+            cents += str[i++] - '0';
+        while (i < str.size() && IsDigit(str[i]))
+            ++i;
+    }
+
+    uint64_t value = units * 100 + cents;
+    if (value > std::numeric_limits<unsigned>::max()) return std::nullopt;
+
+    price.value = static_cast<unsigned>(value);
+    return tb::match_result<Price> { .object = price, .characters_matched = i };
+}
+
+template<>
+auto tb::try_match_single(std::string_view view)
+    -> std::optional<tb::match_result<Price>>
+{
+    return Price::Match(view);
 }
 
 std::optional<Price> Price::FromString(std::string_view str)
 {
-    auto price = tb::try_match_single<Price>(str);
+    auto price = Price::Match(str);
     if (!price)
         return std::nullopt;
 
@@ -147,8 +244,15 @@ Price Price::operator*(float f) const
 
 std::string PricePU::ToString() const
 {
-    const std::string_view& suffix = UNIT_SUFFIXES[static_cast<size_t>(unit)];
-    return price.ToString().append(suffix.begin(), suffix.end());
+    std::array<char, MAX_STRING_SIZE> buffer;
+    return std::string(buffer.data(), ToChars(buffer));
+}
+
+size_t PricePU::ToChars(std::span<char, MAX_STRING_SIZE> out) const
+{
+    size_t size = price.ToChars(out.first<Price::MAX_STRING_SIZE>());
+    std::string_view suffix = UNIT_SUFFIXES[static_cast<size_t>(unit)];
+    return std::ranges::copy(suffix, out.data() + size).out - out.data();
 }
 
 std::optional<PricePU> PricePU::FromString(std::string_view str)
@@ -172,17 +276,16 @@ std::optional<PricePU> PricePU::FromString(std::string_view str)
 
     std::string_view unit_view = str;
     unit_view.remove_prefix(separator_index + 1);
-    auto lowercase_unit = unit_view | std::views::transform(tolower)
-                        | tb::range_to<std::string>();
     std::string_view price_view(str.data(), separator_index);
 
-    if (!UNIT_CONVERSIONS.contains(lowercase_unit)) {
+    const UnitConversion* conversion = FindUnitConversion(unit_view);
+    if (!conversion) {
         Log(LogLevel::WARNING, "Unrecognised unit for '{}'!", str);
         Log(LogLevel::WARNING, "Offending unit: {}", unit_view);
         return std::nullopt;
     }
 
-    auto [unit_type, factor] = UNIT_CONVERSIONS.at(lowercase_unit);
+    auto [_, unit_type, factor] = *conversion;
     std::optional<Price> price = Price::FromString(price_view);
     if (!price) return std::nullopt;
 
@@ -195,6 +298,120 @@ std::partial_ordering PricePU::operator<=>(const PricePU& other) const
     return price <=> other.price;
 }
 
+// ProductKey
+
+// Bits 63-60: the index of the store's bit in StoreID, plus one
+// Bit 59: set if the SKU is hashed
+// Numeric SKUs: bits 58-54 the number of digits, bits 53-0 the value
+// Other SKUs: bits 58-0 an FNV-1a hash of the SKU
+constexpr int KEY_STORE_SHIFT = 60, KEY_HASHED_SHIFT = 59, KEY_DIGITS_SHIFT = 54;
+constexpr uint64_t KEY_HASH_MASK = (uint64_t(1) << KEY_HASHED_SHIFT) - 1;
+constexpr size_t KEY_MAX_DIGITS = 16;
+
+static_assert(9'999'999'999'999'999 < (uint64_t(1) << KEY_DIGITS_SHIFT)
+           && KEY_MAX_DIGITS < (1 << (KEY_HASHED_SHIFT - KEY_DIGITS_SHIFT)),
+    "Numeric SKUs must fit in a product key");
+
+constexpr auto KEYED_STORES = std::to_array<StoreID>({
+    StoreID::SUPERVALU, StoreID::LIDL, StoreID::TESCO, StoreID::ALDI,
+    StoreID::DUNNES_STORES
+});
+
+ProductKey ProductKey::FromSKU(StoreID store, std::string_view sku)
+{
+    uint64_t key = static_cast<uint64_t>(
+        std::countr_zero(static_cast<unsigned>(store)) + 1
+    ) << KEY_STORE_SHIFT;
+
+    bool numeric = !sku.empty() && sku.size() <= KEY_MAX_DIGITS
+        && std::ranges::all_of(sku, [] (char c) { return c >= '0' && c <= '9'; });
+
+    if (numeric) {
+        uint64_t number = 0;
+        std::from_chars(sku.data(), sku.data() + sku.size(), number);
+        return ProductKey { key | (uint64_t(sku.size()) << KEY_DIGITS_SHIFT) | number };
+    }
+
+    uint64_t hash = 14695981039346656037u;
+    for (char c : sku) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 1099511628211u;
+    }
+
+    return ProductKey { key | (uint64_t(1) << KEY_HASHED_SHIFT) | (hash & KEY_HASH_MASK) };
+}
+
+ProductKey ProductKey::FromID(StoreID store, std::string_view id)
+{
+    std::string_view prefix = GetStorePrefix(store);
+    if (id.starts_with(prefix))
+        id.remove_prefix(prefix.size());
+
+    return FromSKU(store, id);
+}
+
+std::optional<ProductKey> ProductKey::FromString(std::string_view str)
+{
+    if (str.size() == HEX_DIGITS) {
+        uint64_t key = 0;
+        auto [end, error] = std::from_chars(str.data(), str.data() + str.size(), key, 16);
+        if (error == std::errc {} && end == str.data() + str.size()
+            && (key >> KEY_STORE_SHIFT) != 0)
+            return ProductKey { key };
+    }
+
+    for (StoreID store : KEYED_STORES) {
+        std::string_view prefix = GetStorePrefix(store);
+        if (str.size() > prefix.size() && str.starts_with(prefix))
+            return FromSKU(store, str.substr(prefix.size()));
+    }
+
+    return std::nullopt;
+}
+
+std::string ProductKey::ToHex() const
+{
+    std::string hex(HEX_DIGITS, '0');
+    WriteHex(std::span<char, HEX_DIGITS> { hex.data(), HEX_DIGITS });
+    return hex;
+}
+
+void ProductKey::WriteHex(std::span<char, HEX_DIGITS> out) const
+{
+    constexpr std::string_view DIGITS = "0123456789abcdef";
+
+    uint64_t rest = value;
+    for (size_t i = HEX_DIGITS; i > 0; --i, rest >>= 4)
+        out[i - 1] = DIGITS[rest & 0xF];
+}
+
+StoreID ProductKey::Store() const
+{
+    uint64_t index = value >> KEY_STORE_SHIFT;
+    return index ? static_cast<StoreID>(1u << (index - 1)) : StoreID {};
+}
+
+bool ProductKey::IsHashed() const { return (value >> KEY_HASHED_SHIFT) & 1; }
+
+void to_json(json& j, ProductKey key) { j = key.ToHex(); }
+
+void from_json(const json& j, ProductKey& key)
+{
+    key = ProductKey::FromString(j.get<std::string_view>()).value_or(ProductKey {});
+}
+
+// URLs
+
+std::string ExpandURL(std::string_view url, std::string_view root)
+{
+    root = ExpansionRoot(url, root);
+
+    std::string result;
+    result.reserve(root.size() + url.size());
+    result.append(root).append(url);
+    return result;
+}
+
 // Offer
 
 template<tb::either<Offer, ArenaOffer> OfferT>
@@ -237,95 +454,184 @@ auto ArenaOffer::ToString() const -> std::string
     return BasicOffer_ToString_Impl(*this);
 }
 
+static_assert(std::ranges::all_of(OFFER_PATTERNS, IsValidOfferPattern),
+    "Offer patterns must be valid");
+
+struct OfferCaptures
+{
+    std::optional<unsigned> count;
+    std::optional<Price> price;
+    std::optional<float> percent;
+};
+
+// Reads the number `field` stands for at `pos`, returning where it ends or nullptr
+static const char* MatchOfferField(OfferField field, const char* pos, const char* end,
+    OfferCaptures& captures)
+{
+    if (field == OfferField::PRICE) {
+        auto price = Price::Match({ pos, end });
+        if (!price) return nullptr;
+        captures.price = price->object;
+        return pos + price->characters_matched;
+    }
+
+    if (field == OfferField::COUNT) {
+        unsigned count;
+        auto [ptr, ec] = std::from_chars(pos, end, count);
+        if (ec != std::errc {}) return nullptr;
+        captures.count = count;
+        return ptr;
+    }
+
+    float percent;
+    auto [ptr, ec] = std::from_chars(pos, end, percent, std::chars_format::fixed);
+    if (ec != std::errc {}) return nullptr;
+    captures.percent = percent;
+    return ptr;
+}
+
+struct OfferMatch
+{
+    int16_t pattern = -1;
+    OfferCaptures captures;
+};
+
+// Walks `grammar` from `state` over the text at `pos`, keeping the first pattern in
+// table order that matches. Literal children differ in their character, so at most one
+// of them is followed; placeholder children are each tried in turn.
+static void MatchOfferGrammar(OfferGrammar grammar, size_t state, const char* pos,
+    const char* end, const OfferCaptures& captures, OfferMatch& best)
+{
+    const OfferState& current = grammar.states[state];
+    if (current.pattern >= 0 && (best.pattern < 0 || current.pattern < best.pattern))
+        best = { current.pattern, captures };
+
+    for (size_t child = current.first_child; child != 0;
+         child = grammar.states[child].next_sibling) {
+        const OfferState& next = grammar.states[child];
+        if (next.field == OfferField::NONE) {
+            if (pos != end && ToLowerASCII(*pos) == next.literal)
+                MatchOfferGrammar(grammar, child, pos + 1, end, captures, best);
+            continue;
+        }
+
+        OfferCaptures field_captures = captures;
+        if (const char* after = MatchOfferField(next.field, pos, end, field_captures))
+            MatchOfferGrammar(grammar, child, after, end, field_captures, best);
+    }
+}
+
 template<tb::either<Offer, ArenaOffer> OfferT>
-auto BasicOffer_FromString_Impl(std::string_view view,
-    tb::thread_safe_memory_arena* arena) -> std::optional<OfferT>
+auto BasicOffer_FromString_Impl(std::string_view view, tb::thread_safe_memory_arena* arena,
+    OfferGrammar grammar) -> std::optional<OfferT>
 {
-    auto text = view | std::views::transform(tolower) | tb::range_to<std::string>();
+    OfferMatch match;
+    MatchOfferGrammar(grammar, 0, view.data(), view.data() + view.size(), {}, match);
+    if (match.pattern < 0)
+        return std::nullopt;
+
+    const OfferPattern* pattern = &grammar.patterns[match.pattern];
+    const OfferCaptures& captures = match.captures;
 
-    auto construct_string = [arena] (std::string_view view) {
-        using string_t = decltype(std::declval<OfferT>().text);
+    OfferT offer = [arena] {
         ([](...){})(arena);
         if constexpr (std::same_as<OfferT, ArenaOffer>)
-            return string_t { view, *arena };
+            return ArenaOffer::WithArena(*arena);
         else
-            return string_t { view };
-    };
-
-    if (auto x_for_y = tb::try_match<unsigned, Price>(text, "{} for {}")) {
-        auto [count, price] = x_for_y->object;
-        return OfferT {
-            .text = construct_string(text),
-            .price = price,
-            .bulk_amount = count,
-            .type = OfferType::MULTIPLE_FOR_REDUCED_PRICE,
-        };
-    } else if (auto x_for_y = tb::try_match<unsigned, Price>(text, "buy {} for {}")) {
-        auto [count, price] = x_for_y->object;
-        return OfferT {
-            .text = construct_string(text),
-            .price = price,
-            .bulk_amount = count,
-            .type = OfferType::MULTIPLE_FOR_REDUCED_PRICE,
-        };
-    } else if (auto any = tb::try_match<unsigned, Price>(text, "any {} for {}")) {
-        auto [count, price] = x_for_y->object;
-        return OfferT {
-            .text = construct_string(text),
-            .price = price,
-            .bulk_amount = count,
-            .type = OfferType::MULTIPLE_HETEROGENEOUS_FOR_REDUCED_PRICE,
-        };
-    } else if (auto reduced = tb::try_match<Price>(text, "only {}")) {
-        return OfferT {
-            .text = construct_string(text),
-            .price = std::get<Price>(reduced->object),
-            .bulk_amount = 1,
-            .type = OfferType::REDUCED_PRICE_ABSOLUTE,
-            .membership_only = text.find("real rewards") != std::string::npos
-        };
-    } else if (auto tesco_clubcard = tb::try_match<Price>(text, "{} clubcard price")) {
-        return OfferT {
-            .text = construct_string(text),
-            .price = std::get<Price>(tesco_clubcard->object),
-            .bulk_amount = 1,
-            .type = OfferType::REDUCED_PRICE_ABSOLUTE,
-            .membership_only = true
-        };
-    } else if (auto save_pc = tb::try_match<float>(text, "save {}%")) {
-        return OfferT {
-            .text = construct_string(text),
-            .type = OfferType::REDUCED_PRICE_PERCENTAGE,
-            .price_reduction_multiplier = 1 - (std::get<float>(save_pc->object) * .01f)
-        };
-    } else if (auto save_amnt = tb::try_match<Price>(text, "save {}")) {
-        return OfferT {
-            .text = construct_string(text),
-            .price = std::get<Price>(save_amnt->object),
-            .bulk_amount = 1,
-            .type = OfferType::REDUCED_PRICE_DEDUCTION
-        };
-    } else if (text.starts_with("half price")) {
-        return OfferT {
-            .text = construct_string(text),
-            .type = OfferType::REDUCED_PRICE_PERCENTAGE,
-            .price_reduction_multiplier = 0.5f
-        };
-    }
-
-    return std::nullopt;
+            return Offer {};
+    }();
+
+    offer.text = view;
+    std::ranges::transform(offer.text, offer.text.begin(), ToLowerASCII);
+
+    offer.type = pattern->type;
+    offer.price = captures.price.value_or(Price {});
+    offer.bulk_amount = captures.count.value_or(captures.price ? 1 : 0);
+    offer.price_reduction_multiplier = captures.percent
+        ? 1 - (*captures.percent * .01f)
+        : pattern->price_reduction_multiplier;
+    offer.membership_only = pattern->membership_only
+        || (!pattern->membership_marker.empty()
+            && offer.text.find(pattern->membership_marker) != std::string_view::npos);
+
+    return offer;
 }
 
 template<>
-auto Offer::FromString(std::string_view view, tb::thread_safe_memory_arena*)
-    -> std::optional<Offer>
+auto Offer::FromString(std::string_view view, tb::thread_safe_memory_arena*,
+    OfferGrammar grammar) -> std::optional<Offer>
 {
-    return BasicOffer_FromString_Impl<Offer>(view, nullptr);
+    return BasicOffer_FromString_Impl<Offer>(view, nullptr, grammar);
 }
 
 template<>
-auto ArenaOffer::FromString(std::string_view view, tb::thread_safe_memory_arena* arena)
-    -> std::optional<ArenaOffer>
+auto ArenaOffer::FromString(std::string_view view, tb::thread_safe_memory_arena* arena,
+    OfferGrammar grammar) -> std::optional<ArenaOffer>
 {
-    return BasicOffer_FromString_Impl<ArenaOffer>(view, arena);
+    return BasicOffer_FromString_Impl<ArenaOffer>(view, arena, grammar);
 }
+
+// Product
+
+// The price of a single item under `offer`, if it can be worked out
+template<tb::either<Offer, ArenaOffer> OfferT>
+static std::optional<unsigned> OfferItemPrice(const OfferT& offer, Price item_price)
+{
+    switch (offer.type) {
+    using enum OfferType;
+    case MULTIPLE_FOR_REDUCED_PRICE:
+    case MULTIPLE_HETEROGENEOUS_FOR_REDUCED_PRICE:
+        if (offer.bulk_amount == 0) return std::nullopt;
+        return (offer.price.value + offer.bulk_amount / 2) / offer.bulk_amount;
+    case REDUCED_PRICE_ABSOLUTE:
+        return offer.price.value;
+    case REDUCED_PRICE_DEDUCTION:
+        return item_price.value - std::min(item_price.value, offer.price.value);
+    case REDUCED_PRICE_PERCENTAGE:
+        return (item_price * offer.price_reduction_multiplier).value;
+    default:
+        return std::nullopt;
+    }
+}
+
+template<typename AATypes>
+EffectivePrices ComputeEffectivePrices(const BasicProduct<AATypes>& product)
+{
+    PricePU per_unit = product.price_per_unit;
+    if (per_unit.unit == Unit::None)
+        per_unit = { product.item_price, Unit::Piece };
+
+    const unsigned item = product.item_price.value;
+    unsigned single = item, bulk = item, member = item;
+
+    for (const auto& offer : product.offers) {
+        if (offer.price.currency != product.item_price.currency) continue;
+
+        std::optional<unsigned> price = OfferItemPrice(offer, product.item_price);
+        if (!price) continue;
+
+        member = std::min(member, *price);
+        if (offer.membership_only) continue;
+
+        bulk = std::min(bulk, *price);
+        if (offer.bulk_amount <= 1)
+            single = std::min(single, *price);
+    }
+
+    // Offers reduce the price per unit in proportion to the item price
+    auto scale = [item, normal = per_unit.price.value] (unsigned item_price) -> unsigned {
+        if (item == 0) return normal;
+        return (uint64_t { normal } * item_price + item / 2) / item;
+    };
+
+    return {
+        .unit = per_unit.unit,
+        .normal = per_unit.price.value,
+        .single = scale(single),
+        .bulk = scale(bulk),
+        .member = scale(member)
+    };
+}
+
+template EffectivePrices ComputeEffectivePrices(const Product& product);
+template EffectivePrices ComputeEffectivePrices(const ArenaProduct& product);
@@ -1,5 +1,11 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
 #include <string>
 #include <string_view>
 #include <compare>
@@ -36,8 +42,16 @@ enum class Currency { EUR };
 
 struct Price
 {
+    // Longest result of ToString
+    constexpr static size_t MAX_STRING_SIZE = 16;
+
     std::string ToString() const;
+    // Writes ToString() to `out` without allocating, returning its length
+    size_t ToChars(std::span<char, MAX_STRING_SIZE> out) const;
     static std::optional<Price> FromString(std::string_view str);
+    // Reads a price such as "€1,234.56" or "75c" from the start of `str` in one pass,
+    // without allocating. Text following the price is not consumed.
+    static std::optional<tb::match_result<Price>> Match(std::string_view str);
 
     std::partial_ordering operator<=>(const Price& other) const;
     Price operator*(float b) const;
@@ -48,7 +62,10 @@ struct Price
 
 struct PricePU
 {
+    constexpr static size_t MAX_STRING_SIZE = Price::MAX_STRING_SIZE + 8;
+
     std::string ToString() const;
+    size_t ToChars(std::span<char, MAX_STRING_SIZE> out) const;
     static std::optional<PricePU> FromString(std::string_view str);
 
     std::partial_ordering operator<=>(const PricePU& other) const;
@@ -59,6 +76,173 @@ struct PricePU
 
 using StoreSelection = tb::enum_selection<StoreID>;
 
+// Written before a product's SKU to form its ID, as in "SV1234"
+constexpr std::string_view GetStorePrefix(StoreID store)
+{
+    switch (store) {
+    case StoreID::SUPERVALU:     return "SV";
+    case StoreID::LIDL:          return "LI";
+    case StoreID::TESCO:         return "TE";
+    case StoreID::ALDI:          return "AL";
+    case StoreID::DUNNES_STORES: return "DS";
+    default:                     return {};
+    }
+}
+
+// Identifies a product by its store and SKU, packed into 64 bits so that products are
+// hashed and compared as integers. Numeric SKUs of up to 16 digits are kept exactly,
+// along with their length so that leading zeros are not lost; other SKUs are hashed.
+// The string ID is kept for display only.
+class ProductKey
+{
+public:
+    constexpr static size_t HEX_DIGITS = 16;
+
+    constexpr ProductKey() = default;
+
+    static ProductKey FromSKU(StoreID store, std::string_view sku);
+    // From a product ID, with or without the store prefix
+    static ProductKey FromID(StoreID store, std::string_view id);
+    // From ToHex, or from a prefixed product ID as keys were written before
+    static std::optional<ProductKey> FromString(std::string_view str);
+
+    // Zero-padded lowercase hex; the key products are stored under
+    std::string ToHex() const;
+    void WriteHex(std::span<char, HEX_DIGITS> out) const;
+
+    StoreID Store() const;
+    bool IsHashed() const;
+    uint64_t Value() const { return value; }
+
+    explicit operator bool() const { return value != 0; }
+    auto operator<=>(const ProductKey&) const = default;
+
+private:
+    constexpr explicit ProductKey(uint64_t v) : value(v) {}
+
+    uint64_t value = 0;
+};
+
+template<>
+struct std::hash<ProductKey>
+{
+    size_t operator()(ProductKey key) const noexcept
+    {
+        return std::hash<uint64_t> {}(key.Value());
+    }
+};
+
+void to_json(json& j, ProductKey key);
+void from_json(const json& j, ProductKey& key);
+
+// Maps keyed by product are written as objects keyed by ToHex
+template<typename V>
+void to_json(json& j, const std::unordered_map<ProductKey, V>& map)
+{
+    j = json::object();
+    for (const auto& [key, value] : map)
+        j.emplace(key.ToHex(), value);
+}
+
+template<typename V>
+void from_json(const json& j, std::unordered_map<ProductKey, V>& map)
+{
+    map.clear();
+    for (const auto& [str, value] : j.items()) {
+        if (std::optional<ProductKey> key = ProductKey::FromString(str))
+            map.emplace(*key, value.template get<V>());
+    }
+}
+
+// Where a store's site is. The webscraper's Store definitions take their URLs from here,
+// and product pages are found at the homepage followed by `product_path`.
+struct StoreSite
+{
+    std::string_view homepage, root_url, product_path, image_root;
+};
+
+constexpr StoreSite GetStoreSite(StoreID store)
+{
+    switch (store) {
+    case StoreID::SUPERVALU:
+        return { "https://shop.supervalu.ie/sm/delivery/rsid/5550",
+                 "https://shop.supervalu.ie", "/product/",
+                 "https://images.cdn.shop.supervalu.ie/detail/" };
+    case StoreID::TESCO:
+        return { "https://www.tesco.ie/shop/en-IE", "https://www.tesco.ie", "/products/",
+                 "https://digitalcontent.api.tesco.com/v2/media/ghs/" };
+    case StoreID::ALDI:
+        return { "https://aldi.ie", "https://aldi.ie", "/product/",
+                 "https://dm.emea.cms.aldi.cx/is/image/aldiprodeu/"
+                 "product/jpg/scaleWidth/1296/" };
+    case StoreID::DUNNES_STORES:
+        return { "https://www.dunnesstoresgrocery.com",
+                 "https://www.dunnesstoresgrocery.com", "/sm/delivery/rsid/258/product/",
+                 "https://images.cdn.dunnesstoresgrocery.com/detail/" };
+    default:
+        return {};
+    }
+}
+
+// The homepage and product path of a store joined, as storage for a string_view
+template<StoreID store>
+constexpr auto JoinProductPageRoot()
+{
+    constexpr StoreSite site = GetStoreSite(store);
+    std::array<char, site.homepage.size() + site.product_path.size()> root {};
+    auto out = std::ranges::copy(site.homepage, root.begin()).out;
+    std::ranges::copy(site.product_path, out);
+    return root;
+}
+
+template<StoreID store>
+constexpr auto PRODUCT_PAGE_ROOT = JoinProductPageRoot<store>();
+
+// Where a store's product pages and images are found. Products keep their URLs relative
+// to these, so that the same prefixes aren't held and sent with every product.
+struct StoreURLRoots
+{
+    std::string_view page, image;
+};
+
+template<StoreID store>
+constexpr StoreURLRoots MakeStoreURLRoots()
+{
+    const auto& page = PRODUCT_PAGE_ROOT<store>;
+    return { { page.data(), page.size() }, GetStoreSite(store).image_root };
+}
+
+constexpr StoreURLRoots GetStoreURLRoots(StoreID store)
+{
+    switch (store) {
+    case StoreID::SUPERVALU:     return MakeStoreURLRoots<StoreID::SUPERVALU>();
+    case StoreID::TESCO:         return MakeStoreURLRoots<StoreID::TESCO>();
+    case StoreID::ALDI:          return MakeStoreURLRoots<StoreID::ALDI>();
+    case StoreID::DUNNES_STORES: return MakeStoreURLRoots<StoreID::DUNNES_STORES>();
+    default:                     return {};
+    }
+}
+
+// `url` relative to `root`, or `url` itself if it lies elsewhere
+constexpr std::string_view CompactURL(std::string_view url, std::string_view root)
+{
+    if (!root.empty() && url.starts_with(root))
+        url.remove_prefix(root.size());
+    return url;
+}
+
+// Undoes CompactURL. Empty and absolute URLs are returned as they are, so products
+// stored before URLs were compacted still read correctly.
+std::string ExpandURL(std::string_view url, std::string_view root);
+
+// What ExpandURL puts before `url`, for writing the full URL without building it
+constexpr std::string_view ExpansionRoot(std::string_view url, std::string_view root)
+{
+    if (url.empty() || url.starts_with("https://") || url.starts_with("http://"))
+        return {};
+    return root;
+}
+
 enum class OfferType
 {
     MULTIPLE_FOR_REDUCED_PRICE, // "x for €Y"
@@ -71,6 +255,183 @@ enum class OfferType
     MEMBERSHIP_DEAL_ONLY
 };
 
+// One form of offer text, e.g. "buy {count} for {price}". Literal text is lowercase and
+// matches regardless of case; {count}, {price} and {percent} match numbers. Patterns
+// match a prefix of the text, so anything after the last placeholder is ignored.
+struct OfferPattern
+{
+    std::string_view format;
+    OfferType type;
+    bool membership_only = false;
+    // Membership is also required if this appears anywhere in the text
+    std::string_view membership_marker {};
+    // Used by percentage reductions without a {percent}
+    float price_reduction_multiplier = 1;
+};
+
+// Whether a pattern's literal text is lowercase and its placeholders are known ones
+constexpr bool IsValidOfferPattern(const OfferPattern& pattern)
+{
+    std::string_view format = pattern.format;
+    if (format.empty()) return false;
+
+    while (!format.empty()) {
+        if (format.front() == '{') {
+            size_t close = format.find('}');
+            if (close == std::string_view::npos) return false;
+            std::string_view field = format.substr(1, close - 1);
+            if (field != "count" && field != "price" && field != "percent") return false;
+            format.remove_prefix(close + 1);
+        } else {
+            if (format.front() == '}' || (format.front() >= 'A' && format.front() <= 'Z'))
+                return false;
+            format.remove_prefix(1);
+        }
+    }
+
+    return true;
+}
+
+// Placeholders of an offer pattern
+enum class OfferField : uint8_t { NONE, COUNT, PRICE, PERCENT };
+
+// A state of an offer grammar, standing for every pattern that starts with the text
+// and placeholders leading to it. Entered from its parent on `literal`, or on a number
+// if `field` is set.
+struct OfferState
+{
+    char literal = 0;
+    OfferField field = OfferField::NONE;
+    uint16_t first_child = 0; // 0 if none, as the root is no state's child
+    uint16_t next_sibling = 0;
+    int16_t pattern = -1; // The first pattern ending here, if any
+};
+
+// Offer patterns merged into one trie, so that text is matched against all of them in
+// a single walk. Patterns sharing a prefix share its states and read it once, and the
+// walk only branches where patterns go on with different placeholders. If several
+// patterns match, the one first in `patterns` wins. See product.cpp
+struct OfferGrammar
+{
+    std::span<const OfferPattern> patterns;
+    std::span<const OfferState> states; // states[0] is the root
+};
+
+// Storage for a grammar built at compile time by MakeOfferGrammar
+template<size_t PatternCount, size_t StateCount>
+struct OfferGrammarTable
+{
+    std::array<OfferPattern, PatternCount> patterns;
+    std::array<OfferState, StateCount> states;
+
+    constexpr operator OfferGrammar() const { return { patterns, states }; }
+};
+
+// Removes the first literal character or placeholder from a valid `format`
+constexpr OfferState TakeOfferToken(std::string_view& format)
+{
+    if (format.front() != '{') {
+        OfferState token { .literal = format.front() };
+        format.remove_prefix(1);
+        return token;
+    }
+
+    size_t close = format.find('}');
+    std::string_view field = format.substr(1, close - 1);
+    format.remove_prefix(close + 1);
+
+    if (field == "count") return { .field = OfferField::COUNT };
+    if (field == "price") return { .field = OfferField::PRICE };
+    return { .field = OfferField::PERCENT };
+}
+
+template<size_t MaxStates>
+struct OfferTrie
+{
+    std::array<OfferState, MaxStates> states {};
+    size_t size = 1;
+
+    constexpr void Insert(std::string_view format, int16_t pattern)
+    {
+        size_t state = 0;
+        while (!format.empty()) {
+            OfferState token = TakeOfferToken(format);
+
+            size_t child = states[state].first_child, last = 0;
+            while (child != 0 && (states[child].literal != token.literal
+                                  || states[child].field != token.field)) {
+                last = child;
+                child = states[child].next_sibling;
+            }
+
+            if (child == 0) {
+                child = size++;
+                states[child] = token;
+                if (last != 0) states[last].next_sibling = child;
+                else states[state].first_child = child;
+            }
+
+            state = child;
+        }
+
+        if (states[state].pattern < 0)
+            states[state].pattern = pattern;
+    }
+};
+
+// Merges the pattern lists into one grammar, earlier lists taking precedence
+template<const auto&... PatternLists>
+constexpr auto MakeOfferGrammar()
+{
+    constexpr auto patterns = [] {
+        std::array<OfferPattern, (PatternLists.size() + ...)> all {};
+        auto out = all.begin();
+        ((out = std::ranges::copy(PatternLists, out).out), ...);
+        return all;
+    }();
+
+    // Every character of a format adds at most one state
+    constexpr size_t max_states = (1 + ... + [] {
+        size_t length = 0;
+        for (const OfferPattern& pattern : PatternLists)
+            length += pattern.format.size();
+        return length;
+    }());
+    static_assert(max_states <= UINT16_MAX, "Offer grammar is too large");
+
+    constexpr auto trie = [] (auto all) {
+        OfferTrie<max_states> trie;
+        for (size_t i = 0; i < all.size(); ++i)
+            trie.Insert(all[i].format, static_cast<int16_t>(i));
+        return trie;
+    }(patterns);
+
+    OfferGrammarTable<patterns.size(), trie.size> table {
+        .patterns = patterns,
+        .states {}
+    };
+    std::copy_n(trie.states.begin(), trie.size, table.states.begin());
+    return table;
+}
+
+// Forms of offer text any store may use. Stores with patterns of their own merge them
+// ahead of these into a grammar of their own.
+constexpr auto OFFER_PATTERNS = std::to_array<OfferPattern>({
+    { "{count} for {price}",     OfferType::MULTIPLE_FOR_REDUCED_PRICE },
+    { "buy {count} for {price}", OfferType::MULTIPLE_FOR_REDUCED_PRICE },
+    { "any {count} for {price} clubcard price",
+      OfferType::MULTIPLE_HETEROGENEOUS_FOR_REDUCED_PRICE, true },
+    { "any {count} for {price}", OfferType::MULTIPLE_HETEROGENEOUS_FOR_REDUCED_PRICE },
+    { "only {price}",            OfferType::REDUCED_PRICE_ABSOLUTE },
+    { "{price} clubcard price",  OfferType::REDUCED_PRICE_ABSOLUTE, true },
+    { "save {percent}%",         OfferType::REDUCED_PRICE_PERCENTAGE },
+    { "save {price}",            OfferType::REDUCED_PRICE_DEDUCTION },
+    { .format = "half price", .type = OfferType::REDUCED_PRICE_PERCENTAGE,
+      .price_reduction_multiplier = 0.5f }
+});
+
+constexpr auto OFFER_GRAMMAR = MakeOfferGrammar<OFFER_PATTERNS>();
+
 template<typename AATypes>
 struct BasicOffer
 {
@@ -83,7 +444,8 @@ struct BasicOffer
     float price_reduction_multiplier = 1;
 
     static auto FromString(std::string_view text,
-        tb::thread_safe_memory_arena* arena = nullptr) -> std::optional<BasicOffer>;
+        tb::thread_safe_memory_arena* arena = nullptr,
+        OfferGrammar grammar = OFFER_GRAMMAR) -> std::optional<BasicOffer>;
     auto ToString() const -> std::string;
 
     template<typename T = AATypes> requires
@@ -105,12 +467,12 @@ NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(ArenaOffer, text, price, bulk_amount, expiry,
     membership_only, price_reduction_multiplier);
 
 template<>
-auto Offer::FromString(std::string_view, tb::thread_safe_memory_arena*)
-    -> std::optional<Offer>;
+auto Offer::FromString(std::string_view, tb::thread_safe_memory_arena*,
+    OfferGrammar) -> std::optional<Offer>;
 
 template<>
-auto ArenaOffer::FromString(std::string_view, tb::thread_safe_memory_arena*)
-    -> std::optional<ArenaOffer>;
+auto ArenaOffer::FromString(std::string_view, tb::thread_safe_memory_arena*,
+    OfferGrammar) -> std::optional<ArenaOffer>;
 
 template<>
 auto Offer::ToString() const -> std::string;
@@ -118,6 +480,21 @@ auto Offer::ToString() const -> std::string;
 template<>
 auto ArenaOffer::ToString() const -> std::string;
 
+// Price per unit after offers, in cents, so that products can be ranked by what they
+// really cost with plain integer comparisons. Each price is at most the one before it.
+struct EffectivePrices
+{
+    Unit unit = Unit::None;
+    unsigned normal = 0; // price_per_unit, or the item price per piece without one
+    unsigned single = 0; // With the best offer on a single item
+    unsigned bulk = 0;   // Also counting offers on several items, such as "3 for €5"
+    unsigned member = 0; // Also counting membership-only offers
+
+    auto operator<=>(const EffectivePrices&) const = default;
+};
+
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(EffectivePrices, unit, normal, single, bulk, member);
+
 template<typename AATypes>
 struct BasicProduct
 {
@@ -125,11 +502,22 @@ struct BasicProduct
     AATypes::template vector<BasicOffer<AATypes>> offers;
     Price item_price;
     PricePU price_per_unit; // Price per KG, L, etc.
+    // From the above; see ComputeEffectivePrices
+    EffectivePrices effective_prices;
     StoreID store;
     TimePoint timestamp;
 
     bool full_info;
 
+    ProductKey Key() const { return ProductKey::FromID(store, id); }
+
+    // `url` and `image_url` are relative to the store's URL roots
+    std::string FullURL() const { return ExpandURL(url, GetStoreURLRoots(store).page); }
+    std::string FullImageURL() const
+    {
+        return ExpandURL(image_url, GetStoreURLRoots(store).image);
+    }
+
     template<typename T = AATypes> requires
         (std::same_as<T, AATypes> && T::arena_type_set)
     static auto WithArena(tb::thread_safe_memory_arena& arena) -> BasicProduct
@@ -148,10 +536,16 @@ struct BasicProduct
 using Product = BasicProduct<tb::default_aa_types>;
 using ArenaProduct = BasicProduct<tb::arena_aa_types>;
 
-NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(Product, name, offers, description, image_url, url,
-    id, item_price, price_per_unit, store, timestamp, full_info);
+// Products stored before a field was added are read with its default
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT(Product, name, offers, description,
+    image_url, url, id, item_price, price_per_unit, effective_prices, store, timestamp,
+    full_info);
 NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(ArenaProduct, name, offers, description, image_url,
-    url, id, item_price, price_per_unit, store, timestamp, full_info);
+    url, id, item_price, price_per_unit, effective_prices, store, timestamp, full_info);
+
+// Must be called again whenever the prices or offers of a product change
+template<typename AATypes>
+EffectivePrices ComputeEffectivePrices(const BasicProduct<AATypes>& product);
 
 struct QueryResultInfo
 {
@@ -159,13 +553,13 @@ struct QueryResultInfo
 };
 NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(QueryResultInfo, relevance);
 
-// Database representation of queries - Product IDs + extra query info
+// Database representation of queries - product keys + extra query info
 template<typename AATypes>
 struct BasicQueryTemplate
 {
     AATypes::string query_string;
     StoreSelection stores;
-    AATypes::template unordered_map<typename AATypes::string, QueryResultInfo> results;
+    AATypes::template unordered_map<ProductKey, QueryResultInfo> results;
     TimePoint timestamp;
     size_t depth;
 
@@ -198,6 +592,7 @@ struct BasicProductList
 {
     AATypes::template vector<SearchResult> products;
     size_t depth = SEARCH_DEPTH_INDEFINITE;
+    StoreSelection stale_stores {}; // Stores whose products were served from cache
 
     template<typename T = AATypes> requires
         (std::same_as<T, AATypes> && T::arena_type_set)
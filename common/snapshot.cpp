@@ -0,0 +1,505 @@
+#include "common/snapshot.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common/util.hpp"
+
+namespace fs = std::filesystem;
+
+using SnapshotClock = std::chrono::steady_clock;
+
+constexpr auto SNAPSHOT_MAGIC = std::to_array<char>({ 'F', 'S', 'N', 'P' });
+constexpr uint32_t SNAPSHOT_VERSION = 1;
+
+struct FileHeader
+{
+    std::array<char, 4> magic;
+    uint32_t version;
+    uint64_t generation;
+};
+
+struct SectionHeader
+{
+    uint32_t entry_count;
+    uint32_t size; // Of the entries that follow
+    int64_t timestamp;
+};
+
+// Followed by the key, then the value
+struct EntryHeader
+{
+    uint8_t store;
+    uint8_t unused;
+    uint16_t key_size;
+    uint32_t value_size;
+};
+
+static_assert(sizeof(FileHeader) == 16 && sizeof(SectionHeader) == 16
+           && sizeof(EntryHeader) == 8);
+static_assert(std::is_trivially_copyable_v<FileHeader>
+           && std::is_trivially_copyable_v<SectionHeader>
+           && std::is_trivially_copyable_v<EntryHeader>);
+
+template<typename T>
+static void Append(ByteBuffer& out, const T& value)
+{
+    const auto* bytes = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+// Advances `data` past what was read
+template<typename T>
+static std::optional<T> Take(std::span<const uint8_t>& data)
+{
+    if (data.size() < sizeof(T)) return std::nullopt;
+
+    T value;
+    std::memcpy(&value, data.data(), sizeof(T));
+    data = data.subspan(sizeof(T));
+    return value;
+}
+
+static std::optional<std::span<const uint8_t>> TakeBytes(std::span<const uint8_t>& data,
+    size_t size)
+{
+    if (data.size() < size) return std::nullopt;
+
+    std::span<const uint8_t> bytes = data.first(size);
+    data = data.subspan(size);
+    return bytes;
+}
+
+static void AppendFileHeader(ByteBuffer& out, uint64_t generation)
+{
+    Append(out, FileHeader {
+        .magic = SNAPSHOT_MAGIC, .version = SNAPSHOT_VERSION, .generation = generation
+    });
+}
+
+// The generation of the file, if it is a snapshot of this version
+static std::optional<uint64_t> TakeFileHeader(std::span<const uint8_t>& data)
+{
+    std::optional<FileHeader> header = Take<FileHeader>(data);
+    if (!header || header->magic != SNAPSHOT_MAGIC || header->version != SNAPSHOT_VERSION)
+        return std::nullopt;
+    return header->generation;
+}
+
+// Reads the sections following the file header into `sections`, stopping at the first
+// that is incomplete or malformed
+static void TakeSections(std::span<const uint8_t>& data,
+    std::vector<std::pair<TimePoint, std::vector<SnapshotEntry>>>& sections)
+{
+    while (std::optional<SectionHeader> header = Take<SectionHeader>(data)) {
+        std::optional<std::span<const uint8_t>> body = TakeBytes(data, header->size);
+        if (!body) return;
+
+        std::vector<SnapshotEntry> entries;
+        entries.reserve(header->entry_count);
+        for (uint32_t i = 0; i < header->entry_count; ++i) {
+            std::optional<EntryHeader> entry = Take<EntryHeader>(*body);
+            if (!entry || entry->store >= SNAPSHOT_DATABASES.size()) return;
+
+            std::optional<std::span<const uint8_t>> key = TakeBytes(*body, entry->key_size);
+            if (!key) return;
+            std::optional<std::span<const uint8_t>> value
+                = TakeBytes(*body, entry->value_size);
+            if (!value) return;
+
+            entries.push_back({
+                .store = static_cast<SnapshotStore>(entry->store),
+                .key { reinterpret_cast<const char*>(key->data()), key->size() },
+                .value = *value
+            });
+        }
+
+        if (!body->empty()) return;
+
+        sections.emplace_back(TimePoint { std::chrono::seconds { header->timestamp } },
+                              std::move(entries));
+    }
+}
+
+static bool WriteFile(const fs::path& path, const ByteBuffer& contents,
+    std::ios::openmode mode = std::ios::trunc)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::out | mode);
+    file.write(reinterpret_cast<const char*>(contents.data()), contents.size());
+    file.close();
+    return file.good();
+}
+
+template<typename Duration>
+static double Milliseconds(Duration duration)
+{
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+// MappedFile
+
+MappedFile::MappedFile(const uint8_t* data, size_t size) : data(data), size(size) {}
+
+std::optional<MappedFile> MappedFile::Open(const std::string& path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return std::nullopt;
+
+    tb::scoped_guard close_fd = [fd] { close(fd); };
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) return std::nullopt;
+
+    size_t size = static_cast<size_t>(file_stat.st_size);
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) return std::nullopt;
+
+    return MappedFile { static_cast<const uint8_t*>(data), size };
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : data(std::exchange(other.data, nullptr)), size(std::exchange(other.size, 0)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    std::swap(data, other.data);
+    std::swap(size, other.size);
+    return *this;
+}
+
+MappedFile::~MappedFile()
+{
+    if (data) munmap(const_cast<uint8_t*>(data), size);
+}
+
+std::span<const uint8_t> MappedFile::Data() const { return { data, size }; }
+
+// Loading
+
+std::string GetSnapshotDirectory()
+{
+    const char* variable = std::getenv(SNAPSHOT_DIRECTORY_VARIABLE);
+    fs::path directory = variable && *variable
+        ? fs::path { variable } : fs::path { DEFAULT_SNAPSHOT_DIRECTORY };
+
+    std::error_code error;
+    fs::path absolute = fs::absolute(directory, error);
+    return (error ? directory : absolute.lexically_normal()).string();
+}
+
+std::optional<LoadedSnapshot> LoadSnapshot(std::string_view directory)
+{
+    fs::path path { directory };
+
+    std::optional<MappedFile> full = MappedFile::Open(path / FULL_SNAPSHOT_NAME);
+    if (!full) return std::nullopt;
+
+    LoadedSnapshot result;
+    std::vector<std::pair<TimePoint, std::vector<SnapshotEntry>>> sections;
+
+    std::span<const uint8_t> data = full->Data();
+    std::optional<uint64_t> generation = TakeFileHeader(data);
+    if (generation) TakeSections(data, sections);
+    if (!generation || sections.size() != 1) {
+        Log(LogLevel::WARNING, "Ignoring invalid snapshot in '{}'", directory);
+        return std::nullopt;
+    }
+
+    result.generation = *generation;
+    result.files.push_back(std::move(*full));
+
+    // Increments written before a crash interrupted rewriting the full snapshot
+    // belong to an older generation
+    if (std::optional<MappedFile> incremental
+            = MappedFile::Open(path / INCREMENTAL_SNAPSHOT_NAME)) {
+        data = incremental->Data();
+        if (TakeFileHeader(data) == generation) {
+            TakeSections(data, sections);
+            result.increments = sections.size() - 1;
+            result.files.push_back(std::move(*incremental));
+        }
+    }
+
+    // Sections list their entries least recently recorded first, and every entry of an
+    // increment was recorded after those before it. Reading back from the last entry
+    // finds the latest value of each key, most recent first. Keys the writer forgot to
+    // stay within a database's capacity are the least recent, so they are the ones left
+    // out once that database is full.
+    std::array<std::unordered_set<std::string_view>, SNAPSHOT_DATABASES.size()> seen;
+    for (auto section = sections.rbegin(); section != sections.rend(); ++section) {
+        const std::vector<SnapshotEntry>& entries = section->second;
+        for (auto entry = entries.rbegin(); entry != entries.rend(); ++entry) {
+            auto& keys = seen[static_cast<size_t>(entry->store)];
+            if (keys.size() < GetDatabaseInfo(entry->store).capacity
+                && keys.insert(entry->key).second)
+                result.entries.push_back(*entry);
+        }
+    }
+
+    std::ranges::reverse(result.entries);
+
+    result.timestamp = sections.back().first;
+    return result;
+}
+
+std::vector<std::pair<std::string_view, Product>> DecodeProductEntries(
+    const LoadedSnapshot& snapshot)
+{
+    std::vector<std::pair<std::string_view, Product>> products;
+
+    for (const SnapshotEntry& entry : snapshot.entries) {
+        if (entry.store != SnapshotStore::PRODUCTS) continue;
+
+        std::optional<Product> product = DecodeProduct(entry.value);
+        if (!product) {
+            Log(LogLevel::WARNING, "Invalid product {} in snapshot", entry.key);
+            continue;
+        }
+        products.emplace_back(entry.key, std::move(product.value()));
+    }
+
+    return products;
+}
+
+std::vector<std::pair<std::string_view, QueryTemplate>> DecodeQueryEntries(
+    const LoadedSnapshot& snapshot)
+{
+    std::vector<std::pair<std::string_view, QueryTemplate>> queries;
+
+    for (const SnapshotEntry& entry : snapshot.entries) {
+        if (entry.store != SnapshotStore::QUERIES) continue;
+
+        try {
+            queries.emplace_back(entry.key,
+                json::from_msgpack(entry.value).get<QueryTemplate>());
+        } catch (const json::exception& e) {
+            Log(LogLevel::WARNING, "Invalid query '{}' in snapshot: {}", entry.key,
+                e.what());
+        }
+    }
+
+    return queries;
+}
+
+// SnapshotWriter
+
+SnapshotWriter::SnapshotWriter(std::string directory) : directory(std::move(directory))
+{}
+
+void SnapshotWriter::Load()
+{
+    SnapshotClock::time_point start = SnapshotClock::now();
+
+    std::optional<LoadedSnapshot> snapshot = LoadSnapshot(directory);
+    if (!snapshot) return;
+
+    for (const SnapshotEntry& entry : snapshot->entries)
+        Record(entry.store, entry.key, ByteBuffer(entry.value.begin(), entry.value.end()));
+
+    // What was just loaded is already on disk
+    {
+        std::scoped_lock lock { mutex };
+        for (Table& table : tables)
+            table.changed.clear();
+        generation = snapshot->generation;
+        needs_full = false;
+    }
+
+    Log(LogLevel::INFO, "Loaded {} snapshot entries in {:.1f} ms", Size(),
+        Milliseconds(SnapshotClock::now() - start));
+}
+
+void SnapshotWriter::Record(SnapshotStore store, std::string_view key, ByteBuffer value)
+{
+    if (key.size() > std::numeric_limits<uint16_t>::max()) return;
+
+    std::scoped_lock lock { mutex };
+    Table& table = tables[static_cast<size_t>(store)];
+
+    auto [iterator, inserted] = table.entries.try_emplace(std::string(key));
+    Entry& entry = iterator->second;
+    if (inserted)
+        entry.recency = table.recency.insert(table.recency.end(), iterator->first);
+    else
+        table.recency.splice(table.recency.end(), table.recency, entry.recency);
+
+    entry.value = std::move(value);
+    table.changed.insert(iterator->first);
+
+    if (table.entries.size() > GetDatabaseInfo(store).capacity) {
+        const std::string& oldest = table.recency.front();
+        table.changed.erase(oldest);
+        table.entries.erase(oldest);
+        table.recency.pop_front();
+    }
+}
+
+template<typename AATypes>
+void SnapshotWriter::RecordProduct(std::string_view key,
+    const BasicProduct<AATypes>& product)
+{
+    ByteBuffer value;
+    value.reserve(ENCODED_PRODUCT_SIZE_HINT);
+    EncodeProduct(value, product);
+    Record(SnapshotStore::PRODUCTS, key, std::move(value));
+}
+
+template void SnapshotWriter::RecordProduct(std::string_view, const Product&);
+template void SnapshotWriter::RecordProduct(std::string_view, const ArenaProduct&);
+
+void SnapshotWriter::RecordProduct(std::string_view key, const PMRProduct& product)
+{
+    std::visit([this, key] (const auto& p) { RecordProduct(key, p); }, product);
+}
+
+void SnapshotWriter::RecordQuery(std::string_view key, const json& query)
+{
+    Record(SnapshotStore::QUERIES, key, json::to_msgpack(query));
+}
+
+size_t SnapshotWriter::AppendSection(ByteBuffer& out, bool only_changed)
+{
+    size_t header_offset = out.size();
+    out.resize(out.size() + sizeof(SectionHeader));
+
+    uint32_t count = 0;
+    auto append = [&out, &count] (SnapshotStore store, const std::string& key,
+                                  const Entry& entry) {
+        Append(out, EntryHeader {
+            .store = static_cast<uint8_t>(store),
+            .unused = 0,
+            .key_size = static_cast<uint16_t>(key.size()),
+            .value_size = static_cast<uint32_t>(entry.value.size())
+        });
+        out.insert(out.end(), key.begin(), key.end());
+        out.insert(out.end(), entry.value.begin(), entry.value.end());
+        ++count;
+    };
+
+    for (size_t i = 0; i < tables.size(); ++i) {
+        Table& table = tables[i];
+        SnapshotStore store = static_cast<SnapshotStore>(i);
+
+        // In order of recency, which LoadSnapshot relies on
+        for (const std::string& key : table.recency) {
+            if (!only_changed || table.changed.contains(key))
+                append(store, key, table.entries.at(key));
+        }
+        table.changed.clear();
+    }
+
+    SectionHeader header {
+        .entry_count = count,
+        .size = static_cast<uint32_t>(out.size() - header_offset - sizeof(SectionHeader)),
+        .timestamp = Now().time_since_epoch().count()
+    };
+    std::memcpy(out.data() + header_offset, &header, sizeof(header));
+
+    return count;
+}
+
+bool SnapshotWriter::WriteIncremental()
+{
+    std::scoped_lock file_lock { file_mutex };
+    SnapshotClock::time_point start = SnapshotClock::now();
+
+    ByteBuffer section;
+    size_t count = 0;
+    bool full = false;
+    {
+        std::scoped_lock lock { mutex };
+        full = needs_full;
+        if (!full) count = AppendSection(section, true);
+    }
+
+    if (full) return WriteFullSnapshot();
+
+    if (count == 0) return true;
+
+    fs::path path = fs::path { directory } / INCREMENTAL_SNAPSHOT_NAME;
+    if (!WriteFile(path, section, std::ios::app)) {
+        Log(LogLevel::WARNING, "Failed to write incremental snapshot to '{}'",
+            path.string());
+        // A partly written section hides any appended after it
+        std::scoped_lock lock { mutex };
+        needs_full = true;
+        return false;
+    }
+
+    Log(LogLevel::INFO, "Wrote incremental snapshot of {} entries ({} KiB) in {:.1f} ms",
+        count, section.size() / 1024, Milliseconds(SnapshotClock::now() - start));
+    return true;
+}
+
+bool SnapshotWriter::WriteFull()
+{
+    std::scoped_lock file_lock { file_mutex };
+    return WriteFullSnapshot();
+}
+
+bool SnapshotWriter::WriteFullSnapshot()
+{
+    SnapshotClock::time_point start = SnapshotClock::now();
+
+    ByteBuffer full, incremental;
+    size_t count;
+    uint64_t full_generation;
+    {
+        std::scoped_lock lock { mutex };
+        full_generation = ++generation;
+        AppendFileHeader(full, full_generation);
+        count = AppendSection(full, false);
+    }
+    AppendFileHeader(incremental, full_generation);
+
+    fs::path path { directory };
+    std::error_code error;
+    fs::create_directories(path, error);
+
+    // Replaced in one step, so that a crash leaves either snapshot whole
+    fs::path full_path = path / FULL_SNAPSHOT_NAME;
+    fs::path temporary_path = full_path;
+    temporary_path += ".tmp";
+
+    bool written = WriteFile(temporary_path, full);
+    if (written) fs::rename(temporary_path, full_path, error);
+    written = written && !error && WriteFile(path / INCREMENTAL_SNAPSHOT_NAME, incremental);
+
+    {
+        std::scoped_lock lock { mutex };
+        needs_full = !written;
+    }
+
+    if (!written) {
+        Log(LogLevel::WARNING, "Failed to write full snapshot to '{}'", full_path.string());
+        return false;
+    }
+
+    Log(LogLevel::INFO, "Wrote full snapshot of {} entries ({} KiB) in {:.1f} ms", count,
+        full.size() / 1024, Milliseconds(SnapshotClock::now() - start));
+    return true;
+}
+
+size_t SnapshotWriter::Size() const
+{
+    std::scoped_lock lock { mutex };
+
+    size_t size = 0;
+    for (const Table& table : tables)
+        size += table.entries.size();
+    return size;
+}
+
+const std::string& SnapshotWriter::Directory() const { return directory; }
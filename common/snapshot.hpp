@@ -0,0 +1,176 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "common/codec.hpp"
+#include "common/product.hpp"
+
+// Snapshots of the product and query databases hosted by the terminal, so that it
+// starts with a warm cache. The webscraper keeps the latest value it put for each key
+// and writes them out: every few minutes the values changed since the last snapshot
+// are appended to an incremental file, and every few increments, and on shutdown,
+// everything is rewritten to a full snapshot. The terminal maps the files into memory
+// at startup and puts their entries back into the databases.
+//
+// Both files start with a header holding the generation of the full snapshot, which
+// grows each time it is rewritten; increments of an older generation are ignored.
+// Entries are grouped into sections, one for the full snapshot and one per increment,
+// so that a section left incomplete by a crash can be told apart. Each section lists
+// its entries least recently recorded first. Values are products
+// encoded by common/codec.hpp and query templates as MessagePack. Integers are in host
+// byte order, since snapshots are only read on the machine that wrote them.
+
+enum class SnapshotStore : uint8_t
+{
+    PRODUCTS,
+    QUERIES
+};
+
+struct DatabaseInfo
+{
+    std::string_view name;
+    size_t capacity;
+};
+
+constexpr auto SNAPSHOT_DATABASES = std::to_array<DatabaseInfo>({
+    { "products", 2000 },
+    { "queries", 200 }
+});
+
+constexpr const DatabaseInfo& GetDatabaseInfo(SnapshotStore store)
+{
+    return SNAPSHOT_DATABASES[static_cast<size_t>(store)];
+}
+
+constexpr std::string_view PRODUCTS_DATABASE
+    = GetDatabaseInfo(SnapshotStore::PRODUCTS).name;
+constexpr std::string_view QUERIES_DATABASE
+    = GetDatabaseInfo(SnapshotStore::QUERIES).name;
+
+constexpr std::string_view DEFAULT_SNAPSHOT_DIRECTORY = ".fitsch_snapshots";
+// Names the snapshot directory for both the webscraper and the terminal
+constexpr const char* SNAPSHOT_DIRECTORY_VARIABLE = "FITSCH_SNAPSHOT_DIRECTORY";
+constexpr std::string_view FULL_SNAPSHOT_NAME = "full.snapshot";
+constexpr std::string_view INCREMENTAL_SNAPSHOT_NAME = "incremental.snapshot";
+
+// Only valid as long as the LoadedSnapshot it came from
+struct SnapshotEntry
+{
+    SnapshotStore store;
+    std::string_view key;
+    std::span<const uint8_t> value;
+};
+
+// A file mapped read-only into memory
+class MappedFile
+{
+public:
+    static std::optional<MappedFile> Open(const std::string& path);
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    ~MappedFile();
+
+    std::span<const uint8_t> Data() const;
+
+private:
+    MappedFile(const uint8_t* data, size_t size);
+
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+struct LoadedSnapshot
+{
+    std::vector<MappedFile> files;
+    // The latest entry for each key, least recently recorded first, and no more for
+    // each database than its capacity
+    std::vector<SnapshotEntry> entries;
+    uint64_t generation = 0;
+    size_t increments = 0;
+    // When the latest section was written
+    TimePoint timestamp {};
+};
+
+// $FITSCH_SNAPSHOT_DIRECTORY, or DEFAULT_SNAPSHOT_DIRECTORY if it is unset or empty, as
+// an absolute path, so that processes started in different directories can be checked
+// to agree from their logs
+std::string GetSnapshotDirectory();
+
+// Maps in the snapshot in `directory`. Empty if there is no valid full snapshot.
+std::optional<LoadedSnapshot> LoadSnapshot(std::string_view directory);
+
+// The entries of each database, decoded. Entries that fail to decode are skipped.
+std::vector<std::pair<std::string_view, Product>> DecodeProductEntries(
+    const LoadedSnapshot& snapshot);
+std::vector<std::pair<std::string_view, QueryTemplate>> DecodeQueryEntries(
+    const LoadedSnapshot& snapshot);
+
+// The latest value recorded for each key, bounded by the capacity of each database by
+// forgetting the least recently recorded. Thread-safe.
+class SnapshotWriter
+{
+public:
+    explicit SnapshotWriter(std::string directory);
+
+    // Starts from the snapshot already in the directory, if there is one, so that
+    // the next full snapshot does not lose what it held. Keys are recorded in the
+    // order they were before, so the same ones are forgotten first.
+    void Load();
+
+    template<typename AATypes>
+    void RecordProduct(std::string_view key, const BasicProduct<AATypes>& product);
+    void RecordProduct(std::string_view key, const PMRProduct& product);
+    void RecordQuery(std::string_view key, const json& query);
+
+    // Appends the values recorded since the last snapshot to the incremental file.
+    // Writes a full snapshot instead if there is none yet.
+    bool WriteIncremental();
+    // Rewrites every value to the full snapshot and empties the incremental file
+    bool WriteFull();
+
+    size_t Size() const;
+    const std::string& Directory() const;
+
+private:
+    struct Entry
+    {
+        ByteBuffer value;
+        std::list<std::string>::iterator recency;
+    };
+
+    struct Table
+    {
+        std::unordered_map<std::string, Entry> entries;
+        // Least recently recorded first
+        std::list<std::string> recency;
+        // Keys recorded since the last snapshot
+        std::unordered_set<std::string> changed;
+    };
+
+    void Record(SnapshotStore store, std::string_view key, ByteBuffer value);
+    // Appends a section of the entries changed since the last snapshot, or of every
+    // entry, and forgets which changed. Returns the number of entries.
+    size_t AppendSection(ByteBuffer& out, bool only_changed);
+    // Expects `file_mutex` to be held
+    bool WriteFullSnapshot();
+
+    // Held while writing files, so that snapshots are written one at a time
+    std::mutex file_mutex;
+    mutable std::mutex mutex;
+    std::string directory;
+    std::array<Table, SNAPSHOT_DATABASES.size()> tables;
+    uint64_t generation = 0;
+    // Set while there is no full snapshot of `generation` for increments to follow
+    bool needs_full = true;
+};
@@ -11,6 +11,13 @@ auto Now() -> TimePoint
     );
 }
 
+auto PreciseNow() -> PreciseTimePoint
+{
+    return std::chrono::time_point_cast<std::chrono::milliseconds>(
+        Clock::now()
+    );
+}
+
 void Abort_AllocFailed()
 {
     Log(LogLevel::SEVERE, "Failed to allocate memory");
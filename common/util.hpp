@@ -1,6 +1,8 @@
 #pragma once
 
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <cstdlib>
 #include <cstdint>
 #include <ctime>
@@ -14,6 +16,12 @@
 
 using Clock = std::chrono::system_clock;
 using TimePoint = std::chrono::time_point<Clock, std::chrono::seconds>;
+using PreciseTimePoint = std::chrono::time_point<Clock, std::chrono::milliseconds>;
+
+// Absolute point in time by which a piece of work must be finished. Deadlines are
+// carried between services as milliseconds since the epoch.
+using Deadline = PreciseTimePoint;
+constexpr Deadline NO_DEADLINE = Deadline::max();
 
 struct Price;
 struct PricePU;
@@ -22,6 +30,7 @@ enum class LogLevel { DEBUG = 0, INFO = 1, WARNING = 2, SEVERE = 3 };
 constexpr auto MIN_LOG_LEVEL = LogLevel::DEBUG;
 
 auto Now() -> TimePoint;
+auto PreciseNow() -> PreciseTimePoint;
 
 template<typename... T>
 void Log(LogLevel l, std::format_string<T...> format, T&&... args)
@@ -109,20 +118,29 @@ void from_json(const json& j, tb::arena_vector<T>& vec)
 	}), vec.begin());
 }
 
+// Keys which are not strings are written as the string they serialise to
 template<typename K, typename V>
 void to_json(json& j, const tb::arena_unordered_map<K, V>& map)
 {
     j = json::object();
-	for (const auto& [key, value] : map)
-		j.emplace(key, value);
+	for (const auto& [key, value] : map) {
+		if constexpr (std::is_convertible_v<const K&, std::string_view>)
+			j.emplace(key, value);
+		else
+			j.emplace(json(key).template get<std::string>(), value);
+	}
 }
 
 template<typename K, typename V>
 void from_json(const json& j, tb::arena_unordered_map<K, V>& map)
 {
 	map.clear();
-	for (const auto& [key, value] : j.items())
-		map.emplace(key, value);
+	for (const auto& [key, value] : j.items()) {
+		if constexpr (std::is_convertible_v<const K&, std::string_view>)
+			map.emplace(key, value);
+		else
+			map.emplace(json(key).template get<K>(), value.template get<V>());
+	}
 }
 
 namespace nlohmann
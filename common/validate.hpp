@@ -17,10 +17,14 @@ constexpr auto IsStringArray = [] (const json& j) -> bool {
     return true;
 };
 
+// Products encoded by EncodeProduct
+constexpr auto IsBinary = [] (const json& j) -> bool { return j.is_binary(); };
+
 inline const buxtehude::ValidationSeries QUERY_RESULT = {
     { "/term"_json_pointer, bux::predicates::NotEmpty },
-    { "/items"_json_pointer, bux::predicates::IsArray },
-    { "/request-id"_json_pointer, bux::predicates::IsNumber }
+    { "/items"_json_pointer, IsBinary },
+    { "/request-id"_json_pointer, bux::predicates::IsNumber },
+    { "/stale-stores"_json_pointer, bux::predicates::IsNumber }
 };
 
 inline const buxtehude::ValidationSeries QUERY = {
@@ -28,7 +32,14 @@ inline const buxtehude::ValidationSeries QUERY = {
     { "/request-id"_json_pointer, bux::predicates::IsNumber },
     { "/stores"_json_pointer, bux::predicates::IsNumber },
     { "/depth"_json_pointer, bux::predicates::IsNumber },
-    { "/force-refresh"_json_pointer, buxtehude::predicates::IsBool }
+    { "/force-refresh"_json_pointer, buxtehude::predicates::IsBool },
+    { "/deadline"_json_pointer, bux::predicates::IsNumber }
+};
+
+inline const buxtehude::ValidationSeries CATALOG_QUERY = {
+    { "/request-id"_json_pointer, bux::predicates::IsNumber },
+    { "/stores"_json_pointer, bux::predicates::IsNumber },
+    { "/count"_json_pointer, bux::predicates::IsNumber }
 };
 
 }
@@ -1,4 +1,6 @@
+#include <chrono>
 #include <iostream>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -8,11 +10,16 @@
 #include <dflat/dflat.hpp>
 
 #include <nlohmann/json.hpp>
+#include "common/codec.hpp"
 #include "common/validate.hpp"
 #include "common/product.hpp"
+#include "common/snapshot.hpp"
 #include "common/util.hpp"
 
 using nlohmann::json;
+using namespace std::chrono_literals;
+
+constexpr auto QUERY_TIMEOUT = 10s;
 
 std::vector<std::string> split(std::string_view view, char delim)
 {
@@ -29,6 +36,49 @@ std::vector<std::string> split(std::string_view view, char delim)
     return result;
 }
 
+// Puts the entries of the snapshot in `directory`, written by the webscraper, back into
+// the databases
+void RestoreSnapshot(dflat::Handle& db_handle, std::string_view directory)
+{
+    using RestoreClock = std::chrono::steady_clock;
+    RestoreClock::time_point start = RestoreClock::now();
+
+    std::optional<LoadedSnapshot> snapshot = LoadSnapshot(directory);
+    if (!snapshot) {
+        Log(LogLevel::INFO, "No snapshot to restore in '{}'", directory);
+        return;
+    }
+
+    RestoreClock::time_point mapped = RestoreClock::now();
+
+    auto products = DecodeProductEntries(*snapshot);
+    auto queries = DecodeQueryEntries(*snapshot);
+
+    std::vector<std::pair<std::string_view, Product&>> product_pairs;
+    product_pairs.reserve(products.size());
+    for (auto& [key, product] : products) product_pairs.emplace_back(key, product);
+
+    std::vector<std::pair<std::string_view, QueryTemplate&>> query_pairs;
+    query_pairs.reserve(queries.size());
+    for (auto& [key, query] : queries) query_pairs.emplace_back(key, query);
+
+    db_handle.PutMany<Product>(PRODUCTS_DATABASE, product_pairs, true).if_err(
+    [] (dflat::DatabaseError) {
+        Log(LogLevel::WARNING, "Failed to restore products from snapshot");
+    });
+    db_handle.PutMany<QueryTemplate>(QUERIES_DATABASE, query_pairs, true).if_err(
+    [] (dflat::DatabaseError) {
+        Log(LogLevel::WARNING, "Failed to restore queries from snapshot");
+    });
+
+    std::chrono::duration<double, std::milli> map_time = mapped - start;
+    std::chrono::duration<double, std::milli> total_time = RestoreClock::now() - start;
+    Log(LogLevel::INFO, "Restored {} products and {} queries from snapshot {}.{} in '{}' "
+        "in {:.1f} ms ({:.1f} ms mapping)", products.size(), queries.size(),
+        snapshot->generation, snapshot->increments, directory, total_time.count(),
+        map_time.count());
+}
+
 int main()
 {
     namespace bux = buxtehude;
@@ -73,17 +123,21 @@ int main()
         if (!bux::ValidateJSON(m.content, validate::QUERY_RESULT)) return;
         tb::print("Query results ({}):\n", m.content["term"].get<std::string>());
 
-        for (const json& j : m.content["items"]) {
-            if (!j.contains("name")) continue;
-            tb::print("  {}\n", j["name"].get<std::string>());
-        }
+        std::optional<std::vector<Product>> products
+            = DecodeProducts(m.content["items"].get_binary());
+        if (!products) return;
+
+        for (const Product& product : products.value())
+            tb::print("  {}\n", product.name);
     });
 
     terminal.InternalConnect(server).ignore_error();
     bux_database.InternalConnect(server).ignore_error();
 
-    db_handle.Create("products", false, 2000).ignore_error();
-    db_handle.Create("queries", false, 200).ignore_error();
+    for (const DatabaseInfo& info : SNAPSHOT_DATABASES)
+        db_handle.Create(info.name, false, info.capacity).ignore_error();
+
+    RestoreSnapshot(db_handle, GetSnapshotDirectory());
 
     std::string input;
 
@@ -103,7 +157,9 @@ int main()
                 { "request-id", 0 },
                 { "stores", stores },
                 { "depth", 10 },
-                { "force-refresh", false }
+                { "force-refresh", false },
+                { "deadline",
+                    (PreciseNow() + QUERY_TIMEOUT).time_since_epoch().count() }
             },
             .only_first = true,
         }).ignore_error();
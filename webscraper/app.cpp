@@ -1,22 +1,26 @@
 #include "webscraper/app.hpp"
 
+#include <algorithm>
+#include <array>
+#include <condition_variable>
 #include <fstream>
 #include <cstdlib>
+#include <mutex>
 #include <ranges>
 
 #include <nlohmann/json.hpp>
 
 #include <buxtehude/validate.hpp>
 
+#include "common/codec.hpp"
 #include "common/product.hpp"
+#include "common/snapshot.hpp"
 #include "common/util.hpp"
 #include "common/validate.hpp"
+#include "webscraper/parsearena.hpp"
 
 #include <chrono>
 
-constexpr std::string_view PRODUCTS_DATABASE = "products";
-constexpr std::string_view QUERIES_DATABASE = "queries";
-
 constexpr auto DATABASE_UPLOAD_FAILED = [] (dflat::DatabaseError) {
     Log(LogLevel::WARNING, "Failed to upload to database!");
 };
@@ -25,6 +29,13 @@ constexpr auto DATABASE_GET_FAILED = [] (dflat::DatabaseError) {
     Log(LogLevel::WARNING, "Failed to get documents from database!");
 };
 
+// Products pushed by the query tasks
+struct QueryResults {
+    ArenaProductList* list;
+    bool queried_website;
+    std::optional<StoreID> store; // Set for a fetched search page
+};
+
 auto RETRY_TASK = [] (auto) {
     using namespace std::chrono_literals;
     std::this_thread::sleep_for(5ms);
@@ -46,23 +57,121 @@ static void PrintProduct(GroupHandle, std::span<Result> results, App* app,
     }
 
     auto& product = results[0].Get<ArenaProduct>();
+    product.effective_prices = ComputeEffectivePrices(product);
 
     tb::print("Product at URL `{}`:\n  {}: {} [{}]\n", url, product.name,
                product.item_price.ToString(), product.price_per_unit.ToString());
 
-    app->db_handle.Put(PRODUCTS_DATABASE, product.id, product, true)
+    app->catalog.Put(product);
+
+    std::string key = product.Key().ToHex();
+    app->snapshots.RecordProduct(key, product);
+    app->db_handle.Put(PRODUCTS_DATABASE, key, product, true)
+        .if_err(DATABASE_UPLOAD_FAILED);
+}
+
+static void StoreEnrichedProduct(GroupHandle, std::span<Result> results, App* app,
+    std::string_view url)
+{
+    if (results.empty() || results[0].GetType() != Result::GENERIC_VALID) {
+        Log(LogLevel::DEBUG, "Failed to enrich product at URL {}", url);
+        return;
+    }
+
+    auto& product = results[0].Get<ArenaProduct>();
+    product.effective_prices = ComputeEffectivePrices(product);
+
+    std::string key = product.Key().ToHex();
+
+    // A product page that lists offers describes the product fully and replaces the
+    // stored listing. Other product pages only add details, which are merged into the
+    // stored search listing so that its offers are kept.
+    std::optional<Product> stored;
+    if (product.offers.empty()) {
+        app->db_handle.Get<Product>(PRODUCTS_DATABASE, key)
+        .if_ok_mut([&stored] (Product& listing) { stored = std::move(listing); });
+    }
+
+    if (!stored) {
+        app->catalog.Put(product);
+        app->snapshots.RecordProduct(key, product);
+        app->db_handle.Put(PRODUCTS_DATABASE, key, product, true)
+            .if_err(DATABASE_UPLOAD_FAILED);
+        return;
+    }
+
+    stored->description.assign(product.description.data(), product.description.size());
+    stored->price_per_unit = product.price_per_unit;
+    stored->effective_prices = ComputeEffectivePrices(*stored);
+    stored->full_info = true;
+    app->catalog.Put(*stored);
+
+    app->snapshots.RecordProduct(key, *stored);
+    app->db_handle.Put(PRODUCTS_DATABASE, key, *stored, true)
         .if_err(DATABASE_UPLOAD_FAILED);
 }
 
+// Search listings have no description and sometimes a rough price per unit. Details
+// fetched earlier are carried over to the listings about to be stored, unless
+// disabled in the config, and products still lacking them are queued for enrichment.
+// The details of all listings are looked up in one batch.
+static void CarryOverDetails(App* app,
+    std::span<std::pair<std::string_view, PMRProduct&>> products)
+{
+    std::vector<std::string_view> lacking;
+    if (app->config.carry_over_details) {
+        for (const auto& [key, pmr_product] : products) {
+            if (!std::visit([] (auto& p) { return p.full_info; }, pmr_product))
+                lacking.push_back(key);
+        }
+    }
+
+    std::unordered_map<std::string, Product> stored;
+    if (!lacking.empty()) {
+        app->db_handle.GetMany<Product>(PRODUCTS_DATABASE, lacking)
+        .if_err(DATABASE_GET_FAILED)
+        .if_ok_mut([&stored] (std::unordered_map<std::string, Product>& results) {
+            stored = std::move(results);
+        });
+    }
+
+    for (auto& [key, pmr_product] : products) {
+        std::visit([&, key = key] (auto& product) {
+            if (product.full_info) return;
+
+            auto iter = stored.find(std::string(key));
+            if (iter != stored.end() && iter->second.full_info) {
+                const Product& details = iter->second;
+                product.description.assign(details.description.data(),
+                                           details.description.size());
+                if (details.item_price.value == product.item_price.value) {
+                    product.price_per_unit = details.price_per_unit;
+                    product.effective_prices = ComputeEffectivePrices(product);
+                    app->catalog.Put(product);
+                }
+                product.full_info = true;
+                return;
+            }
+
+            const Store* store = app->GetStore(product.store);
+            if (app->config.enrichment && store && store->GetProductAtURL)
+                app->enrichment.Add(product.Key(), product.FullURL(), product.store);
+        }, pmr_product);
+    }
+}
+
 static void SendQuery(GroupHandle g, std::span<Result> results, App* app,
     std::string_view dest, std::string_view query_string,
     StoreSelection stores, unsigned request_id)
 {
     bool upload = false;
-    json items_to_send = json::array();
+    StoreSelection stale_stores {};
     tb::arena_vector<std::pair<std::string_view, PMRProduct&>> product_pairs {
         g.group->results_region
     };
+    tb::arena_vector<std::pair<const PMRProduct*, size_t>> ranked_products {
+        g.group->results_region
+    };
 
     tb::scoped_guard free_pmr_products = [&product_pairs] () {
         for (auto& [_, product] : product_pairs) {
@@ -79,17 +188,20 @@ static void SendQuery(GroupHandle g, std::span<Result> results, App* app,
         .depth = SEARCH_DEPTH_INDEFINITE
     };
 
+    // A store whose first page failed is left out entirely, including any later
+    // pages of it that did arrive
     for (const Result& result : results) {
-        if (result.GetType() == Result::EMPTY)
-            continue;
-
-        if (result.GetType() != Result::GENERIC_VALID) {
+        if (result.GetType() == Result::GENERIC_ERROR)
             stores = stores.without(result.Get<StoreID>());
+    }
+
+    for (const Result& result : results) {
+        if (result.GetType() != Result::GENERIC_VALID)
             continue;
-        }
 
-        auto& [queried_website, product_list]
-            = result.Get<std::pair<bool, ArenaProductList*>>();
+        auto& [product_list, queried_website, store] = result.Get<QueryResults>();
+        if (store && StoreSelection { *store }.without(stores))
+            continue;
 
         upload |= queried_website;
 
@@ -99,24 +211,52 @@ static void SendQuery(GroupHandle g, std::span<Result> results, App* app,
         if (product_list->depth < qt.depth)
             qt.depth = product_list->depth;
 
+        bool stale = static_cast<bool>(product_list->stale_stores);
+        if (stale)
+            stale_stores = product_list->stale_stores;
+
         for (const auto& [product, result_info] : product_list->products) {
-            items_to_send.push_back(product);
-            auto id = std::visit([] (const auto& p) -> std::string_view {
-                return p.id;
+            ranked_products.emplace_back(&product, result_info.relevance);
+            // Also brings products cached before effective prices existed up to date
+            ProductKey key = std::visit([app] (auto& p) {
+                p.effective_prices = ComputeEffectivePrices(p);
+                app->catalog.Put(p);
+                return p.Key();
             }, product);
 
-            product_pairs.emplace_back(id, product);
-            qt.results.emplace(id, result_info);
+            // Stale products are kept in the query template so that they remain
+            // available as a fallback, but are not written back
+            if (!stale) {
+                auto& hex = *g.AllocateResult<std::array<char, ProductKey::HEX_DIGITS>>();
+                key.WriteHex(hex);
+                product_pairs.emplace_back(std::string_view { hex.data(), hex.size() },
+                                           product);
+            }
+            qt.results.emplace(key, result_info);
         }
     }
 
+    // Stores served from cache must still be queried next time
+    qt.stores = stores.without(stale_stores);
+
+    // Pages arrive in any order - send them merged by rank
+    std::stable_sort(ranked_products.begin(), ranked_products.end(),
+        [] (const auto& a, const auto& b) { return a.second < b.second; });
+
+    ByteBuffer items;
+    items.reserve(ranked_products.size() * ENCODED_PRODUCT_SIZE_HINT);
+    EncodeProductArrayHeader(items, ranked_products.size());
+    for (const auto& [product, _] : ranked_products)
+        EncodeProduct(items, *product);
+
     {
         std::scoped_lock client_lock { app->client_mutex };
         app->bclient.Write({ .dest { dest }, .type = "query-result",
             .content = {
-                { "items", std::move(items_to_send) },
+                { "items", json::binary(std::move(items)) },
                 { "term", query_string },
-                { "request-id", request_id }
+                { "request-id", request_id },
+                { "stale-stores", stale_stores }
             }
         }).if_err([] (bux::WriteError) {
             Log(LogLevel::WARNING,
@@ -128,57 +268,196 @@ static void SendQuery(GroupHandle g, std::span<Result> results, App* app,
         return;
 
     Log(LogLevel::DEBUG, "Uploading query {}", query_string);
+    app->snapshots.RecordQuery(query_string, qt);
     app->db_handle.Put(QUERIES_DATABASE, query_string, qt, true)
         .if_err(DATABASE_UPLOAD_FAILED);
 
     if (!product_pairs.empty()) {
+        CarryOverDetails(app, product_pairs);
+        for (const auto& [key, product] : product_pairs)
+            app->snapshots.RecordProduct(key, product);
         app->db_handle.PutMany<PMRProduct>(PRODUCTS_DATABASE, product_pairs, true)
             .if_err(DATABASE_UPLOAD_FAILED);
     }
 }
 
+// Latest cached products for `stores`, regardless of expiry, for stores whose
+// circuit breaker is open
+static ArenaProductList* GetStaleProducts(GroupHandle group, App* app,
+    std::string_view query_string, StoreSelection stores, size_t depth)
+{
+    auto& list = *group.AllocateResult<ArenaProductList>(
+        ArenaProductList::WithArena(group.group->results_region)
+    );
+    list.depth = depth;
+    list.stale_stores = stores;
+
+    app->db_handle.Get<QueryTemplate>(QUERIES_DATABASE, query_string)
+    .if_err([] (dflat::DatabaseError e) {
+        if (e != dflat::DatabaseError::KEY_NOT_FOUND)
+            DATABASE_GET_FAILED(e);
+    }).if_ok([&] (const QueryTemplate& query_info) {
+        std::vector<std::string> stale_keys;
+        for (const auto& [key, info] : query_info.results) {
+            if (info.relevance < depth && !StoreSelection { key.Store() }.without(stores))
+                stale_keys.push_back(key.ToHex());
+        }
+
+        app->db_handle.GetMany<Product>(PRODUCTS_DATABASE, stale_keys)
+        .if_ok_mut([&] (std::unordered_map<std::string, Product>& results) {
+            for (auto& [_, product] : results) {
+                ProductKey key = product.Key();
+                auto& product_copy = *group.AllocateResult<PMRProduct>(
+                    std::move(product)
+                );
+                list.products.emplace_back(
+                    product_copy,
+                    query_info.results.at(key)
+                );
+            }
+        })
+        .if_err(DATABASE_GET_FAILED);
+    });
+
+    return &list;
+}
+
+// Pages fetched per store for one query, bounded so that the transfers of a query
+// across all stores stay well inside TaskGroup::MAX_TASKS
+constexpr size_t MAX_SEARCH_PAGES = 4;
+static_assert(MAX_SEARCH_PAGES * stores::ALL.size() < TaskGroup::MAX_TASKS);
+
+// Pages needed for `depth` results, no more
+static size_t SearchPageCount(const Store& store, size_t depth)
+{
+    // An indefinite depth reads whatever the first page holds
+    if (depth == SEARCH_DEPTH_INDEFINITE) return 1;
+
+    size_t pages = (depth + store.page_size - 1) / store.page_size;
+    return std::clamp<size_t>(pages, 1, MAX_SEARCH_PAGES);
+}
+
 static Result TC_DoQuery(GroupHandle group, App* app, std::string_view query_string,
-    StoreSelection stores, size_t depth)
+    StoreSelection stores, size_t depth, Deadline deadline)
 {
+    Deadline transfer_deadline = deadline - app->config.deadline_margin;
+    if (PreciseNow() >= transfer_deadline) {
+        Log(LogLevel::DEBUG, "Deadline passed, not querying stores for {}", query_string);
+        return {};
+    }
+
+    StoreSelection open_circuit = stores;
     for (StoreID id : stores) {
         const Store* store = app->GetStore(id);
         if (store == nullptr) {
             Log(LogLevel::WARNING, "Invalid store ID {}", static_cast<int>(id));
+            open_circuit = open_circuit.without(id);
             continue;
         }
-        std::string url = store->GetProductSearchURL(query_string);
+
+        CircuitBreaker& breaker = app->GetCircuitBreaker(id);
+        CircuitBreaker::Admission admission = breaker.AllowRequest();
+        if (admission == CircuitBreaker::Admission::DENIED)
+            continue;
+
+        open_circuit = open_circuit.without(id);
+
         CURLOptions request_options = store->GetProductSearchCURLOptions(query_string);
+        request_options.deadline = transfer_deadline;
+        request_options.store = id;
+
+        auto parse = store->ParseProductSearch;
+        if (app->config.parser_backend == ParserBackend::STREAM && store->StreamProductSearch)
+            parse = store->StreamProductSearch;
+
+        // Held for the whole transfer, so a reload cannot free it mid-parse
+        std::shared_ptr<const ExtractionPlan> plan = app->GetPlan(id);
+
+        // All pages are requested at once; each becomes its own result, ranked by
+        // its offset into the store's results. A half-open breaker's probe is a
+        // single transfer, so it only asks for the first page.
+        size_t pages = admission == CircuitBreaker::Admission::PROBE
+                     ? 1 : SearchPageCount(*store, depth);
+        size_t fetched_depth = depth == SEARCH_DEPTH_INDEFINITE
+                             ? depth : std::min(depth, pages * store->page_size);
+        for (size_t page = 0; page < pages; ++page) {
+            size_t offset = page * store->page_size;
+            size_t page_depth = depth == SEARCH_DEPTH_INDEFINITE
+                              ? depth : std::min(store->page_size, depth - offset);
+
+            std::string url = store->GetProductSearchURL(query_string, page);
+
+            auto transfer_task = group.CreateExternalTask();
+            group.QueueTasks({}, { transfer_task }).ignore_error();
+
+            app->curl_driver.PerformTransfer(url,
+            [transfer_task, parse, plan, store, fetched_depth, page_depth, offset, id,
+             group, &breaker, admission]
+            (auto data, auto url, CURLcode code) {
+                tb::thread_safe_memory_arena& arena = group.group->results_region;
+
+                // Block and error pages arrive as HTTP_ERROR_STATUS, and count as a
+                // failure rather than a page without listings
+                ArenaProductList* list = nullptr;
+                if (code == CURLE_OK) {
+                    list = plan ? ExecutePlan(*plan, *store, data, arena, page_depth)
+                                : parse(data, arena, page_depth);
+                }
+
+                // The first page alone stands for the store's health, so that a
+                // half-open breaker sees exactly one probe. A transfer that expired
+                // in the queue never reached the store and says nothing about it.
+                if (offset == 0) {
+                    if (code == TRANSFER_EXPIRED) breaker.RecordAbandoned(admission);
+                    else if (list != nullptr) breaker.RecordSuccess(admission);
+                    else breaker.RecordFailure(admission);
+                }
 
-        auto transfer_task = group.CreateExternalTask();
-        group.QueueTasks({}, { transfer_task }).ignore_error();
+                if (list == nullptr && offset == 0) {
+                    transfer_task.PushResult({
+                        group.AllocateResult<StoreID>(id),
+                        Result::GENERIC_ERROR
+                    });
+                    return;
+                }
+
+                if (list == nullptr) {
+                    // Losing a later page only loses its results, which leaves the
+                    // store's results complete up to that page
+                    list = arena.allocate_object<ArenaProductList>(
+                        ArenaProductList::WithArena(arena));
+                    list->depth = offset;
+                } else {
+                    list->depth = fetched_depth;
+                    for (auto& [product, info] : list->products)
+                        info.relevance += offset;
+                }
 
-        app->curl_driver.PerformTransfer(url,
-        [transfer_task, store, depth, id, group] (auto data, auto url, CURLcode code) {
-            if (code == CURLE_OK) {
                 transfer_task.PushResult({
-                    group.AllocateResult<std::pair<bool, ArenaProductList*>>(
-                        true,
-                        store->ParseProductSearch(
-                            data, group.group->results_region, depth
-                        )
-                    ),
+                    group.AllocateResult<QueryResults>(list, true, id),
                     Result::GENERIC_VALID
                 });
-            } else {
-                transfer_task.PushResult({
-                    group.AllocateResult<StoreID>(id),
-                    Result::GENERIC_ERROR
-                });
-            }
-        }, request_options);
+            }, request_options);
+        }
     }
 
-    return {};
+    if (!open_circuit)
+        return {};
+
+    Log(LogLevel::DEBUG, "Serving cached products for stores {} (circuit open)",
+        open_circuit._enum_field);
+
+    return {
+        group.AllocateResult<QueryResults>(
+            GetStaleProducts(group, app, query_string, open_circuit, depth), false
+        ),
+        Result::GENERIC_VALID
+    };
 }
 
 static Result TC_GetQueriesDB(GroupHandle group, App* app,
     std::string_view query_string, StoreSelection stores, size_t depth,
-    bool force_refresh)
+    bool force_refresh, Deadline deadline)
 {
     auto& list = *group.AllocateResult<ArenaProductList>(
         ArenaProductList::WithArena(group.group->results_region)
@@ -196,29 +475,34 @@ static Result TC_GetQueriesDB(GroupHandle group, App* app,
             if (query_info.depth < depth || time_elapsed > app->config.entry_expiry_time)
                 return;
 
-            size_t ids_count = 0;
-            auto relevant_ids = std::views::keys(
-                query_info.results | std::views::filter([depth, &ids_count] (auto& pair) {
-                    auto& [id, info] = pair;
-                    ++ids_count;
-                    return info.relevance < depth;
-                })
-            );
+            size_t keys_count = 0;
+            std::vector<std::string> relevant_keys;
+            for (const auto& [key, info] : query_info.results) {
+                ++keys_count;
+                if (info.relevance < depth)
+                    relevant_keys.push_back(key.ToHex());
+            }
 
-            app->db_handle.GetMany<Product>(PRODUCTS_DATABASE, relevant_ids)
+            app->db_handle.GetMany<Product>(PRODUCTS_DATABASE, relevant_keys)
             .if_ok_mut([&] (std::unordered_map<std::string, Product>& results) {
-                if (results.size() != ids_count)
+                if (results.size() != keys_count)
                     return;
 
                 missing = stores.without(query_info.stores);
 
-                for (auto& [id, product] : results) {
+                for (auto& [_, product] : results) {
+                    // Stale fallback products of stores still missing from the
+                    // template are refreshed by the live query instead
+                    if (!StoreSelection { product.store }.without(missing))
+                        continue;
+
+                    ProductKey key = product.Key();
                     auto& product_copy = *group.AllocateResult<PMRProduct>(
                         std::move(product)
                     );
                     list.products.emplace_back(
                         product_copy,
-                        query_info.results.at(id)
+                        query_info.results.at(key)
                     );
                 }
             })
@@ -227,14 +511,12 @@ static Result TC_GetQueriesDB(GroupHandle group, App* app,
     }
 
     if (missing) {
-        Task do_query { TC_DoQuery, app, query_string, missing, depth };
+        Task do_query { TC_DoQuery, app, query_string, missing, depth, deadline };
         group.QueueTasks(tb::make_span({ do_query })).ignore_error();
     }
 
     return {
-        group.AllocateResult<std::pair<bool, ArenaProductList*>>(
-            false, &list
-        ),
+        group.AllocateResult<QueryResults>(&list, false),
         Result::GENERIC_VALID
     };
 }
@@ -268,6 +550,20 @@ std::optional<AppConfig> AppConfig::FromJSONFile(std::string_view path)
         cfg_json["curl"]["user-agent"].get_to(result.curl_useragent);
     }
 
+    if (cfg_json.contains("/curl/proxies"_json_pointer)) {
+        for (const json& proxy : cfg_json["curl"]["proxies"]) {
+            if (!proxy.contains("url") || !proxy["url"].is_string()) {
+                Log(LogLevel::WARNING, "Ignoring proxy without URL in config");
+                continue;
+            }
+
+            ProxyConfig& proxy_config = result.proxies.emplace_back();
+            proxy["url"].get_to(proxy_config.url);
+            if (proxy.contains("max-concurrent") && proxy["max-concurrent"].is_number())
+                proxy_config.max_concurrent = proxy["max-concurrent"].get<unsigned>();
+        }
+    }
+
     if (cfg_json.contains("/buxtehude/type"_json_pointer)) {
         const json& type = cfg_json["buxtehude"]["type"];
         if (type == "unix")
@@ -290,6 +586,71 @@ std::optional<AppConfig> AppConfig::FromJSONFile(std::string_view path)
             result.entry_expiry_time = time;
     }
 
+    if (cfg_json.contains("/deadline-margin-ms"_json_pointer)) {
+        const json& margin = cfg_json["deadline-margin-ms"];
+        if (margin.is_number())
+            result.deadline_margin = std::chrono::milliseconds { margin.get<unsigned>() };
+    }
+
+    if (cfg_json.contains("/lexbor-parse-arena"_json_pointer)) {
+        const json& arena = cfg_json["lexbor-parse-arena"];
+        if (arena.is_boolean())
+            result.lexbor_parse_arena = arena;
+    }
+
+    if (cfg_json.contains("/extraction-plans"_json_pointer)) {
+        cfg_json["extraction-plans"].get_to(result.extraction_plans_path);
+    }
+
+    if (cfg_json.contains("/enrichment"_json_pointer)) {
+        const json& enrichment = cfg_json["enrichment"];
+        if (enrichment.is_boolean())
+            result.enrichment = enrichment;
+    }
+
+    if (cfg_json.contains("/carry-over-details"_json_pointer)) {
+        const json& carry_over = cfg_json["carry-over-details"];
+        if (carry_over.is_boolean())
+            result.carry_over_details = carry_over;
+    }
+
+    if (cfg_json.contains("/catalog-capacity"_json_pointer)) {
+        const json& capacity = cfg_json["catalog-capacity"];
+        if (capacity.is_number_unsigned() && capacity.get<size_t>() > 0)
+            result.catalog_capacity = capacity;
+    }
+
+    if (cfg_json.contains("/snapshots/enabled"_json_pointer)) {
+        const json& enabled = cfg_json["snapshots"]["enabled"];
+        if (enabled.is_boolean())
+            result.snapshots = enabled;
+    }
+
+    if (cfg_json.contains("/snapshots/directory"_json_pointer)) {
+        Log(LogLevel::WARNING, "Ignoring snapshots.directory, set {} instead so that "
+            "the terminal reads the same snapshots", SNAPSHOT_DIRECTORY_VARIABLE);
+    }
+
+    if (cfg_json.contains("/snapshots/interval-seconds"_json_pointer)) {
+        const json& interval = cfg_json["snapshots"]["interval-seconds"];
+        if (interval.is_number() && interval.get<unsigned>() > 0)
+            result.snapshot_interval = std::chrono::seconds { interval.get<unsigned>() };
+    }
+
+    if (cfg_json.contains("/snapshots/increments-per-full"_json_pointer)) {
+        const json& increments = cfg_json["snapshots"]["increments-per-full"];
+        if (increments.is_number())
+            result.increments_per_full_snapshot = increments.get<unsigned>();
+    }
+
+    if (cfg_json.contains("/parser-backend"_json_pointer)) {
+        const json& backend = cfg_json["parser-backend"];
+        if (backend == "stream")
+            result.parser_backend = ParserBackend::STREAM;
+        else if (backend != "dom")
+            Log(LogLevel::WARNING, "Unknown parser backend {}, using DOM", backend.dump());
+    }
+
     if (cfg_json.contains("/max-concurrent-transfers"_json_pointer)) {
         const json& max_transfers = cfg_json["max-concurrent-transfers"];
         if (max_transfers.is_number())
@@ -330,6 +691,15 @@ static void Bux_HandleQuery(bux::Client& client, const bux::Message& msg, App* a
     size_t depth = msg.content["depth"];
     auto stores = msg.content["stores"].get<StoreSelection>();
     bool force_refresh = msg.content["force-refresh"];
+    Deadline deadline {
+        std::chrono::milliseconds { msg.content["deadline"].get<int64_t>() }
+    };
+
+    if (PreciseNow() >= deadline) {
+        Log(LogLevel::DEBUG, "Dropping query #{} from {} - deadline passed",
+            request_id, msg.src);
+        return;
+    }
 
     for (const json& term_obj : msg.content["terms"]) {
         GroupHandle group;
@@ -355,7 +725,9 @@ static void Bux_HandleQuery(bux::Client& client, const bux::Message& msg, App* a
         bool reattempt = false;
         while (group.QueueTasks(
             tb::make_span({
-                Task { TC_GetQueriesDB, app, term, stores, depth, force_refresh }
+                Task {
+                    TC_GetQueriesDB, app, term, stores, depth, force_refresh, deadline
+                }
             }),
             {},
             reattempt
@@ -365,17 +737,102 @@ static void Bux_HandleQuery(bux::Client& client, const bux::Message& msg, App* a
     }
 }
 
+static void Bux_HandleConcurrencyStats(bux::Client& client, const bux::Message& msg,
+    App* app)
+{
+    json windows = json::array();
+    for (const ConcurrencyStats& stats : app->curl_driver.GetConcurrencyStats()) {
+        windows.push_back({
+            { "store", stats.store },
+            { "window", stats.window },
+            { "in-flight", stats.in_flight },
+            { "latency-ms", stats.latency_ms }
+        });
+    }
+
+    std::scoped_lock client_lock { app->client_mutex };
+    client.Write({ .dest { msg.src }, .type = "concurrency-stats-result",
+        .content = { { "windows", std::move(windows) } }
+    }).if_err([] (bux::WriteError) {
+        Log(LogLevel::WARNING,
+            "Failed to write back concurrency-stats-result - connection closed");
+    });
+}
+
+// Ranks the products in the catalog. Optional fields are "unit", "max-price",
+// "newer-than" (seconds since the epoch), "price" - one of "item", "unit", "effective"
+// (the default) and "member" - and "per-unit", which picks the cheapest product of
+// each unit instead of the `count` cheapest.
+static void Bux_HandleCatalogQuery(bux::Client& client, const bux::Message& msg,
+    App* app)
+{
+    if (!bux::ValidateJSON(msg.content, validate::CATALOG_QUERY)) return;
+
+    constexpr auto PRICE_COLUMNS = std::to_array<std::pair<std::string_view, PriceColumn>>({
+        { "item", PriceColumn::ITEM },
+        { "unit", PriceColumn::UNIT },
+        { "effective", PriceColumn::EFFECTIVE },
+        { "member", PriceColumn::MEMBER }
+    });
+
+    const json& content = msg.content;
+    CatalogFilter filter {
+        .stores = content["stores"].get<StoreSelection>(),
+        .max_price = content.value("max-price", std::numeric_limits<unsigned>::max()),
+        .newer_than = TimePoint { std::chrono::seconds {
+            content.value("newer-than", int64_t {})
+        } }
+    };
+    if (content.contains("unit")) {
+        const json& unit = content["unit"];
+        if (!unit.is_number_unsigned()
+            || unit.get<unsigned>() > static_cast<unsigned>(Unit::Metres)) {
+            Log(LogLevel::WARNING, "Ignoring catalog-query with unknown unit {}",
+                unit.dump());
+            return;
+        }
+        filter.unit = static_cast<Unit>(unit.get<unsigned>());
+    }
+
+    PriceColumn column = PriceColumn::EFFECTIVE;
+    std::string price = content.value("price", "effective");
+    for (const auto& [name, value] : PRICE_COLUMNS) {
+        if (name == price) column = value;
+    }
+
+    std::vector<CatalogEntry> entries = content.value("per-unit", false)
+        ? app->catalog.CheapestPerUnit(filter, column)
+        : app->catalog.TopK(filter, column, content["count"].get<size_t>());
+
+    std::scoped_lock client_lock { app->client_mutex };
+    client.Write({ .dest { msg.src }, .type = "catalog-query-result",
+        .content = {
+            { "request-id", content["request-id"] },
+            { "items", entries },
+            { "catalog-size", app->catalog.Size() }
+        }
+    }).if_err([] (bux::WriteError) {
+        Log(LogLevel::WARNING,
+            "Failed to write back catalog-query-result - connection closed");
+    });
+}
+
 // App
 
-App::App(AppConfig& cfg_temp) : config(std::move(cfg_temp))
+App::App(AppConfig& cfg_temp)
+    : config(std::move(cfg_temp)), enrichment(config.entry_expiry_time)
 {
+    if (config.lexbor_parse_arena)
+        EnableParseArenas();
+
     CURLDriver::GlobalInit();
     bux::Initialise([] (bux::LogLevel level, std::string_view msg) {
         if (level < bux::LogLevel::SEVERE) return;
         Log(static_cast<LogLevel>(level), "(buxtehude) {}", msg);
     });
 
-    curl_driver.Init(config.max_concurrent_transfers, config.curl_useragent);
+    curl_driver.Init(config.max_concurrent_transfers, config.curl_useragent,
+        config.proxies);
 
     db_handle.server_name = config.dflat_db_name;
 
@@ -388,6 +845,20 @@ App::App(AppConfig& cfg_temp) : config(std::move(cfg_temp))
         Bux_HandleQuery(client, msg, this);
     });
 
+    bclient.AddHandler("concurrency-stats",
+    [this] (bux::Client& client, const bux::Message& msg) {
+        Bux_HandleConcurrencyStats(client, msg, this);
+    });
+
+    bclient.AddHandler("catalog-query",
+    [this] (bux::Client& client, const bux::Message& msg) {
+        Bux_HandleCatalogQuery(client, msg, this);
+    });
+
+    bclient.AddHandler("reload-plans", [this] (bux::Client&, const bux::Message&) {
+        LoadPlans();
+    });
+
     bclient.SetDisconnectHandler([this] (bux::Client& client) {
         Log(LogLevel::WARNING, "Connection dropped to buxtehude server, retrying...");
         RetryConnection();
@@ -400,14 +871,42 @@ App::App(AppConfig& cfg_temp) : config(std::move(cfg_temp))
     }).if_ok([] {
         Log(LogLevel::INFO, "Established connection to buxtehude server");
     });
+
+    if (config.enrichment) {
+        enrichment_thread = std::jthread([this] (std::stop_token stop) {
+            RunEnrichment(stop);
+        });
+    }
+
+    if (config.snapshots) {
+        Log(LogLevel::INFO, "Writing snapshots to '{}'", snapshots.Directory());
+        snapshots.Load();
+        snapshot_thread = std::jthread([this] (std::stop_token stop) {
+            RunSnapshots(stop);
+        });
+    }
 }
 
 App::~App()
 {
+    if (enrichment_thread.joinable()) {
+        enrichment_thread.request_stop();
+        enrichment_thread.join();
+    }
+    if (snapshot_thread.joinable()) {
+        snapshot_thread.request_stop();
+        snapshot_thread.join();
+        snapshots.WriteFull();
+    }
     CURLDriver::GlobalCleanup();
 }
 
-void App::AddStore(const Store* store) { stores.emplace(store->id, store); }
+void App::AddStore(const Store* store)
+{
+    stores.emplace(store->id, store);
+    circuit_breakers.try_emplace(store->id);
+    plans.try_emplace(store->id);
+}
 
 const Store* App::GetStore(StoreID id)
 {
@@ -415,54 +914,199 @@ const Store* App::GetStore(StoreID id)
     return stores[id];
 }
 
+CircuitBreaker& App::GetCircuitBreaker(StoreID id) { return circuit_breakers.at(id); }
+
+void App::LoadPlans()
+{
+    if (config.extraction_plans_path.empty()) return;
+
+    std::ifstream spec_file(config.extraction_plans_path);
+    if (!spec_file.is_open()) {
+        Log(LogLevel::WARNING, "Failed to open extraction plans '{}'",
+            config.extraction_plans_path);
+        return;
+    }
+
+    json spec;
+    try {
+        spec = json::parse(spec_file);
+    } catch (const json::parse_error& e) {
+        Log(LogLevel::WARNING, "Failed to parse extraction plans: {}", e.what());
+        return;
+    }
+
+    size_t loaded = 0;
+    for (auto& [id, store] : stores) {
+        std::string prefix { store->prefix };
+        if (!spec.contains(prefix)) {
+            plans.at(id).store(nullptr);
+            continue;
+        }
+
+        if (std::shared_ptr<const ExtractionPlan> plan = CompilePlan(spec[prefix], prefix)) {
+            plans.at(id).store(std::move(plan));
+            ++loaded;
+        }
+    }
+
+    Log(LogLevel::INFO, "Loaded {} extraction plans from '{}'", loaded,
+        config.extraction_plans_path);
+}
+
+std::shared_ptr<const ExtractionPlan> App::GetPlan(StoreID id)
+{
+    return plans.at(id).load();
+}
+
 void App::GetProductAtURL(StoreID store_id, std::string_view item_url)
+{
+    FetchProduct(store_id, item_url, false);
+}
+
+bool App::FetchProduct(StoreID store_id, std::string_view item_url, bool enrich,
+    CircuitBreaker::Admission admission)
 {
     const Store* store = GetStore(store_id);
     if (store == nullptr) {
         Log(LogLevel::WARNING, "Invalid store!");
-        return;
+        return true;
+    }
+
+    if (store->GetProductAtURL == nullptr) {
+        Log(LogLevel::WARNING, "{} has no product page parser", store->name);
+        return true;
     }
 
     GroupHandle group;
-    while (
-        delegator.NewTaskGroup()
-        .try_move(group)
-        .if_err(RETRY_TASK)
-        .is_error()
-    ) {}
+    if (enrich) {
+        if (delegator.NewTaskGroup().try_move(group).is_error())
+            return false;
+    } else {
+        while (
+            delegator.NewTaskGroup()
+            .try_move(group)
+            .if_err(RETRY_TASK)
+            .is_error()
+        ) {}
+    }
 
     std::string_view url_arg {
         *group.AllocateArg<tb::arena_string>(item_url)
     };
 
-    group.SetResultCallback(PrintProduct, this, url_arg);
+    if (enrich)
+        group.SetResultCallback(StoreEnrichedProduct, this, url_arg);
+    else
+        group.SetResultCallback(PrintProduct, this, url_arg);
+
+    // Only enrichment fetches are admitted by the breaker, so only they report to it
+    CircuitBreaker* breaker = enrich ? &GetCircuitBreaker(store_id) : nullptr;
 
     auto transfer_task = group.CreateExternalTask();
     group.QueueTasks({}, { transfer_task }).ignore_error();
 
-    curl_driver.PerformTransfer(item_url,
-        [group, transfer_task, store] (auto data, auto url, CURLcode code) {
+    curl_driver.PerformTransfer(url_arg,
+        [group, transfer_task, store, breaker, admission]
+        (auto data, auto url, CURLcode code) {
+        ArenaProduct* product = nullptr;
         if (code == CURLE_OK) {
             std::optional<HTML> html = HTML::FromString(data);
-            if (!html) {
-                transfer_task.PushResult(Result::Error());
-                return;
+            if (html) {
+                product = store->GetProductAtURL(html.value(),
+                                                 group.group->results_region);
             }
+        }
 
-            ArenaProduct* product = store->GetProductAtURL(html.value(), group.group->results_region);
-            if (product == nullptr) {
-                transfer_task.PushResult(Result::Error());
-                return;
-            }
+        if (breaker) {
+            if (code == TRANSFER_EXPIRED) breaker->RecordAbandoned(admission);
+            else if (product != nullptr) breaker->RecordSuccess(admission);
+            else breaker->RecordFailure(admission);
+        }
 
-            transfer_task.PushResult({
-                product,
-                Result::GENERIC_VALID
-            });
-        } else {
+        if (product == nullptr) {
             transfer_task.PushResult(Result::Error());
+            return;
         }
+
+        transfer_task.PushResult({
+            product,
+            Result::GENERIC_VALID
+        });
+    }, {
+        .store = store_id,
+        .priority = enrich ? CURLOptions::Priority::BACKGROUND
+                           : CURLOptions::Priority::NORMAL
     });
+
+    return true;
+}
+
+void App::RunEnrichment(std::stop_token stop)
+{
+    std::mutex mutex;
+    std::condition_variable_any wakeup;
+
+    while (!stop.stop_requested()) {
+        {
+            std::unique_lock lock { mutex };
+            wakeup.wait_for(lock, stop, EnrichmentQueue::BATCH_INTERVAL,
+                            [] { return false; });
+        }
+
+        if (stop.stop_requested())
+            return;
+
+        std::vector<EnrichmentQueue::Candidate> batch = enrichment.TakeBatch();
+        if (batch.empty())
+            continue;
+
+        Log(LogLevel::DEBUG, "Enriching {} products ({} pending)", batch.size(),
+            enrichment.Size());
+
+        // Candidates not fetched now go back in the queue for a later batch
+        std::vector<EnrichmentQueue::Candidate> deferred;
+        for (size_t i = 0; i < batch.size(); ++i) {
+            const EnrichmentQueue::Candidate& candidate = batch[i];
+            CircuitBreaker& breaker = GetCircuitBreaker(candidate.store);
+            CircuitBreaker::Admission admission = breaker.AllowRequest();
+            if (admission == CircuitBreaker::Admission::DENIED) {
+                deferred.push_back(candidate);
+                continue;
+            }
+
+            if (!FetchProduct(candidate.store, candidate.url, true, admission)) {
+                breaker.RecordAbandoned(admission);
+                deferred.insert(deferred.end(), batch.begin() + i, batch.end());
+                break;
+            }
+        }
+
+        enrichment.Return(deferred);
+    }
+}
+
+void App::RunSnapshots(std::stop_token stop)
+{
+    std::mutex mutex;
+    std::condition_variable_any wakeup;
+
+    for (unsigned increments = 0; !stop.stop_requested();) {
+        {
+            std::unique_lock lock { mutex };
+            wakeup.wait_for(lock, stop, config.snapshot_interval, [] { return false; });
+        }
+
+        if (stop.stop_requested())
+            return;
+
+        if (increments < config.increments_per_full_snapshot) {
+            snapshots.WriteIncremental();
+            ++increments;
+        } else {
+            snapshots.WriteFull();
+            increments = 0;
+        }
+    }
 }
 
 tb::error<bux::ConnectError> App::BuxConnect()
@@ -1,15 +1,22 @@
 #pragma once
 
+#include <atomic>
 #include <optional>
 #include <string>
 #include <string_view>
 #include <memory>
+#include <thread>
 
 #include <curl/curl.h>
 
+#include "common/catalog.hpp"
 #include "common/product.hpp"
+#include "common/snapshot.hpp"
+#include "webscraper/circuitbreaker.hpp"
 #include "webscraper/stores.hpp"
 #include "webscraper/curldriver.hpp"
+#include "webscraper/enrichment.hpp"
+#include "webscraper/plan.hpp"
 #include "webscraper/task.hpp"
 
 #include <buxtehude/buxtehude.hpp>
@@ -19,6 +26,10 @@
 
 constexpr std::string_view FITSCH_VERSION = "0.0.1";
 constexpr std::chrono::seconds DEFAULT_ENTRY_EXPIRY_TIME = std::chrono::hours { 48 };
+// Time reserved out of a query's deadline for parsing results and replying
+constexpr std::chrono::milliseconds DEFAULT_DEADLINE_MARGIN { 250 };
+constexpr std::chrono::seconds DEFAULT_SNAPSHOT_INTERVAL = std::chrono::minutes { 5 };
+constexpr unsigned DEFAULT_INCREMENTS_PER_FULL_SNAPSHOT = 12;
 
 namespace bux = buxtehude;
 
@@ -28,8 +39,27 @@ struct AppConfig
     std::string curl_useragent = "Mozilla/5.0";
     std::string bux_path_or_hostname = "localhost";
     std::chrono::seconds entry_expiry_time = DEFAULT_ENTRY_EXPIRY_TIME;
+    std::chrono::milliseconds deadline_margin = DEFAULT_DEADLINE_MARGIN;
     bux::ConnectionType bux_conn_type = bux::ConnectionType::INTERNET;
     unsigned max_concurrent_transfers = 32;
+    ParserBackend parser_backend = ParserBackend::DOM;
+    // Build DOMs in per-thread parse arenas instead of pooled heap documents
+    bool lexbor_parse_arena = false;
+    // Spec file of declarative extraction plans, see docs/plans.md
+    std::string extraction_plans_path;
+    // Fetch detail pages of products seen in search results in the background
+    bool enrichment = true;
+    // Look up details fetched earlier for the listings of each search before storing
+    // them, at the cost of a database round trip per search
+    bool carry_over_details = true;
+    // Products held by the catalog answering catalog-query messages
+    size_t catalog_capacity = DEFAULT_CATALOG_CAPACITY;
+    // Write snapshots of the databases for the terminal to restore on startup, to
+    // GetSnapshotDirectory(). See common/snapshot.hpp.
+    bool snapshots = true;
+    std::chrono::seconds snapshot_interval = DEFAULT_SNAPSHOT_INTERVAL;
+    unsigned increments_per_full_snapshot = DEFAULT_INCREMENTS_PER_FULL_SNAPSHOT;
+    std::vector<ProxyConfig> proxies;
     uint16_t bux_port = bux::DEFAULT_PORT;
 
     static std::optional<AppConfig> FromJSONFile(std::string_view path);
@@ -43,6 +73,14 @@ public:
 
     void AddStore(const Store* store);
     const Store* GetStore(StoreID id);
+    CircuitBreaker& GetCircuitBreaker(StoreID id);
+
+    // (Re)compiles the plans in config.extraction_plans_path and swaps them in.
+    // Stores missing from the spec go back to their hand-written parsers; stores
+    // whose spec fails to compile keep their current plan.
+    void LoadPlans();
+    // Null if the store has no plan
+    std::shared_ptr<const ExtractionPlan> GetPlan(StoreID id);
 
     void GetProductAtURL(StoreID store, std::string_view item_url);
 
@@ -50,12 +88,29 @@ public:
     CURLDriver curl_driver;
     bux::Client bclient;
     AppConfig config;
+    EnrichmentQueue enrichment;
+    // The products seen most recently
+    Catalog catalog { config.catalog_capacity };
     dflat::Handle db_handle { bclient };
+    // Every value put into db_handle
+    SnapshotWriter snapshots { GetSnapshotDirectory() };
     std::mutex client_mutex;
 
 private:
     void RetryConnection();
+    void RunEnrichment(std::stop_token stop);
+    void RunSnapshots(std::stop_token stop);
+    // Enrichment fetches run at background priority and give up, returning false,
+    // if no task group is free; other fetches wait for one. An enrichment fetch
+    // reports its outcome to the store's breaker under `admission`.
+    bool FetchProduct(StoreID store_id, std::string_view item_url, bool enrich,
+        CircuitBreaker::Admission admission = CircuitBreaker::Admission::ALLOWED);
     tb::error<bux::ConnectError> BuxConnect();
 
     std::unordered_map<StoreID, const Store*> stores;
+    std::unordered_map<StoreID, CircuitBreaker> circuit_breakers;
+    std::unordered_map<StoreID, std::atomic<std::shared_ptr<const ExtractionPlan>>> plans;
+
+    std::jthread enrichment_thread;
+    std::jthread snapshot_thread;
 };
@@ -0,0 +1,66 @@
+#include "webscraper/circuitbreaker.hpp"
+
+auto CircuitBreaker::AllowRequest() -> Admission
+{
+    std::scoped_lock guard(mutex);
+
+    switch (state) {
+    case State::CLOSED:
+        return Admission::ALLOWED;
+    case State::OPEN:
+        if (PreciseNow() - opened_at < OPEN_DURATION)
+            return Admission::DENIED;
+        state = State::HALF_OPEN;
+        [[fallthrough]];
+    case State::HALF_OPEN:
+        if (probe_in_flight)
+            return Admission::DENIED;
+        probe_in_flight = true;
+        return Admission::PROBE;
+    default:
+        tb::declare_unreachable();
+    }
+}
+
+void CircuitBreaker::RecordSuccess(Admission admission)
+{
+    std::scoped_lock guard(mutex);
+
+    if (admission == Admission::PROBE) {
+        probe_in_flight = false;
+        state = State::CLOSED;
+    } else if (state != State::CLOSED) {
+        return;
+    }
+
+    consecutive_failures = 0;
+}
+
+void CircuitBreaker::RecordFailure(Admission admission)
+{
+    std::scoped_lock guard(mutex);
+
+    if (admission == Admission::PROBE) {
+        probe_in_flight = false;
+    } else if (state != State::CLOSED
+               || ++consecutive_failures < FAILURE_THRESHOLD) {
+        return;
+    }
+
+    state = State::OPEN;
+    opened_at = PreciseNow();
+}
+
+void CircuitBreaker::RecordAbandoned(Admission admission)
+{
+    std::scoped_lock guard(mutex);
+
+    if (admission == Admission::PROBE)
+        probe_in_flight = false;
+}
+
+auto CircuitBreaker::GetState() -> State
+{
+    std::scoped_lock guard(mutex);
+    return state;
+}
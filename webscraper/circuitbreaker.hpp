@@ -0,0 +1,39 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+
+#include "common/util.hpp"
+
+// Tracks the health of one store. After FAILURE_THRESHOLD consecutive failed
+// fetches the breaker opens and live fetches are skipped for OPEN_DURATION. It then
+// half-opens, letting a single probe fetch through: success closes the breaker,
+// failure reopens it. Outcomes of fetches admitted before the breaker opened do not
+// decide it once it has.
+class CircuitBreaker
+{
+public:
+    enum class State { CLOSED, OPEN, HALF_OPEN };
+    enum class Admission { DENIED, ALLOWED, PROBE };
+
+    constexpr static unsigned FAILURE_THRESHOLD = 5;
+    constexpr static std::chrono::seconds OPEN_DURATION { 30 };
+
+    // Returns DENIED if a live fetch should not be attempted. PROBE reserves the
+    // half-open probe - its outcome must be recorded.
+    Admission AllowRequest();
+    void RecordSuccess(Admission admission);
+    void RecordFailure(Admission admission);
+    // For a fetch that never reached the store, e.g. because its deadline passed
+    // first. Frees the probe without deciding the breaker.
+    void RecordAbandoned(Admission admission);
+
+    State GetState();
+
+private:
+    std::mutex mutex;
+    PreciseTimePoint opened_at {};
+    unsigned consecutive_failures = 0;
+    State state = State::CLOSED;
+    bool probe_in_flight = false;
+};
@@ -3,6 +3,8 @@
 #include <event2/thread.h>
 #include <sys/time.h>
 
+#include <utility>
+
 #include "common/util.hpp"
 
 // Libevent callbacks
@@ -37,6 +39,14 @@ static void Libevent_InterruptCallback(int fd, short what, void* general_ctx)
     event_base_loopbreak(ctx->ebase);
 }
 
+static void Libevent_QueueCallback(int fd, short what, void* general_ctx)
+{
+    auto* ctx = static_cast<GeneralCURLContext*>(general_ctx);
+
+    ctx->check_queue = true;
+    event_base_loopbreak(ctx->ebase);
+}
+
 static void Libevent_AddTransferCallback(int fd, short what, void* handle_pair)
 {
     auto* ctx = static_cast<std::pair<CURL*, EasyHandleInfo>*>(handle_pair);
@@ -104,6 +114,42 @@ static int CURL_TimerInfoCallback(CURLM* multi_handle, long timeout, void* gener
     return 0;
 }
 
+// ConcurrencyWindow
+
+void ConcurrencyWindow::OnCompletion(double latency_ms)
+{
+    if (baseline_latency_ms == 0) {
+        baseline_latency_ms = smoothed_latency_ms = latency_ms;
+    } else {
+        smoothed_latency_ms += (latency_ms - smoothed_latency_ms) * LATENCY_SMOOTHING;
+        // The baseline follows the fastest transfers seen, drifting slowly upwards so
+        // that it adapts when a store becomes permanently slower
+        baseline_latency_ms = std::min(latency_ms,
+            baseline_latency_ms + (latency_ms - baseline_latency_ms) * BASELINE_DRIFT);
+    }
+
+    if (smoothed_latency_ms > baseline_latency_ms * LATENCY_SPIKE_FACTOR) {
+        OnCongestion();
+        return;
+    }
+
+    // Grows by roughly one transfer for every window's worth of completions
+    window = std::min(window + 1 / window, maximum);
+}
+
+void ConcurrencyWindow::OnCongestion()
+{
+    // Only shrink once per round trip - transfers that were in flight when congestion
+    // was first observed are likely to report it too
+    auto now = PreciseNow();
+    if (now - last_decrease < std::chrono::milliseconds {
+            static_cast<long>(smoothed_latency_ms) })
+        return;
+
+    last_decrease = now;
+    window = std::max(window * DECREASE_FACTOR, MINIMUM);
+}
+
 CURLHeaders::~CURLHeaders()
 {
     if (header_list) curl_slist_free_all(header_list);
@@ -125,14 +171,22 @@ CURLHeaders::CURLHeaders(std::span<std::string_view> headers)
 
 // CURLDriver
 
-void CURLDriver::Init(unsigned pool_size, std::string_view user_agent)
+void CURLDriver::Init(unsigned pool_size, std::string_view user_agent,
+    std::span<const ProxyConfig> proxy_configs)
 {
+    for (const ProxyConfig& config : proxy_configs) {
+        proxies.push_back({ .url = config.url, .max_concurrent = config.max_concurrent });
+    }
+
     general_context.ebase = event_base_new();
     general_context.multi_handle = curl_multi_init();
     interrupt_event = event_new(general_context.ebase, -1, 0,
         Libevent_InterruptCallback, &general_context);
+    queue_event = event_new(general_context.ebase, -1, 0,
+        Libevent_QueueCallback, &general_context);
 
-    if (!general_context.ebase || !general_context.multi_handle || !interrupt_event) {
+    if (!general_context.ebase || !general_context.multi_handle || !interrupt_event
+        || !queue_event) {
         Abort_AllocFailed();
     }
 
@@ -144,6 +198,11 @@ void CURLDriver::Init(unsigned pool_size, std::string_view user_agent)
     curl_multi_setopt(multi_handle, CURLMOPT_SOCKETDATA, &general_context);
     curl_multi_setopt(multi_handle, CURLMOPT_TIMERDATA, &general_context);
 
+    // Connections are cached per proxy, so room is made for a full set of
+    // connections through each one
+    curl_multi_setopt(multi_handle, CURLMOPT_MAXCONNECTS,
+        static_cast<long>(pool_size * std::max<size_t>(proxies.size(), 1)));
+
     for (unsigned i = 0; i < pool_size; ++i) {
         easy_handles.emplace(curl_easy_init(), EasyHandleInfo {
             .multi_handle = multi_handle
@@ -162,6 +221,8 @@ void CURLDriver::Init(unsigned pool_size, std::string_view user_agent)
         curl_easy_setopt(easy_handle, CURLOPT_WRITEFUNCTION, CURL_WriteData);
         curl_easy_setopt(easy_handle, CURLOPT_WRITEDATA, &info.buffer);
         curl_easy_setopt(easy_handle, CURLOPT_USERAGENT, user_agent.data());
+        curl_easy_setopt(easy_handle, CURLOPT_LOW_SPEED_LIMIT, LOW_SPEED_LIMIT);
+        curl_easy_setopt(easy_handle, CURLOPT_LOW_SPEED_TIME, LOW_SPEED_TIME);
     }
 
     thread = std::thread(&CURLDriver::Drive, this);
@@ -174,6 +235,7 @@ CURLDriver::~CURLDriver()
     if (thread.joinable()) thread.join();
 
     event_free(interrupt_event);
+    event_free(queue_event);
 
     for (auto& [handle, info] : easy_handles) {
         curl_multi_remove_handle(general_context.multi_handle, handle);
@@ -206,20 +268,54 @@ void CURLDriver::GlobalCleanup()
     curl_global_cleanup();
 }
 
-void CURLDriver::PerformTransfer_NoLock(std::string_view url, TransferDoneCallback&& cb,
+static bool DeadlinePassed(const CURLOptions& options)
+{
+    return options.deadline != NO_DEADLINE && PreciseNow() >= options.deadline;
+}
+
+// Invokes the callback with TRANSFER_EXPIRED if the deadline has passed. Only called on
+// the driver thread.
+static bool CheckDeadline(std::string_view url, TransferDoneCallback& cb,
     const CURLOptions& options)
 {
-    auto iter = std::ranges::find_if(easy_handles, [] (auto& pair) {
-        return std::get<EasyHandleInfo>(pair).available;
-    });
+    if (!DeadlinePassed(options))
+        return true;
 
-    if (iter == easy_handles.end()) {
-        pending.emplace(std::string(url), std::forward<TransferDoneCallback>(cb),
+    Log(LogLevel::DEBUG, "Deadline passed before transfer started: {}", url);
+    if (cb) cb({}, url, TRANSFER_EXPIRED);
+    return false;
+}
+
+void CURLDriver::PerformTransfer_NoLock(std::string_view url, TransferDoneCallback&& cb,
+    const CURLOptions& options)
+{
+    // An expired request is queued and dropped by the driver thread, rather than having
+    // its callback run here on the caller's thread with container_mutex held
+    bool expired = DeadlinePassed(options);
+
+    auto iter = FindAvailableHandle();
+    std::optional<size_t> proxy;
+    if (expired || iter == easy_handles.end() || !PriorityAllows(options)
+        || !WindowHasCapacity(options) || !(proxy = SelectProxy(options))) {
+        pending.emplace_back(std::string(url), std::forward<TransferDoneCallback>(cb),
             options);
+        if (expired) event_active(queue_event, 0, 0);
         return;
     }
 
-    auto& [easy_handle, handle_info] = *iter;
+    StartTransfer(*iter, url, std::forward<TransferDoneCallback>(cb), options,
+        proxy.value());
+}
+
+void CURLDriver::StartTransfer(std::pair<CURL* const, EasyHandleInfo>& handle,
+    std::string_view url, TransferDoneCallback&& cb, const CURLOptions& options,
+    size_t proxy)
+{
+    auto& [easy_handle, handle_info] = handle;
+
+    long timeout_ms = 0;
+    if (options.deadline != NO_DEADLINE)
+        timeout_ms = std::max((options.deadline - PreciseNow()).count(), 1l);
 
     switch (options.method) {
     case CURLOptions::Method::GET:
@@ -233,9 +329,22 @@ void CURLDriver::PerformTransfer_NoLock(std::string_view url, TransferDoneCallba
     }
 
     curl_easy_setopt(easy_handle, CURLOPT_URL, url.data());
+    curl_easy_setopt(easy_handle, CURLOPT_TIMEOUT_MS, timeout_ms);
     if (options.headers->header_list)
         curl_easy_setopt(easy_handle, CURLOPT_HTTPHEADER, options.headers->header_list);
 
+    // An empty proxy string overrides any proxy set in the environment
+    if (proxy == DIRECT_CONNECTION) {
+        curl_easy_setopt(easy_handle, CURLOPT_PROXY, "");
+    } else {
+        curl_easy_setopt(easy_handle, CURLOPT_PROXY, proxies[proxy].url.c_str());
+        ++proxies[proxy].in_flight;
+    }
+
+    if (options.store)
+        ++GetWindow(options.store.value()).in_flight;
+
+    handle_info.proxy = proxy;
     handle_info.callback = std::move(cb);
     handle_info.available = false;
     handle_info.buffer.clear();
@@ -248,12 +357,209 @@ void CURLDriver::PerformTransfer_NoLock(std::string_view url, TransferDoneCallba
 
 void CURLDriver::PerformNextInQueue()
 {
-    if (pending.empty()) return;
+    // Requests for stores whose window is full are skipped over, and expired
+    // requests are dropped without occupying a handle
+    for (auto request = pending.begin(); request != pending.end();) {
+        if (!CheckDeadline(request->url, request->callback, request->options)) {
+            request = pending.erase(request);
+            continue;
+        }
+
+        // Without a free handle, the rest are only checked for expiry
+        auto handle = FindAvailableHandle();
+        std::optional<size_t> proxy;
+        if (handle == easy_handles.end() || !PriorityAllows(request->options)
+            || !WindowHasCapacity(request->options)
+            || !(proxy = SelectProxy(request->options))) {
+            ++request;
+            continue;
+        }
+
+        StartTransfer(*handle, request->url, std::move(request->callback),
+            request->options, proxy.value());
+        request = pending.erase(request);
+    }
+}
+
+auto CURLDriver::FindAvailableHandle() -> decltype(easy_handles)::iterator
+{
+    return std::ranges::find_if(easy_handles, [] (auto& pair) {
+        return std::get<EasyHandleInfo>(pair).available;
+    });
+}
+
+ConcurrencyWindow& CURLDriver::GetWindow(StoreID store)
+{
+    auto [iter, _] = windows.try_emplace(store, ConcurrencyWindow {
+        .maximum = static_cast<double>(easy_handles.size())
+    });
+    return iter->second;
+}
+
+bool CURLDriver::PriorityAllows(const CURLOptions& options)
+{
+    if (options.priority == CURLOptions::Priority::NORMAL) return true;
+
+    bool normal_waiting = std::ranges::any_of(pending, [] (const TransferRequest& r) {
+        return r.options.priority == CURLOptions::Priority::NORMAL;
+    });
+    if (normal_waiting) return false;
 
-    TransferRequest& request = pending.front();
-    PerformTransfer_NoLock(request.url,
-        std::forward<TransferDoneCallback>(request.callback));
-    pending.pop();
+    size_t available = std::ranges::count_if(easy_handles, [] (auto& pair) {
+        return std::get<EasyHandleInfo>(pair).available;
+    });
+
+    return available > easy_handles.size() * CURLOptions::BACKGROUND_RESERVE;
+}
+
+bool CURLDriver::WindowHasCapacity(const CURLOptions& options)
+{
+    if (!options.store) return true;
+    return GetWindow(options.store.value()).HasCapacity();
+}
+
+void CURLDriver::UpdateWindow(CURL* easy_handle, const CURLOptions& options,
+    CURLcode result)
+{
+    if (!options.store) return;
+
+    ConcurrencyWindow& window = GetWindow(options.store.value());
+    --window.in_flight;
+
+    long response_code = 0;
+    curl_off_t total_time_us = 0;
+    curl_easy_getinfo(easy_handle, CURLINFO_RESPONSE_CODE, &response_code);
+    curl_easy_getinfo(easy_handle, CURLINFO_TOTAL_TIME_T, &total_time_us);
+
+    // Timeouts, including low-speed aborts, point at an overloaded store; other
+    // transport errors say nothing about its load and leave the window alone
+    double old_window = window.window;
+    if (result == CURLE_OPERATION_TIMEDOUT
+        || response_code == 429 || response_code >= 500)
+        window.OnCongestion();
+    else if (result == CURLE_OK)
+        window.OnCompletion(total_time_us / 1000.0);
+
+    if (static_cast<unsigned>(old_window) != static_cast<unsigned>(window.window)) {
+        Log(LogLevel::DEBUG, "Concurrency window for store {} now {}",
+            static_cast<int>(options.store.value()),
+            static_cast<unsigned>(window.window));
+    }
+}
+
+auto CURLDriver::SelectProxy(const CURLOptions& options) -> std::optional<size_t>
+{
+    if (proxies.empty())
+        return DIRECT_CONNECTION;
+
+    auto now = PreciseNow();
+
+    auto note_recovery = [this] (size_t proxy) {
+        if (!all_proxies_ejected) return;
+        Log(LogLevel::INFO, "Proxy {} healthy again, no longer connecting directly",
+            proxies[proxy].url);
+        all_proxies_ejected = false;
+    };
+
+    if (options.store) {
+        auto assignment = proxy_assignments.find(options.store.value());
+        if (assignment != proxy_assignments.end()
+            && proxies[assignment->second].IsHealthy(now)) {
+            size_t proxy = assignment->second;
+            note_recovery(proxy);
+            if (!proxies[proxy].HasCapacity())
+                return std::nullopt;
+            return proxy;
+        }
+    }
+
+    // Least loaded healthy proxy, relative to its concurrency cap
+    size_t best = DIRECT_CONNECTION;
+    for (size_t i = 0; i < proxies.size(); ++i) {
+        const Proxy& proxy = proxies[i];
+        if (!proxy.IsHealthy(now))
+            continue;
+
+        if (best == DIRECT_CONNECTION
+            || proxy.in_flight * proxies[best].max_concurrent
+               < proxies[best].in_flight * proxy.max_concurrent)
+            best = i;
+    }
+
+    if (best == DIRECT_CONNECTION) {
+        if (!all_proxies_ejected)
+            Log(LogLevel::WARNING, "All proxies ejected, connecting directly");
+        all_proxies_ejected = true;
+        return DIRECT_CONNECTION;
+    }
+
+    note_recovery(best);
+
+    if (options.store)
+        proxy_assignments[options.store.value()] = best;
+
+    if (!proxies[best].HasCapacity())
+        return std::nullopt;
+
+    return best;
+}
+
+void CURLDriver::UpdateProxyHealth(CURL* easy_handle, size_t index, CURLcode result)
+{
+    if (index == DIRECT_CONNECTION) return;
+
+    Proxy& proxy = proxies[index];
+    --proxy.in_flight;
+
+    long proxy_response_code = 0;
+    curl_easy_getinfo(easy_handle, CURLINFO_HTTP_CONNECTCODE, &proxy_response_code);
+
+    bool proxy_failed = false;
+    switch (result) {
+    case CURLE_COULDNT_RESOLVE_PROXY:
+    case CURLE_COULDNT_CONNECT:
+    case CURLE_PROXY:
+    case CURLE_SEND_ERROR:
+    case CURLE_RECV_ERROR:
+    case CURLE_GOT_NOTHING:
+        proxy_failed = true;
+        break;
+    default:
+        proxy_failed = proxy_response_code >= 400;
+        break;
+    }
+
+    if (!proxy_failed) {
+        proxy.consecutive_failures = 0;
+        return;
+    }
+
+    if (++proxy.consecutive_failures < Proxy::EJECT_THRESHOLD)
+        return;
+
+    Log(LogLevel::WARNING, "Ejecting proxy {} for {} after {} failures", proxy.url,
+        Proxy::EJECT_DURATION, proxy.consecutive_failures);
+
+    proxy.consecutive_failures = 0;
+    proxy.ejected_until = PreciseNow() + Proxy::EJECT_DURATION;
+}
+
+auto CURLDriver::GetConcurrencyStats() -> std::vector<ConcurrencyStats>
+{
+    std::scoped_lock guard(container_mutex);
+
+    std::vector<ConcurrencyStats> stats;
+    stats.reserve(windows.size());
+    for (const auto& [store, window] : windows) {
+        stats.push_back({
+            .store = store,
+            .window = static_cast<unsigned>(window.window),
+            .in_flight = window.in_flight,
+            .latency_ms = window.smoothed_latency_ms
+        });
+    }
+
+    return stats;
 }
 
 void CURLDriver::Drive()
@@ -307,13 +613,28 @@ void CURLDriver::Drive()
             const char* url = nullptr;
             curl_easy_getinfo(message->easy_handle, CURLINFO_EFFECTIVE_URL, &url);
 
+            CURLcode callback_code = error_code;
+            long response_code = 0;
+            curl_easy_getinfo(message->easy_handle, CURLINFO_RESPONSE_CODE,
+                &response_code);
+            if (error_code == CURLE_OK && (response_code < 200 || response_code >= 300)) {
+                Log(LogLevel::WARNING, "HTTP status {} from {}", response_code, url);
+                callback_code = HTTP_ERROR_STATUS;
+            }
+
             if (info.callback)
-                info.callback(info.buffer, url, error_code);
+                info.callback(info.buffer, url, callback_code);
+
+            UpdateWindow(message->easy_handle, info.options, error_code);
+            UpdateProxyHealth(message->easy_handle, info.proxy, error_code);
 
             curl_multi_remove_handle(multi_handle, message->easy_handle);
             info.available = true;
 
             PerformNextInQueue();
         }
+
+        if (std::exchange(general_context.check_queue, false))
+            PerformNextInQueue();
     }
 }
@@ -1,18 +1,22 @@
 #pragma once
 
+#include <deque>
 #include <memory>
 #include <mutex>
-#include <queue>
+#include <optional>
 #include <span>
 #include <string>
 #include <string_view>
 #include <unordered_map>
 #include <thread>
 #include <functional>
+#include <limits>
+#include <vector>
 
 #include <curl/curl.h>
 #include <event2/event.h>
 
+#include "common/product.hpp"
 #include "common/util.hpp"
 
 using TransferDoneCallback
@@ -37,15 +41,101 @@ inline const CURLHeaders CURLHEADERS_ALDI {
     })
 };
 
+// Result passed to the callback of a transfer dropped because its deadline passed
+// before it started, so that no request reached the server. curl never returns it
+// for the transfers driven here, as none of them sets a progress callback.
+constexpr CURLcode TRANSFER_EXPIRED = CURLE_ABORTED_BY_CALLBACK;
+
+// Result passed to the callback of a transfer answered with a status other than 2xx,
+// such as a store's block or error page, so that the page is not taken for results.
+// The driver still reads the status itself to adjust the store's concurrency window.
+constexpr CURLcode HTTP_ERROR_STATUS = CURLE_HTTP_RETURNED_ERROR;
+
+// Transfers slower than LOW_SPEED_LIMIT bytes/s for LOW_SPEED_TIME seconds are aborted
+constexpr long LOW_SPEED_LIMIT = 1024;
+constexpr long LOW_SPEED_TIME = 3;
+
 struct CURLOptions
 {
     enum class Method { GET, POST };
+    enum class Priority { NORMAL, BACKGROUND };
 
     std::string post_content;
     const CURLHeaders* headers = &CURLHEADERS_DEFAULT;
     Method method = Method::GET;
+    // Transfers whose deadline has passed by the time a handle is free are not
+    // started; their callback is invoked with TRANSFER_EXPIRED instead, on the driver
+    // thread like any other completion.
+    Deadline deadline = NO_DEADLINE;
+    // Transfers for a store are subject to that store's concurrency window
+    std::optional<StoreID> store;
+    // Background transfers only start when no normal transfer is waiting, and never
+    // take the last BACKGROUND_RESERVE fraction of free handles
+    Priority priority = Priority::NORMAL;
+
+    constexpr static double BACKGROUND_RESERVE = 0.25;
+};
+
+// Additive-increase/multiplicative-decrease limit on concurrent transfers to one
+// store. Healthy completions grow the window by about one transfer per window's
+// worth of completions, whatever their status code; HTTP 429/5xx responses, timeouts
+// and latency spikes halve it.
+struct ConcurrencyWindow
+{
+    constexpr static double INITIAL = 4;
+    constexpr static double MINIMUM = 1;
+    constexpr static double DECREASE_FACTOR = 0.5;
+    constexpr static double LATENCY_SPIKE_FACTOR = 3;
+    constexpr static double LATENCY_SMOOTHING = 0.125;
+    constexpr static double BASELINE_DRIFT = 0.01;
+
+    double window = INITIAL;
+    double maximum = INITIAL;
+    double smoothed_latency_ms = 0;
+    double baseline_latency_ms = 0;
+    PreciseTimePoint last_decrease {};
+    unsigned in_flight = 0;
+
+    bool HasCapacity() const { return in_flight < static_cast<unsigned>(window); }
+
+    void OnCompletion(double latency_ms);
+    void OnCongestion();
 };
 
+struct ProxyConfig
+{
+    std::string url; // e.g. http://10.0.0.2:3128 or socks5h://127.0.0.1:1080
+    unsigned max_concurrent = 8;
+};
+
+// An outbound proxy. Proxies that fail at the connection level EJECT_THRESHOLD
+// times in a row are ejected from the pool for EJECT_DURATION.
+struct Proxy
+{
+    constexpr static unsigned EJECT_THRESHOLD = 3;
+    constexpr static std::chrono::seconds EJECT_DURATION { 60 };
+
+    std::string url;
+    unsigned max_concurrent;
+    unsigned in_flight = 0;
+    unsigned consecutive_failures = 0;
+    PreciseTimePoint ejected_until {};
+
+    bool IsHealthy(PreciseTimePoint now) const { return now >= ejected_until; }
+    bool HasCapacity() const { return in_flight < max_concurrent; }
+};
+
+struct ConcurrencyStats
+{
+    StoreID store;
+    unsigned window;
+    unsigned in_flight;
+    double latency_ms;
+};
+
+// Index into CURLDriver's proxy pool for transfers that connect directly
+constexpr size_t DIRECT_CONNECTION = std::numeric_limits<size_t>::max();
+
 struct EasyHandleInfo
 {
     std::string buffer;
@@ -53,6 +143,7 @@ struct EasyHandleInfo
     event* add_transfer_event = nullptr;
     CURLM* multi_handle = nullptr;
     CURLOptions options;
+    size_t proxy = DIRECT_CONNECTION;
     bool available = true;
 };
 
@@ -76,32 +167,61 @@ struct GeneralCURLContext
     CURLMcode return_code = CURLM_OK;
     int running_handles = 0;
     bool interrupt = false;
+    // Set when requests were queued that may be dropped or started right away
+    bool check_queue = false;
 };
 
 class CURLDriver
 {
 public:
     CURLDriver() = default;
-    void Init(unsigned pool_size, std::string_view user_agent);
+    // Transfers are spread across `proxies` if any are given. Each store sticks to
+    // one proxy for as long as that proxy stays healthy.
+    void Init(unsigned pool_size, std::string_view user_agent,
+        std::span<const ProxyConfig> proxies = {});
     ~CURLDriver();
 
+    // `callback` is invoked on the driver thread once the transfer completes or expires
     void PerformTransfer(std::string_view url, TransferDoneCallback&& callback,
         const CURLOptions& options = {});
 
+    // Snapshot of the current per-store concurrency windows, for monitoring
+    auto GetConcurrencyStats() -> std::vector<ConcurrencyStats>;
+
     static bool GlobalInit(long flags = CURL_GLOBAL_DEFAULT);
     static void GlobalCleanup();
 private:
     void PerformTransfer_NoLock(std::string_view url, TransferDoneCallback&& callback,
         const CURLOptions& options = {});
+    void StartTransfer(std::pair<CURL* const, EasyHandleInfo>& handle,
+        std::string_view url, TransferDoneCallback&& callback,
+        const CURLOptions& options, size_t proxy);
     void PerformNextInQueue();
     void Drive();
 
     std::unordered_map<CURL*, EasyHandleInfo> easy_handles;
-    std::queue<TransferRequest> pending;
+    std::unordered_map<StoreID, ConcurrencyWindow> windows;
+    std::vector<Proxy> proxies;
+    std::unordered_map<StoreID, size_t> proxy_assignments;
+    // Set while every proxy is ejected, so that the fallback is logged once
+    bool all_proxies_ejected = false;
+    std::deque<TransferRequest> pending;
     std::mutex container_mutex;
 
+    auto FindAvailableHandle() -> decltype(easy_handles)::iterator;
+    ConcurrencyWindow& GetWindow(StoreID store);
+    bool WindowHasCapacity(const CURLOptions& options);
+    bool PriorityAllows(const CURLOptions& options);
+    void UpdateWindow(CURL* easy_handle, const CURLOptions& options, CURLcode result);
+    // Proxy the transfer should use - DIRECT_CONNECTION if no proxies are configured
+    // or all are ejected - or std::nullopt if it must wait for proxy capacity
+    auto SelectProxy(const CURLOptions& options) -> std::optional<size_t>;
+    void UpdateProxyHealth(CURL* easy_handle, size_t proxy, CURLcode result);
+
     std::thread thread;
 
     GeneralCURLContext general_context;
     event* interrupt_event = nullptr;
+    // Wakes the driver thread to run PerformNextInQueue
+    event* queue_event = nullptr;
 };
@@ -0,0 +1,75 @@
+#include "webscraper/enrichment.hpp"
+
+#include <algorithm>
+
+EnrichmentQueue::EnrichmentQueue(std::chrono::seconds r) : retry_after(r) {}
+
+void EnrichmentQueue::Add(ProductKey key, std::string_view url, StoreID store)
+{
+    std::scoped_lock guard(mutex);
+
+    if (auto entry = pending.find(key); entry != pending.end()) {
+        ++entry->second.hits;
+        return;
+    }
+
+    if (auto when = taken.find(key); when != taken.end()) {
+        if (Now() - when->second < retry_after) return;
+        taken.erase(when);
+    }
+
+    if (pending.size() >= MAX_PENDING) return;
+
+    pending.emplace(key, Entry { std::string(url), store, 1 });
+}
+
+auto EnrichmentQueue::TakeBatch(size_t count) -> std::vector<Candidate>
+{
+    std::scoped_lock guard(mutex);
+
+    TimePoint now = Now();
+    std::erase_if(taken, [&] (const auto& pair) {
+        return now - pair.second >= retry_after;
+    });
+
+    std::vector<decltype(pending)::iterator> ranked;
+    ranked.reserve(pending.size());
+    for (auto iter = pending.begin(); iter != pending.end(); ++iter)
+        ranked.push_back(iter);
+
+    count = std::min(count, ranked.size());
+    std::partial_sort(ranked.begin(), ranked.begin() + count, ranked.end(),
+        [] (const auto& a, const auto& b) { return a->second.hits > b->second.hits; });
+
+    std::vector<Candidate> batch;
+    batch.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        auto node = pending.extract(ranked[i]);
+        taken.emplace(node.key(), now);
+        batch.push_back({
+            .key = node.key(),
+            .url = std::move(node.mapped().url),
+            .store = node.mapped().store,
+            .hits = node.mapped().hits
+        });
+    }
+
+    return batch;
+}
+
+void EnrichmentQueue::Return(std::span<const Candidate> candidates)
+{
+    std::scoped_lock guard(mutex);
+
+    for (const Candidate& candidate : candidates) {
+        taken.erase(candidate.key);
+        pending.try_emplace(candidate.key,
+                            Entry { candidate.url, candidate.store, candidate.hits });
+    }
+}
+
+size_t EnrichmentQueue::Size()
+{
+    std::scoped_lock guard(mutex);
+    return pending.size();
+}
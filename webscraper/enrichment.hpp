@@ -0,0 +1,57 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "common/product.hpp"
+#include "common/util.hpp"
+
+// Products seen in search results without full info, waiting for their detail page
+// to be fetched in the background. Repeated sightings of a product are merged and
+// counted, and the most seen products are handed out first. Products handed out are
+// not queued again until `retry_after` has passed, whether or not their fetch
+// succeeded, unless they are returned unfetched.
+class EnrichmentQueue
+{
+public:
+    constexpr static size_t MAX_PENDING = 4096;
+    constexpr static size_t BATCH_SIZE = 8;
+    constexpr static std::chrono::seconds BATCH_INTERVAL { 10 };
+
+    struct Candidate
+    {
+        ProductKey key;
+        std::string url;
+        StoreID store;
+        size_t hits;
+    };
+
+    EnrichmentQueue(std::chrono::seconds retry_after);
+
+    // Ignored if the queue is full or the product was enriched recently
+    void Add(ProductKey key, std::string_view url, StoreID store);
+    // Removes and returns up to `count` of the most seen candidates
+    std::vector<Candidate> TakeBatch(size_t count = BATCH_SIZE);
+    // Puts back candidates that were taken but never fetched
+    void Return(std::span<const Candidate> candidates);
+
+    size_t Size();
+
+private:
+    struct Entry
+    {
+        std::string url;
+        StoreID store;
+        size_t hits;
+    };
+
+    std::mutex mutex;
+    std::chrono::seconds retry_after;
+    std::unordered_map<ProductKey, Entry> pending;
+    std::unordered_map<ProductKey, TimePoint> taken;
+};
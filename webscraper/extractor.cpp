@@ -0,0 +1,107 @@
+#include "webscraper/extractor.hpp"
+
+#include <cctype>
+
+#include "common/util.hpp"
+
+bool ContainsIgnoreCase(std::string_view haystack, std::string_view needle)
+{
+    if (needle.empty()) return true;
+    if (needle.size() > haystack.size()) return false;
+
+    auto equal_ignore_case = [] (char a, char b) {
+        return tolower(static_cast<unsigned char>(a))
+            == tolower(static_cast<unsigned char>(b));
+    };
+
+    for (size_t i = 0; i + needle.size() <= haystack.size(); ++i) {
+        if (!equal_ignore_case(haystack[i], needle[0])) continue;
+        if (std::equal(needle.begin() + 1, needle.end(), haystack.begin() + i + 1,
+            equal_ignore_case))
+            return true;
+    }
+
+    return false;
+}
+
+void Extractor::Run(Element root_element)
+{
+    counts.fill(0);
+    dropped = 0;
+    root = lxb_dom_interface_node(root_element.Data());
+
+    // Pre-order walk of the descendants of root
+    lxb_dom_node_t* node = root->first_child;
+    while (node) {
+        if (node->type == LXB_DOM_NODE_TYPE_ELEMENT)
+            MatchElement(lxb_dom_interface_element(node));
+
+        if (node->first_child) {
+            node = node->first_child;
+            continue;
+        }
+
+        while (node != root && node->next == nullptr)
+            node = node->parent;
+        node = node == root ? nullptr : node->next;
+    }
+
+    if (dropped) {
+        Log(LogLevel::WARNING, "Extractor dropped {} matches over the limit of {} per "
+            "pattern", dropped, MAX_MATCHES);
+    }
+}
+
+size_t Extractor::Count(size_t pattern) const { return counts[pattern]; }
+
+std::optional<Element> Extractor::First(size_t pattern) const
+{
+    if (counts[pattern] == 0) return std::nullopt;
+    return Element { matches[pattern][0] };
+}
+
+Element Extractor::Get(size_t pattern, size_t index) const
+{
+    return matches[pattern][index];
+}
+
+void Extractor::MatchElement(lxb_dom_element_t* element)
+{
+    for (lxb_dom_attr_t* attr = lxb_dom_element_first_attribute(element); attr;
+         attr = lxb_dom_element_next_attribute(attr)) {
+        size_t name_length, value_length;
+        const lxb_char_t* name = lxb_dom_attr_qualified_name(attr, &name_length);
+        const lxb_char_t* value = lxb_dom_attr_value(attr, &value_length);
+        if (!name || !value) continue;
+
+        std::string_view name_view(reinterpret_cast<const char*>(name), name_length);
+        std::string_view value_view(reinterpret_cast<const char*>(value), value_length);
+
+        for (size_t i = 0; i < patterns.size(); ++i) {
+            const AttrPattern& pattern = patterns[i];
+            if (name_view != pattern.attr) continue;
+            // An element with several matching attributes is only recorded once
+            if (counts[i] && matches[i][counts[i] - 1] == element) continue;
+            if (!ContainsIgnoreCase(value_view, pattern.value)) continue;
+            if (!InScope(i, element)) continue;
+
+            if (counts[i] == MAX_MATCHES) ++dropped;
+            else matches[i][counts[i]++] = element;
+        }
+    }
+}
+
+bool Extractor::InScope(size_t pattern, lxb_dom_element_t* element) const
+{
+    size_t scope_pattern = patterns[pattern].within;
+    if (scope_pattern == AttrPattern::NO_SCOPE) return true;
+    if (counts[scope_pattern] == 0) return false;
+
+    lxb_dom_node_t* scope = lxb_dom_interface_node(matches[scope_pattern][0]);
+    for (lxb_dom_node_t* node = lxb_dom_interface_node(element)->parent;
+         node && node != root; node = node->parent) {
+        if (node == scope) return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include <span>
+#include <string_view>
+
+#include "webscraper/html.hpp"
+
+// True for an empty needle, like std::string_view::find
+bool ContainsIgnoreCase(std::string_view haystack, std::string_view needle);
+
+// Attribute pattern for Extractor. An element matches if it has attribute `attr`
+// whose value contains `value`, ignoring case - the same test as HTML::SearchAttr
+// with broad=true.
+struct AttrPattern
+{
+    std::string_view attr, value;
+    // If not NO_SCOPE, only descendants of the first element matched by the pattern
+    // at this index can match
+    size_t within = NO_SCOPE;
+
+    constexpr static size_t NO_SCOPE = static_cast<size_t>(-1);
+};
+
+// Matches a set of attribute patterns against every element of a subtree in a single
+// walk, in place of one HTML::SearchAttr/SearchClass scan per pattern. Matches are
+// recorded in document order, up to MAX_MATCHES per pattern; a run that drops any
+// beyond that logs how many.
+class Extractor
+{
+public:
+    constexpr static size_t MAX_PATTERNS = 16;
+    constexpr static size_t MAX_MATCHES = 8;
+
+    template<size_t N>
+    Extractor(const std::array<AttrPattern, N>& p) : patterns(p)
+    {
+        static_assert(N <= MAX_PATTERNS, "Too many extractor patterns");
+    }
+
+    // Matches the descendants of `root`, discarding the results of the previous run
+    void Run(Element root);
+
+    size_t Count(size_t pattern) const;
+    std::optional<Element> First(size_t pattern) const;
+    Element Get(size_t pattern, size_t index) const;
+
+private:
+    void MatchElement(lxb_dom_element_t* element);
+    bool InScope(size_t pattern, lxb_dom_element_t* element) const;
+
+    std::span<const AttrPattern> patterns;
+    lxb_dom_node_t* root = nullptr;
+    std::array<std::array<lxb_dom_element_t*, MAX_MATCHES>, MAX_PATTERNS> matches {};
+    std::array<size_t, MAX_PATTERNS> counts {};
+    size_t dropped = 0;
+};
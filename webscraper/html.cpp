@@ -1,6 +1,190 @@
 #include "webscraper/html.hpp"
 
+#include <algorithm>
+#include <vector>
+
 #include "common/util.hpp"
+#include "webscraper/parsearena.hpp"
+
+// Selector
+
+Selector::Selector(std::string_view selector)
+{
+    parser = lxb_css_parser_create();
+    if (!parser || lxb_css_parser_init(parser, nullptr) != LXB_STATUS_OK)
+        Abort_AllocFailed();
+
+    list = lxb_css_selectors_parse(parser,
+        reinterpret_cast<const lxb_char_t*>(selector.data()), selector.size());
+
+    if (!list || parser->status != LXB_STATUS_OK) {
+        Log(LogLevel::SEVERE, "Invalid CSS selector '{}'", selector);
+        throw std::invalid_argument { "Invalid CSS selector" };
+    }
+}
+
+Selector::~Selector()
+{
+    lxb_css_selector_list_destroy_memory(list);
+    lxb_css_parser_destroy(parser, true);
+}
+
+lxb_css_selector_list_t* Selector::Data() const { return list; }
+
+lxb_selectors_t* ThreadSelectorsEngine()
+{
+    struct Engine
+    {
+        lxb_selectors_t* ptr = lxb_selectors_create();
+
+        Engine()
+        {
+            if (!ptr || lxb_selectors_init(ptr) != LXB_STATUS_OK)
+                Abort_AllocFailed();
+            // Report each element once, even if several selectors in a list match
+            lxb_selectors_opt_set(ptr, LXB_SELECTORS_OPT_MATCH_FIRST);
+        }
+
+        ~Engine() { lxb_selectors_destroy(ptr, true); }
+    };
+
+    thread_local Engine engine;
+    return engine.ptr;
+}
+
+// Region prefiltering
+
+std::optional<std::string_view> FindRegion(std::string_view data,
+    const RegionMarkers& markers)
+{
+    // string_view::find scans with memchr for the first character of the needle
+    size_t body = data.find("<body");
+    size_t search_start = body == std::string_view::npos ? 0 : body;
+
+    size_t first = data.find(markers.begin, search_start);
+    if (first == std::string_view::npos) return {};
+
+    size_t last = data.rfind(markers.begin);
+
+    // The marker usually sits inside an attribute, so start at the enclosing tag
+    size_t begin = data.rfind('<', first);
+    if (begin == std::string_view::npos || begin < search_start) begin = first;
+
+    size_t end = data.size();
+    for (std::string_view end_marker : markers.end)
+        end = std::min(end, data.find(end_marker, last));
+
+    return data.substr(begin, end - begin);
+}
+
+// Pools
+
+namespace {
+
+size_t RetainedBytes(const lexbor_mraw_t* mraw)
+{
+    size_t total = 0;
+    for (const lexbor_mem_chunk_t* chunk = mraw->mem->chunk_first; chunk;
+         chunk = chunk->next)
+        total += chunk->size;
+
+    return total;
+}
+
+struct HTMLPool
+{
+    std::vector<lxb_html_document_t*> documents;
+    std::vector<lxb_dom_collection_t*> collections;
+    HTMLPoolStats stats;
+
+    HTMLPool()
+    {
+        documents.reserve(MAX_POOLED_DOCUMENTS);
+        collections.reserve(MAX_POOLED_COLLECTIONS);
+    }
+
+    ~HTMLPool()
+    {
+        for (lxb_dom_collection_t* col : collections)
+            lxb_dom_collection_destroy(col, true);
+        for (lxb_html_document_t* dom : documents)
+            lxb_html_document_destroy(dom);
+    }
+};
+
+thread_local HTMLPool pool;
+
+} // namespace
+
+lxb_html_document_t* AcquireDocument()
+{
+    if (!pool.documents.empty()) {
+        lxb_html_document_t* dom = pool.documents.back();
+        pool.documents.pop_back();
+        ++pool.stats.documents_reused;
+        return dom;
+    }
+
+    lxb_html_document_t* dom = lxb_html_document_create();
+    if (!dom) Abort_AllocFailed();
+    ++pool.stats.documents_created;
+
+    return dom;
+}
+
+void ReleaseDocument(lxb_html_document_t* dom)
+{
+    if (!dom) return;
+
+    if (pool.documents.size() >= MAX_POOLED_DOCUMENTS) {
+        lxb_html_document_destroy(dom);
+        return;
+    }
+
+    // Cleaning frees all but the first chunk of each arena, so what remains is
+    // roughly the document's baseline footprint unless one allocation was huge
+    lxb_html_document_clean(dom);
+
+    const lxb_dom_document_t& doc = dom->dom_document;
+    if (RetainedBytes(doc.mraw) + RetainedBytes(doc.text) > MAX_POOLED_DOCUMENT_BYTES) {
+        lxb_html_document_destroy(dom);
+        return;
+    }
+
+    pool.documents.push_back(dom);
+}
+
+lxb_dom_collection_t* AcquireCollection(lxb_html_document_t* dom, size_t capacity)
+{
+    if (!pool.collections.empty()) {
+        lxb_dom_collection_t* col = pool.collections.back();
+        pool.collections.pop_back();
+        col->document = &dom->dom_document;
+        ++pool.stats.collections_reused;
+        return col;
+    }
+
+    lxb_dom_collection_t* col = lxb_dom_collection_make(&dom->dom_document, capacity);
+    if (!col) Abort_AllocFailed();
+    ++pool.stats.collections_created;
+
+    return col;
+}
+
+void ReleaseCollection(lxb_dom_collection_t* col)
+{
+    if (pool.collections.size() >= MAX_POOLED_COLLECTIONS
+        || col->array.size > MAX_POOLED_COLLECTION_CAPACITY) {
+        lxb_dom_collection_destroy(col, true);
+        return;
+    }
+
+    lxb_dom_collection_clean(col);
+    col->document = nullptr;
+    pool.collections.push_back(col);
+}
+
+HTMLPoolStats GetThreadHTMLPoolStats() { return pool.stats; }
 
 // Node
 
@@ -50,12 +234,37 @@ Node Element::FirstChild() const
 
 lxb_dom_element_t* Element::Data() const { return ptr; }
 
+std::optional<Element> Element::SelectFirst(const Selector& selector) const
+{
+    std::optional<Element> result;
+    ForEach(selector, [&result] (Element e) {
+        result = e;
+        return false;
+    });
+
+    return result;
+}
+
 // HTML
 
+// Arena-backed documents alive on this thread; the arena is reset when none are left
+static thread_local size_t arena_documents = 0;
+
 HTML::HTML()
 {
+    if (!ParseArenasEnabled()) {
+        dom = AcquireDocument();
+        return;
+    }
+
+    // Arena-backed documents are never pooled: anything they allocate during the
+    // parse is gone once the arena resets
+    ParseArenaScope scope;
     dom = lxb_html_document_create();
     if (!dom) Abort_AllocFailed();
+
+    arena_backed = true;
+    ++arena_documents;
 }
 
 std::optional<HTML> HTML::FromString(std::string_view data)
@@ -68,10 +277,26 @@ std::optional<HTML> HTML::FromString(std::string_view data)
     return {};
 }
 
-HTML::~HTML() { lxb_html_document_destroy(dom); }
+HTML::~HTML()
+{
+    if (!arena_backed) {
+        ReleaseDocument(dom);
+        return;
+    }
+
+    // Freeing arena memory is a no-op, so this only releases what lexbor allocated
+    // on the heap after parsing, e.g. for text content
+    lxb_html_document_destroy(dom);
+
+    if (--arena_documents == 0)
+        ThreadParseArena().Reset();
+}
 
 [[nodiscard]] bool HTML::Parse(std::string_view data)
 {
+    std::optional<ParseArenaScope> scope;
+    if (arena_backed) scope.emplace();
+
     return lxb_html_document_parse(dom,
         reinterpret_cast<const lxb_char_t*>(data.data()), data.size()) == LXB_STATUS_OK;
 }
@@ -139,6 +364,32 @@ void HTML::SearchClass(Collection<Element>& col, std::string_view name,
     _SearchAttr(col.Data(), "class", name, root, broad);
 }
 
+Collection<Element> HTML::Select(const Selector& selector, Element root) const
+{
+    Collection<Element> col(dom, 16);
+    Select(col, selector, root);
+
+    return col;
+}
+
+void HTML::Select(Collection<Element>& col, const Selector& selector,
+    Element root) const
+{
+    if (!col.Data()) col = Collection<Element>(dom, 16);
+    lxb_dom_collection_clean(col.Data());
+
+    ForEach(selector, [&col] (Element e) {
+        if (lxb_dom_collection_append(col.Data(), e.Data()) != LXB_STATUS_OK)
+            Abort_AllocFailed();
+        return true;
+    }, root);
+}
+
+std::optional<Element> HTML::SelectFirst(const Selector& selector, Element root) const
+{
+    return Element { Resolve(root) }.SelectFirst(selector);
+}
+
 lxb_dom_element_t* HTML::Resolve(Element e) const
 {
     switch (e.dom_tag) {
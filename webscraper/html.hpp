@@ -1,11 +1,17 @@
 #pragma once
 
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
 #include <string>
 #include <type_traits>
 #include <utility>
 
 #include <lexbor/html/parser.h>
 #include <lexbor/dom/interfaces/element.h>
+#include <lexbor/css/css.h>
+#include <lexbor/selectors/selectors.h>
 
 #include "common/util.hpp"
 
@@ -15,6 +21,30 @@ concept CollectionCompatible = requires(T t, lxb_dom_collection_t* col, size_t i
     { T::collection_access(col, index) } -> std::same_as<decltype(t.Data())>;
 };
 
+// Precompiled CSS selector list, e.g. `[class*="ColListing" i]`. Compiled
+// selectors are immutable, so one instance can be shared between documents and
+// threads; matching uses a lexbor selectors engine private to each thread.
+class Selector
+{
+public:
+    Selector(std::string_view selector);
+    ~Selector();
+
+    Selector(const Selector& other) = delete;
+    Selector& operator=(const Selector& other) = delete;
+
+    lxb_css_selector_list_t* Data() const;
+private:
+    lxb_css_parser_t* parser = nullptr;
+    lxb_css_selector_list_t* list = nullptr;
+};
+
+// Runs `selector` over the descendants of `root`, calling `callback` for each match
+// in document order until it returns false. Nothing is allocated per call.
+template<typename Callable>
+void SelectorForEach(const Selector& selector, lxb_dom_element_t* root,
+    Callable&& callback);
+
 // Non-owning node wrapper
 class Node
 {
@@ -50,6 +80,14 @@ public:
 
     Node FirstChild() const;
 
+    template<typename Callable>
+    void ForEach(const Selector& selector, Callable&& callback) const
+    {
+        SelectorForEach(selector, ptr, std::forward<Callable>(callback));
+    }
+
+    std::optional<Element> SelectFirst(const Selector& selector) const;
+
     template<typename Callable>
     Node FindChildIf(Callable&& predicate) const
     {
@@ -71,6 +109,41 @@ private:
     };
 };
 
+// Markers delimiting the part of a page worth building a DOM for
+struct RegionMarkers
+{
+    std::string_view begin;
+    std::span<const std::string_view> end;
+};
+
+// Returns the slice of `data` starting at the tag containing the first occurrence of
+// `markers.begin` inside <body>, and ending at the first end marker following its
+// last occurrence (or the end of the page). Returns nullopt if the marker is absent.
+std::optional<std::string_view> FindRegion(std::string_view data,
+                                           const RegionMarkers& markers);
+
+// Per-thread pools of cleaned lexbor documents and collections, reused between
+// parses instead of being created and destroyed for every page
+struct HTMLPoolStats
+{
+    size_t documents_created = 0, documents_reused = 0;
+    size_t collections_created = 0, collections_reused = 0;
+};
+
+constexpr size_t MAX_POOLED_DOCUMENTS = 4;
+constexpr size_t MAX_POOLED_COLLECTIONS = 32;
+// Documents retaining more than this after cleaning are destroyed, not pooled
+constexpr size_t MAX_POOLED_DOCUMENT_BYTES = 4 * 1024 * 1024;
+constexpr size_t MAX_POOLED_COLLECTION_CAPACITY = 1024;
+
+lxb_html_document_t* AcquireDocument();
+void ReleaseDocument(lxb_html_document_t* dom);
+
+lxb_dom_collection_t* AcquireCollection(lxb_html_document_t* dom, size_t capacity);
+void ReleaseCollection(lxb_dom_collection_t* col);
+
+HTMLPoolStats GetThreadHTMLPoolStats();
+
 // Owning collection wrapper
 template<CollectionCompatible T>
 class Collection
@@ -93,15 +166,13 @@ public:
     Collection(lxb_dom_collection_t* collection) : ptr(collection) {}
 
     Collection(lxb_html_document_t* dom, size_t capacity)
-    {
-        ptr = lxb_dom_collection_make(&dom->dom_document, capacity);
-        if (!ptr) Abort_AllocFailed();
-    }
+        : ptr(AcquireCollection(dom, capacity)) {}
 
     Collection(Collection&& other) : ptr(std::exchange(other.ptr, nullptr)) {}
 
     Collection& operator=(Collection&& other)
     {
+        if (ptr) ReleaseCollection(ptr);
         ptr = std::exchange(other.ptr, nullptr);
         return *this;
     }
@@ -109,7 +180,7 @@ public:
     Collection(const Collection& other) = delete;
     Collection& operator=(const Collection& other) = delete;
 
-    ~Collection() { if (ptr) lxb_dom_collection_destroy(ptr, true); }
+    ~Collection() { if (ptr) ReleaseCollection(ptr); }
 
     size_t size() const { return lxb_dom_collection_length(ptr); }
     lxb_dom_collection_t* Data() const { return ptr; }
@@ -130,7 +201,9 @@ public:
 
     static std::optional<HTML> FromString(std::string_view data);
 
-    HTML(HTML&& other) : dom(std::exchange(other.dom, nullptr)) {}
+    HTML(HTML&& other)
+        : dom(std::exchange(other.dom, nullptr)),
+          arena_backed(std::exchange(other.arena_backed, false)) {}
 
     HTML(const HTML& other) = delete;
     HTML& operator=(const HTML& other) = delete;
@@ -159,6 +232,21 @@ public:
     void SearchClass(Collection<Element>& col, std::string_view name,
                      Element root={ Element::ROOT }, bool broad=false) const;
 
+    Collection<Element> Select(const Selector& selector,
+                               Element root={ Element::ROOT }) const;
+    void Select(Collection<Element>& col, const Selector& selector,
+                Element root={ Element::ROOT }) const;
+
+    std::optional<Element> SelectFirst(const Selector& selector,
+                                       Element root={ Element::ROOT }) const;
+
+    template<typename Callable>
+    void ForEach(const Selector& selector, Callable&& callback,
+                 Element root={ Element::ROOT }) const
+    {
+        SelectorForEach(selector, Resolve(root), std::forward<Callable>(callback));
+    }
+
 private:
     lxb_dom_element_t* Resolve(Element e) const;
 
@@ -168,4 +256,29 @@ private:
                     Element root={ Element::ROOT }, bool broad=false) const;
 
     lxb_html_document_t* dom = nullptr;
+    // Built in the thread's ParseArena rather than taken from the document pool
+    bool arena_backed = false;
 };
+
+lxb_selectors_t* ThreadSelectorsEngine();
+
+template<typename Callable>
+void SelectorForEach(const Selector& selector, lxb_dom_element_t* root,
+    Callable&& callback)
+{
+    using CallableT = std::remove_cvref_t<Callable>;
+
+    auto trampoline = [] (lxb_dom_node_t* node, lxb_css_selector_specificity_t,
+        void* ctx) -> lxb_status_t {
+        CallableT& cb = *static_cast<CallableT*>(ctx);
+        return cb(Element { lxb_dom_interface_element(node) })
+            ? LXB_STATUS_OK : LXB_STATUS_STOP;
+    };
+
+    lxb_status_t status = lxb_selectors_find(ThreadSelectorsEngine(),
+        lxb_dom_interface_node(root), selector.Data(), trampoline,
+        const_cast<CallableT*>(std::addressof(callback)));
+
+    if (status != LXB_STATUS_OK && status != LXB_STATUS_STOP)
+        Log(LogLevel::WARNING, "Selector search failed with code {}", status);
+}
@@ -0,0 +1,210 @@
+#include "webscraper/jsonextractor.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <stdexcept>
+
+// Appends the segments of `pointer`. Numeric segments match both array indices and
+// object keys, as in JSON pointers.
+static bool AppendPointer(std::string_view pointer, auto& segments, size_t& size)
+{
+    while (!pointer.empty()) {
+        if (pointer.front() != '/' || size == segments.size()) return false;
+        pointer.remove_prefix(1);
+
+        std::string_view key = pointer.substr(0, pointer.find('/'));
+        pointer.remove_prefix(key.size());
+
+        auto& segment = segments[size++];
+        segment = { .key = key };
+
+        size_t index;
+        auto [end, ec] = std::from_chars(key.data(), key.data() + key.size(), index);
+        if (!key.empty() && ec == std::errc {} && end == key.data() + key.size())
+            segment.index = index;
+    }
+
+    return true;
+}
+
+JSONExtractor::JSONExtractor(std::string_view items,
+    std::span<const std::string_view> fields)
+    : field_count(std::min(fields.size(), MAX_FIELDS))
+{
+    Path& item_path = paths[ITEM_PATH];
+    bool valid = AppendPointer(items, item_path.segments, item_path.size)
+              && item_path.size < MAX_SEGMENTS;
+    if (valid)
+        item_path.segments[item_path.size++] = { .any_index = true };
+
+    for (size_t i = 0; valid && i < field_count; ++i) {
+        paths[i] = item_path;
+        valid = fields[i].size() && AppendPointer(fields[i], paths[i].segments, paths[i].size)
+             && paths[i].size <= item_path.size + MAX_SEGMENTS;
+    }
+
+    if (!valid) {
+        Log(LogLevel::SEVERE, "Invalid JSON pointer for extractor of '{}'", items);
+        throw std::invalid_argument { "Invalid JSON pointer" };
+    }
+
+    all_paths = (1u << field_count) - 1 | 1u << ITEM_PATH;
+}
+
+bool JSONExtractor::RunImpl(std::string_view data, ItemCallback cb, void* ctx)
+{
+    callback = cb;
+    callback_ctx = ctx;
+    depth = item_depth = item_index = 0;
+    key_mask = 0;
+    in_item = stopped = false;
+
+    nlohmann::json_sax<json>* sax = this;
+    bool completed = json::sax_parse(data.begin(), data.end(), sax);
+
+    return completed || stopped;
+}
+
+size_t JSONExtractor::ItemIndex() const { return item_index; }
+
+std::optional<std::string_view> JSONExtractor::String(size_t field) const
+{
+    if (captures[field].kind != Capture::STRING) return std::nullopt;
+    return captures[field].text;
+}
+
+std::optional<double> JSONExtractor::Number(size_t field) const
+{
+    if (captures[field].kind != Capture::NUMBER) return std::nullopt;
+    return captures[field].number;
+}
+
+uint32_t JSONExtractor::NextMask()
+{
+    if (depth == 0) return all_paths;
+    if (depth > MAX_DEPTH) return 0;
+
+    Frame& frame = stack[depth - 1];
+    if (!frame.is_array) return key_mask;
+
+    size_t index = frame.next_index++;
+    uint32_t mask = 0;
+    for (uint32_t bits = frame.mask; bits; bits &= bits - 1) {
+        size_t path = std::countr_zero(bits);
+        if (paths[path].size < depth) continue;
+
+        const Segment& segment = paths[path].segments[depth - 1];
+        if (segment.any_index || segment.index == index)
+            mask |= 1u << path;
+    }
+
+    return mask;
+}
+
+bool JSONExtractor::Scalar(Capture::Kind kind, std::string_view text, double number)
+{
+    uint32_t mask = NextMask();
+    if (!in_item) return true;
+
+    for (uint32_t bits = mask & ~(1u << ITEM_PATH); bits; bits &= bits - 1) {
+        size_t field = std::countr_zero(bits);
+        if (paths[field].size != depth) continue;
+
+        Capture& capture = captures[field];
+        capture.kind = kind;
+        capture.number = number;
+        capture.text.assign(text);
+    }
+
+    return true;
+}
+
+bool JSONExtractor::StartContainer(bool is_array)
+{
+    uint32_t mask = NextMask();
+
+    if (!in_item && mask & 1u << ITEM_PATH && paths[ITEM_PATH].size == depth) {
+        in_item = true;
+        item_depth = depth + 1;
+        for (size_t i = 0; i < field_count; ++i)
+            captures[i].kind = Capture::NONE;
+    }
+
+    if (depth < MAX_DEPTH)
+        stack[depth] = { .mask = mask, .is_array = is_array, .next_index = 0 };
+    ++depth;
+
+    return true;
+}
+
+bool JSONExtractor::EndContainer()
+{
+    if (in_item && depth == item_depth) {
+        in_item = false;
+        bool proceed = callback(callback_ctx);
+        ++item_index;
+        if (!proceed) {
+            stopped = true;
+            return false;
+        }
+    }
+
+    --depth;
+    return true;
+}
+
+bool JSONExtractor::null() { return Scalar(Capture::OTHER, {}, 0); }
+
+bool JSONExtractor::boolean(bool) { return Scalar(Capture::OTHER, {}, 0); }
+
+bool JSONExtractor::number_integer(number_integer_t value)
+{
+    return Scalar(Capture::NUMBER, {}, static_cast<double>(value));
+}
+
+bool JSONExtractor::number_unsigned(number_unsigned_t value)
+{
+    return Scalar(Capture::NUMBER, {}, static_cast<double>(value));
+}
+
+bool JSONExtractor::number_float(number_float_t value, const string_t&)
+{
+    return Scalar(Capture::NUMBER, {}, value);
+}
+
+bool JSONExtractor::string(string_t& value) { return Scalar(Capture::STRING, value, 0); }
+
+bool JSONExtractor::binary(binary_t&) { return Scalar(Capture::OTHER, {}, 0); }
+
+bool JSONExtractor::start_object(std::size_t) { return StartContainer(false); }
+
+bool JSONExtractor::key(string_t& value)
+{
+    key_mask = 0;
+    if (depth > MAX_DEPTH) return true;
+
+    for (uint32_t bits = stack[depth - 1].mask; bits; bits &= bits - 1) {
+        size_t path = std::countr_zero(bits);
+        if (paths[path].size < depth) continue;
+
+        const Segment& segment = paths[path].segments[depth - 1];
+        if (!segment.any_index && segment.key == value)
+            key_mask |= 1u << path;
+    }
+
+    return true;
+}
+
+bool JSONExtractor::end_object() { return EndContainer(); }
+
+bool JSONExtractor::start_array(std::size_t) { return StartContainer(true); }
+
+bool JSONExtractor::end_array() { return EndContainer(); }
+
+bool JSONExtractor::parse_error(std::size_t position, const std::string&,
+    const nlohmann::detail::exception& ex)
+{
+    Log(LogLevel::WARNING, "Failed to parse JSON at byte {}: {}", position, ex.what());
+    return false;
+}
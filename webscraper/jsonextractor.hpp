@@ -0,0 +1,124 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include <nlohmann/json.hpp>
+
+#include "common/util.hpp"
+
+// Reads selected values from a JSON document with nlohmann's SAX parser, without
+// building a DOM. `items` points to an array; for each element of it, the scalar
+// values at `fields` - JSON pointers relative to the element - are captured and the
+// callback is invoked when the element ends. The document is read in a single pass,
+// which ends early once the callback returns false. Captures live in fixed
+// per-field slots whose buffers are reused from item to item. Pointers are matched
+// literally, without unescaping ~0 and ~1.
+class JSONExtractor : private nlohmann::json_sax<json>
+{
+public:
+    constexpr static size_t MAX_FIELDS = 16;
+    constexpr static size_t MAX_SEGMENTS = 8;
+    // Values nested deeper than this are never captured
+    constexpr static size_t MAX_DEPTH = 64;
+
+    // Throws std::invalid_argument if a pointer has too many segments
+    JSONExtractor(std::string_view items, std::span<const std::string_view> fields);
+
+    // Calls `on_item()` for each element of the items array until it returns false.
+    // Returns false if the document is not valid JSON.
+    template<typename Callable>
+    bool Run(std::string_view data, Callable&& on_item)
+    {
+        using CallableT = std::remove_cvref_t<Callable>;
+        return RunImpl(data, [] (void* ctx) -> bool {
+            return (*static_cast<CallableT*>(ctx))();
+        }, const_cast<CallableT*>(std::addressof(on_item)));
+    }
+
+    // Only valid during the callback
+    size_t ItemIndex() const;
+    std::optional<std::string_view> String(size_t field) const;
+    std::optional<double> Number(size_t field) const;
+
+private:
+    constexpr static size_t NO_INDEX = static_cast<size_t>(-1);
+    constexpr static size_t ITEM_PATH = MAX_FIELDS;
+    constexpr static size_t MAX_PATH_SEGMENTS = MAX_SEGMENTS * 2 + 1;
+
+    static_assert(MAX_FIELDS < 32, "Paths are tracked in a 32-bit mask");
+
+    struct Segment
+    {
+        std::string_view key;
+        size_t index = NO_INDEX;
+        bool any_index = false;
+    };
+
+    struct Path
+    {
+        std::array<Segment, MAX_PATH_SEGMENTS> segments;
+        size_t size = 0;
+    };
+
+    struct Capture
+    {
+        enum Kind : uint8_t { NONE, STRING, NUMBER, OTHER };
+
+        std::string text;
+        double number = 0;
+        Kind kind = NONE;
+    };
+
+    struct Frame
+    {
+        uint32_t mask;
+        bool is_array;
+        size_t next_index;
+    };
+
+    using ItemCallback = bool (*)(void*);
+
+    bool RunImpl(std::string_view data, ItemCallback callback, void* ctx);
+
+    // Paths the next value lies on, given its key or array index
+    uint32_t NextMask();
+    bool Scalar(Capture::Kind kind, std::string_view text, double number);
+    bool StartContainer(bool is_array);
+    bool EndContainer();
+
+    // nlohmann::json_sax
+    bool null() override;
+    bool boolean(bool value) override;
+    bool number_integer(number_integer_t value) override;
+    bool number_unsigned(number_unsigned_t value) override;
+    bool number_float(number_float_t value, const string_t& text) override;
+    bool string(string_t& value) override;
+    bool binary(binary_t& value) override;
+    bool start_object(std::size_t elements) override;
+    bool key(string_t& value) override;
+    bool end_object() override;
+    bool start_array(std::size_t elements) override;
+    bool end_array() override;
+    bool parse_error(std::size_t position, const std::string& last_token,
+                     const nlohmann::detail::exception& ex) override;
+
+    std::array<Path, MAX_FIELDS + 1> paths;
+    size_t field_count;
+    uint32_t all_paths;
+
+    ItemCallback callback = nullptr;
+    void* callback_ctx = nullptr;
+
+    std::array<Capture, MAX_FIELDS> captures;
+    std::array<Frame, MAX_DEPTH> stack;
+    size_t depth = 0, item_depth = 0, item_index = 0;
+    uint32_t key_mask = 0;
+    bool in_item = false, stopped = false;
+};
@@ -1,5 +1,10 @@
+#include <csignal>
 #include <iostream>
 #include <string>
+#include <thread>
+
+#include <pthread.h>
+#include <unistd.h>
 
 #include "webscraper/app.hpp"
 #include "webscraper/stores.hpp"
@@ -10,6 +15,15 @@ int main(int argc, char** argv)
 {
     Log(LogLevel::INFO, "Starting Fitsch {}", FITSCH_VERSION);
 
+    // SIGINT and SIGTERM are waited for below instead of handled, so that the app is
+    // destroyed normally and writes its final snapshot. They are blocked before any
+    // thread starts, since threads inherit the mask.
+    sigset_t shutdown_signals;
+    sigemptyset(&shutdown_signals);
+    sigaddset(&shutdown_signals, SIGINT);
+    sigaddset(&shutdown_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &shutdown_signals, nullptr);
+
     std::string_view cfg_path = argc > 1 ? argv[1] : "config.json";
 
     std::optional<AppConfig> config = AppConfig::FromJSONFile(cfg_path);
@@ -20,10 +34,10 @@ int main(int argc, char** argv)
 
     App a(config.value());
 
-    a.AddStore(&stores::SuperValu);
-    a.AddStore(&stores::Tesco);
-    a.AddStore(&stores::DunnesStores);
-    a.AddStore(&stores::Aldi);
+    for (const Store* store : stores::ALL)
+        a.AddStore(store);
+
+    a.LoadPlans();
 
     std::string_view url = "https://shop.supervalu.ie/sm/delivery/rsid/5550/"
     			 	  	   "product/batchelors-chick-peas-225-g-id-1018033000";
@@ -37,11 +51,19 @@ int main(int argc, char** argv)
           "product/dunnes-stores-irish-chicken-breast-fillets-840g-id-100222328";
     a.GetProductAtURL(StoreID::DUNNES_STORES, url3);
 
-    std::string input;
-    while (1) {
-        std::getline(std::cin, input);
-        if (input == "quit") break;
-    }
+    // "quit" and the end of input shut down the same way as a signal. The thread is
+    // left behind if a signal comes first, since it can't be woken from getline.
+    std::thread([&a] {
+        std::string input;
+        while (std::getline(std::cin, input) && input != "quit") {
+            if (input == "reload") a.LoadPlans();
+        }
+        kill(getpid(), SIGTERM);
+    }).detach();
+
+    int received;
+    sigwait(&shutdown_signals, &received);
+    Log(LogLevel::INFO, "Shutting down");
 
     return 0;
 }
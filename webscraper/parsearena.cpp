@@ -0,0 +1,173 @@
+#include "webscraper/parsearena.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+#include <lexbor/core/lexbor.h>
+
+#include "common/util.hpp"
+
+// Every allocation is preceded by a header recording its size, for realloc
+constexpr size_t HEADER_SIZE = ParseArena::ALIGNMENT;
+
+static std::atomic_bool arenas_enabled = false;
+static thread_local ParseArena* active_arena = nullptr;
+// Thread-local destruction order is not ours to choose, so hooks called while other
+// thread-locals are torn down must not touch a destroyed arena
+static thread_local bool thread_arena_alive = false;
+
+static bool InThreadArena(const void* ptr)
+{
+    return ptr && thread_arena_alive && ThreadParseArena().Contains(ptr);
+}
+
+// ParseArena
+
+ParseArena::~ParseArena()
+{
+    for (Chunk& chunk : chunks)
+        std::free(chunk.data);
+}
+
+void* ParseArena::Allocate(size_t size)
+{
+    size_t needed = HEADER_SIZE + (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+
+    while (current < chunks.size() && offset + needed > chunks[current].size) {
+        ++current;
+        offset = 0;
+    }
+
+    if (current == chunks.size()) {
+        size_t chunk_size = std::max(CHUNK_SIZE, needed);
+        char* data = static_cast<char*>(std::aligned_alloc(ALIGNMENT, chunk_size));
+        if (!data) return nullptr;
+
+        chunks.push_back({ data, chunk_size });
+        offset = 0;
+    }
+
+    char* block = chunks[current].data + offset;
+    offset += needed;
+    bytes_in_use += needed;
+    high_water_mark = std::max(high_water_mark, bytes_in_use);
+
+    std::memcpy(block, &size, sizeof(size));
+    return block + HEADER_SIZE;
+}
+
+bool ParseArena::Contains(const void* ptr) const
+{
+    const char* p = static_cast<const char*>(ptr);
+    return std::any_of(chunks.begin(), chunks.end(), [p] (const Chunk& chunk) {
+        return p >= chunk.data && p < chunk.data + chunk.size;
+    });
+}
+
+size_t ParseArena::SizeOf(const void* ptr)
+{
+    size_t size;
+    std::memcpy(&size, static_cast<const char*>(ptr) - HEADER_SIZE, sizeof(size));
+    return size;
+}
+
+void ParseArena::Reset()
+{
+    size_t retained = 0, keep = 0;
+    while (keep < chunks.size() && retained + chunks[keep].size <= MAX_RETAINED_BYTES)
+        retained += chunks[keep++].size;
+
+    for (size_t i = keep; i < chunks.size(); ++i)
+        std::free(chunks[i].data);
+    chunks.resize(keep);
+
+    current = 0;
+    offset = 0;
+    bytes_in_use = 0;
+}
+
+size_t ParseArena::BytesInUse() const { return bytes_in_use; }
+
+size_t ParseArena::HighWaterMark() const { return high_water_mark; }
+
+void ParseArena::ResetHighWaterMark() { high_water_mark = bytes_in_use; }
+
+// lexbor hooks
+
+static void* ArenaMalloc(size_t size)
+{
+    if (active_arena) return active_arena->Allocate(size);
+    return std::malloc(size);
+}
+
+static void* ArenaCalloc(size_t count, size_t size)
+{
+    if (!active_arena) return std::calloc(count, size);
+
+    void* ptr = active_arena->Allocate(count * size);
+    if (ptr) std::memset(ptr, 0, count * size);
+
+    return ptr;
+}
+
+static void* ArenaRealloc(void* ptr, size_t size)
+{
+    // Arena memory cannot grow in place, so it is moved - to the heap if the
+    // document is being used outside of a scope
+    if (InThreadArena(ptr)) {
+        void* moved = ArenaMalloc(size);
+        if (moved) std::memcpy(moved, ptr, std::min(size, ParseArena::SizeOf(ptr)));
+        return moved;
+    }
+
+    if (active_arena && !ptr)
+        return active_arena->Allocate(size);
+
+    return std::realloc(ptr, size);
+}
+
+static void* ArenaFree(void* ptr)
+{
+    if (ptr && !InThreadArena(ptr))
+        std::free(ptr);
+
+    return nullptr;
+}
+
+void EnableParseArenas()
+{
+    if (arenas_enabled.exchange(true)) return;
+
+    if (lexbor_memory_setup(ArenaMalloc, ArenaRealloc, ArenaCalloc, ArenaFree)
+        != LXB_STATUS_OK) {
+        Log(LogLevel::WARNING, "Failed to install lexbor memory hooks");
+        arenas_enabled = false;
+    }
+}
+
+bool ParseArenasEnabled() { return arenas_enabled; }
+
+ParseArena& ThreadParseArena()
+{
+    struct ThreadArena
+    {
+        ParseArena arena;
+
+        ThreadArena() { thread_arena_alive = true; }
+        ~ThreadArena() { thread_arena_alive = false; }
+    };
+
+    thread_local ThreadArena thread_arena;
+    return thread_arena.arena;
+}
+
+// ParseArenaScope
+
+ParseArenaScope::ParseArenaScope() : previous(active_arena)
+{
+    active_arena = &ThreadParseArena();
+}
+
+ParseArenaScope::~ParseArenaScope() { active_arena = previous; }
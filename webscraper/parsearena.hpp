@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Bump allocator backing lexbor while a document is built, so a whole DOM is
+// released by resetting the arena instead of node by node. Each thread has its own
+// arena; lexbor's global memory hooks send allocations to it while a ParseArenaScope
+// is active on the calling thread and to the heap otherwise. Freeing arena memory
+// is a no-op, and heap memory is freed as usual whether or not a scope is active.
+class ParseArena
+{
+public:
+    constexpr static size_t ALIGNMENT = 16;
+    constexpr static size_t CHUNK_SIZE = 1024 * 1024;
+    // Chunks beyond this total are returned to the heap on Reset
+    constexpr static size_t MAX_RETAINED_BYTES = 8 * 1024 * 1024;
+
+    ParseArena() = default;
+    ~ParseArena();
+
+    ParseArena(const ParseArena& other) = delete;
+    ParseArena& operator=(const ParseArena& other) = delete;
+
+    void* Allocate(size_t size);
+    bool Contains(const void* ptr) const;
+    // Size requested for an allocation returned by Allocate
+    static size_t SizeOf(const void* ptr);
+
+    void Reset();
+
+    size_t BytesInUse() const;
+    size_t HighWaterMark() const;
+    void ResetHighWaterMark();
+
+private:
+    struct Chunk
+    {
+        char* data;
+        size_t size;
+    };
+
+    std::vector<Chunk> chunks;
+    size_t current = 0, offset = 0;
+    size_t bytes_in_use = 0, high_water_mark = 0;
+};
+
+// Installs the lexbor memory hooks. Must be called once, before parsing starts on
+// any thread.
+void EnableParseArenas();
+bool ParseArenasEnabled();
+
+ParseArena& ThreadParseArena();
+
+// Routes lexbor allocations on this thread to ThreadParseArena() while alive
+class ParseArenaScope
+{
+public:
+    ParseArenaScope();
+    ~ParseArenaScope();
+
+    ParseArenaScope(const ParseArenaScope& other) = delete;
+    ParseArenaScope& operator=(const ParseArenaScope& other) = delete;
+
+private:
+    ParseArena* previous;
+};
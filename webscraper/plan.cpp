@@ -0,0 +1,463 @@
+#include "webscraper/plan.hpp"
+
+#include <charconv>
+
+#include "common/util.hpp"
+#include "webscraper/stores.hpp"
+
+// Compilation
+
+namespace {
+
+struct PlanCompiler
+{
+    ExtractionPlan& plan;
+
+    std::string_view Intern(std::string_view str)
+    {
+        return plan.strings.emplace_back(str);
+    }
+
+    // An empty attribute or substring would match every element, or none
+    static const std::string& NonEmptyString(const json& object, const char* key)
+    {
+        const std::string& str = object.at(key).get_ref<const std::string&>();
+        if (str.empty())
+            throw std::invalid_argument { std::format("empty '{}'", key) };
+        return str;
+    }
+
+    // Returns the index of the pattern matching elements described by `matcher`,
+    // reusing an existing pattern where possible
+    size_t CompileMatcher(const json& matcher, std::string_view capture)
+    {
+        const std::string& attr = NonEmptyString(matcher, "attr");
+        const std::string& contains = NonEmptyString(matcher, "contains");
+
+        size_t within = AttrPattern::NO_SCOPE;
+        if (matcher.contains("within"))
+            within = CompileMatcher(matcher["within"], {});
+
+        for (size_t i = 0; i < plan.patterns.size(); ++i) {
+            StreamPattern& pattern = plan.patterns[i];
+            if (pattern.match.attr != attr || pattern.match.value != contains
+                || pattern.match.within != within)
+                continue;
+
+            if (capture.empty() || pattern.capture_attr == capture)
+                return i;
+
+            if (pattern.capture_attr.empty()) {
+                pattern.capture_attr = Intern(capture);
+                return i;
+            }
+        }
+
+        if (plan.patterns.size() == StreamExtractor::MAX_PATTERNS)
+            throw std::invalid_argument { "too many element patterns" };
+
+        plan.patterns.push_back({
+            .match = { Intern(attr), Intern(contains), within },
+            .capture_attr = capture.empty() ? std::string_view {} : Intern(capture)
+        });
+
+        return plan.patterns.size() - 1;
+    }
+
+    FieldSource CompileSource(const json& source)
+    {
+        FieldSource result;
+
+        if (plan.kind == ExtractionPlan::Kind::JSON) {
+            result.pointer = json::json_pointer {
+                source.at("pointer").get<std::string>()
+            };
+            return result;
+        }
+
+        std::string take = source.value("take", "text");
+        std::string_view capture;
+        if (take.starts_with('@')) {
+            result.take_attr = true;
+            capture = std::string_view(take).substr(1);
+            if (capture.empty())
+                throw std::invalid_argument { "invalid take '@'" };
+        } else if (take != "text") {
+            throw std::invalid_argument { std::format("invalid take '{}'", take) };
+        }
+
+        if (source.value("listing", false)) {
+            result.from_listing = true;
+            if (!result.take_attr)
+                throw std::invalid_argument { "listing sources must take an attribute" };
+            if (!plan.listing.capture_attr.empty() && plan.listing.capture_attr != capture)
+                throw std::invalid_argument { "only one listing attribute can be taken" };
+            plan.listing.capture_attr = Intern(capture);
+        } else {
+            result.pattern = CompileMatcher(source, capture);
+        }
+
+        return result;
+    }
+
+    void CompileField(const json& fields, const char* name, FieldPlan& field,
+        bool required)
+    {
+        if (!fields.contains(name)) {
+            if (required)
+                throw std::invalid_argument { std::format("missing field '{}'", name) };
+            return;
+        }
+
+        const json& spec = fields[name];
+        const json& from = spec.at("from");
+        if (from.is_array()) {
+            for (const json& source : from)
+                field.sources.push_back(CompileSource(source));
+        } else {
+            field.sources.push_back(CompileSource(from));
+        }
+
+        if (spec.contains("join"))
+            field.join = spec["join"].get<std::string>();
+        if (spec.contains("default"))
+            field.fallback = spec["default"].get<std::string>();
+
+        field.until = spec.value("until", "");
+        field.until_last = spec.value("until-last", "");
+        field.after_last = spec.value("after-last", "");
+        field.format = spec.value("format", "");
+
+        std::string parser = spec.value("parse", "price");
+        if (parser == "cents")
+            field.parser = ValueParser::CENTS;
+        else if (parser != "price")
+            throw std::invalid_argument { std::format("invalid parser '{}'", parser) };
+    }
+};
+
+} // namespace
+
+std::shared_ptr<const ExtractionPlan> CompilePlan(const json& spec, std::string_view store)
+{
+    auto plan = std::make_shared<ExtractionPlan>();
+    PlanCompiler compiler { *plan };
+
+    try {
+        std::string type = spec.value("type", "html");
+        if (type == "json") {
+            plan->kind = ExtractionPlan::Kind::JSON;
+            plan->items = json::json_pointer { spec.value("items", "") };
+        } else if (type == "html") {
+            const json& listing = spec.at("listing");
+            plan->listing.match = {
+                compiler.Intern(PlanCompiler::NonEmptyString(listing, "attr")),
+                compiler.Intern(PlanCompiler::NonEmptyString(listing, "contains"))
+            };
+        } else {
+            throw std::invalid_argument { std::format("invalid type '{}'", type) };
+        }
+
+        const json& fields = spec.at("fields");
+        compiler.CompileField(fields, "name", plan->name, true);
+        compiler.CompileField(fields, "id", plan->id, true);
+        compiler.CompileField(fields, "url", plan->url, true);
+        compiler.CompileField(fields, "price", plan->price, true);
+        compiler.CompileField(fields, "image", plan->image, false);
+        compiler.CompileField(fields, "description", plan->description, false);
+        compiler.CompileField(fields, "price-per", plan->price_per, false);
+        compiler.CompileField(fields, "unit", plan->unit, false);
+        compiler.CompileField(fields, "offers", plan->offers, false);
+    } catch (const json::exception& e) {
+        Log(LogLevel::WARNING, "Invalid extraction plan for {}: {}", store, e.what());
+        return nullptr;
+    } catch (const std::invalid_argument& e) {
+        Log(LogLevel::WARNING, "Invalid extraction plan for {}: {}", store, e.what());
+        return nullptr;
+    }
+
+    return plan;
+}
+
+// Execution
+
+static std::string ExpandFormat(std::string_view format, std::string_view value,
+    const Store& store)
+{
+    constexpr std::string_view HOMEPAGE = "{homepage}", ROOT = "{root}";
+
+    std::string result;
+    result.reserve(format.size() + value.size());
+
+    while (!format.empty()) {
+        size_t brace = format.find('{');
+        result += format.substr(0, brace);
+        if (brace == std::string_view::npos) break;
+
+        format.remove_prefix(brace);
+        if (format.starts_with("{}")) {
+            result += value;
+            format.remove_prefix(2);
+        } else if (format.starts_with(HOMEPAGE)) {
+            result += store.homepage;
+            format.remove_prefix(HOMEPAGE.size());
+        } else if (format.starts_with(ROOT)) {
+            result += store.root_url;
+            format.remove_prefix(ROOT.size());
+        } else {
+            result += '{';
+            format.remove_prefix(1);
+        }
+    }
+
+    return result;
+}
+
+// `read` returns the value of a source, or nullopt if it is absent
+template<typename Reader>
+static std::optional<std::string> Evaluate(const FieldPlan& field, const Store& store,
+    Reader&& read)
+{
+    std::string value;
+    bool found = false;
+
+    for (const FieldSource& source : field.sources) {
+        std::optional<std::string_view> v = read(source);
+        if (!v) continue;
+
+        if (!field.join) {
+            value.assign(v.value());
+            found = true;
+            break;
+        }
+
+        if (found) value += field.join.value();
+        value += v.value();
+        found = true;
+    }
+
+    if (!found) return field.fallback;
+
+    std::string_view view = value;
+    if (!field.until.empty())
+        view = view.substr(0, view.find(field.until));
+    if (!field.until_last.empty())
+        view = view.substr(0, view.rfind(field.until_last));
+    if (!field.after_last.empty()) {
+        size_t pos = view.rfind(field.after_last);
+        if (pos != std::string_view::npos)
+            view.remove_prefix(pos + field.after_last.size());
+    }
+
+    if (field.format.empty()) return std::string(view);
+    return ExpandFormat(field.format, view, store);
+}
+
+static std::optional<Price> ParsePrice(ValueParser parser, std::string_view text)
+{
+    if (parser == ValueParser::PRICE)
+        return Price::FromString(text);
+
+    unsigned cents;
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), cents);
+    if (ec != std::errc {} || end != text.data() + text.size())
+        return std::nullopt;
+
+    return Price { Currency::EUR, cents };
+}
+
+// `for_each_offer` calls its argument with the text of each offer
+template<typename Reader, typename OfferVisitor>
+static PMRProduct* BuildProduct(const ExtractionPlan& plan, const Store& store,
+    tb::thread_safe_memory_arena& arena, size_t index, Reader&& read,
+    OfferVisitor&& for_each_offer)
+{
+    std::optional<std::string> name = Evaluate(plan.name, store, read),
+                               id = Evaluate(plan.id, store, read),
+                               url = Evaluate(plan.url, store, read),
+                               price_text = Evaluate(plan.price, store, read);
+
+    if (!name || !id || !url || !price_text) {
+        Log(LogLevel::WARNING,
+            "Incomplete product info for product #{} (Store: {})\n"
+            "  Name: {}, ID: {}, URL: {}, Price: {}\n",
+            index, store.name, name.has_value(), id.has_value(), url.has_value(),
+            price_text.has_value());
+        return nullptr;
+    }
+
+    std::optional<Price> price = ParsePrice(plan.price.parser, price_text.value());
+    if (!price) {
+        Log(LogLevel::WARNING,
+            "Couldn't parse price string for product #{} (Store: {})\n"
+            "  string: {}",
+            index, store.name, price_text.value());
+        return nullptr;
+    }
+
+    PMRProduct& pmr_product
+        = *arena.allocate_object<PMRProduct>(ArenaProduct::WithArena(arena));
+
+    ArenaProduct& product = std::get<ArenaProduct>(pmr_product);
+
+    product.name = name.value();
+    product.id = std::format("{}{}", store.prefix, id.value());
+    const StoreURLRoots roots = GetStoreURLRoots(store.id);
+    product.url = CompactURL(url.value(), roots.page);
+    product.image_url = CompactURL(Evaluate(plan.image, store, read).value_or(""),
+                                   roots.image);
+    product.description = Evaluate(plan.description, store, read).value_or("");
+    for_each_offer([&] (std::string_view text) {
+        if (auto opt = ArenaOffer::FromString(text, &arena, store.offer_grammar))
+            product.offers.emplace_back(std::move(opt.value()));
+    });
+    product.item_price = price.value();
+    product.store = store.id;
+    product.price_per_unit = {};
+    product.timestamp = Now();
+    product.full_info = false;
+
+    PricePU fallback { .price = product.item_price, .unit = Unit::Piece };
+
+    if (std::optional<std::string> per = Evaluate(plan.price_per, store, read)) {
+        if (plan.unit.Empty()) {
+            product.price_per_unit = PricePU::FromString(per.value()).value_or(fallback);
+        } else {
+            // The unit and the price per unit come from separate fields
+            std::optional<std::string> unit = Evaluate(plan.unit, store, read);
+            std::optional<Price> per_price = ParsePrice(plan.price_per.parser, per.value());
+            if (unit && per_price) {
+                product.price_per_unit = PricePU::FromString(unit.value()).value_or(fallback);
+                product.price_per_unit.price = per_price.value();
+            }
+        }
+    }
+
+    if (product.price_per_unit.unit == Unit::None)
+        product.price_per_unit = fallback;
+
+    return &pmr_product;
+}
+
+static bool ExecuteHTMLPlan(const ExtractionPlan& plan, const Store& store,
+    std::string_view data, tb::thread_safe_memory_arena& arena,
+    ArenaProductList& results)
+{
+    StreamExtractor extractor(plan.listing, plan.patterns);
+
+    auto read = [&extractor] (const FieldSource& source)
+        -> std::optional<std::string_view> {
+        if (source.from_listing) {
+            std::string_view attr = extractor.ListingAttr();
+            if (attr.empty()) return std::nullopt;
+            return attr;
+        }
+
+        return source.take_attr ? extractor.Attr(source.pattern)
+                                : extractor.Text(source.pattern);
+    };
+
+    auto for_each_offer = [&] (auto&& visit) {
+        for (const FieldSource& source : plan.offers.sources) {
+            if (source.from_listing) continue;
+
+            for (size_t i = 0; i < extractor.Count(source.pattern); ++i) {
+                std::optional<std::string_view> text = source.take_attr
+                    ? extractor.Attr(source.pattern, i)
+                    : extractor.Text(source.pattern, i);
+                if (text) visit(text.value());
+            }
+        }
+    };
+
+    return extractor.Run(data, [&] {
+        PMRProduct* product = BuildProduct(plan, store, arena,
+            results.products.size(), read, for_each_offer);
+        if (product) {
+            results.products.emplace_back(
+                *product,
+                QueryResultInfo { results.products.size() }
+            );
+        }
+
+        return results.products.size() < results.depth;
+    });
+}
+
+static bool ExecuteJSONPlan(const ExtractionPlan& plan, const Store& store,
+    std::string_view data, tb::thread_safe_memory_arena& arena,
+    ArenaProductList& results)
+{
+    json root;
+    try {
+        root = json::parse(data);
+    } catch (const json::parse_error& e) {
+        Log(LogLevel::WARNING, "Failed to parse {} response: {}", store.name, e.what());
+        return false;
+    }
+
+    if (!root.contains(plan.items) || !root[plan.items].is_array()) {
+        Log(LogLevel::WARNING, "No items in {} response", store.name);
+        return false;
+    }
+
+    const json& items = root[plan.items];
+    results.products.reserve(std::min(items.size(), results.depth));
+
+    for (const json& item : items) {
+        std::string number;
+
+        auto read = [&item, &number] (const FieldSource& source)
+            -> std::optional<std::string_view> {
+            if (!item.contains(source.pointer)) return std::nullopt;
+
+            const json& value = item[source.pointer];
+            if (value.is_string()) return value.get_ref<const std::string&>();
+            if (!value.is_number()) return std::nullopt;
+
+            number = value.dump();
+            return number;
+        };
+
+        auto for_each_offer = [&] (auto&& visit) {
+            for (const FieldSource& source : plan.offers.sources) {
+                if (!item.contains(source.pointer)) continue;
+
+                const json& offers = item[source.pointer];
+                if (offers.is_string()) {
+                    visit(offers.get_ref<const std::string&>());
+                } else if (offers.is_array()) {
+                    for (const json& offer : offers)
+                        if (offer.is_string()) visit(offer.get_ref<const std::string&>());
+                }
+            }
+        };
+
+        PMRProduct* product = BuildProduct(plan, store, arena,
+            results.products.size(), read, for_each_offer);
+        if (!product) continue;
+
+        results.products.emplace_back(
+            *product,
+            QueryResultInfo { results.products.size() }
+        );
+
+        if (results.products.size() >= results.depth) break;
+    }
+
+    return true;
+}
+
+ArenaProductList* ExecutePlan(const ExtractionPlan& plan, const Store& store,
+    std::string_view data, tb::thread_safe_memory_arena& arena, size_t depth)
+{
+    ArenaProductList& results
+        = *arena.allocate_object<ArenaProductList>(ArenaProductList::WithArena(arena));
+    results.depth = depth;
+
+    bool ok = plan.kind == ExtractionPlan::Kind::HTML
+            ? ExecuteHTMLPlan(plan, store, data, arena, results)
+            : ExecuteJSONPlan(plan, store, data, arena, results);
+
+    return ok ? &results : nullptr;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "common/product.hpp"
+#include "webscraper/streamextractor.hpp"
+
+struct Store;
+
+// Declarative extraction plans. A spec file maps store prefixes to a description of
+// their search results - see docs/plans.md - which is compiled once at load time
+// into an ExtractionPlan. HTML plans run on StreamExtractor, JSON plans on
+// precompiled JSON pointers.
+
+// One place a field's value can come from
+struct FieldSource
+{
+    constexpr static size_t NO_PATTERN = static_cast<size_t>(-1);
+
+    // HTML: index into ExtractionPlan::patterns, or the listing element itself
+    size_t pattern = NO_PATTERN;
+    bool from_listing = false;
+    // HTML: take the captured attribute instead of the element's text
+    bool take_attr = false;
+    // JSON: relative to each item
+    json::json_pointer pointer;
+};
+
+enum class ValueParser { PRICE, CENTS };
+
+struct FieldPlan
+{
+    // Tried in order, the first present value wins - unless `join` is set, in which
+    // case all present values are joined with it
+    std::vector<FieldSource> sources;
+    std::optional<std::string> join;
+
+    // Applied in this order: cut at the first `until`, cut at the last `until_last`,
+    // keep what follows the last `after_last`
+    std::string until, until_last, after_last;
+    // {} is replaced by the value, {homepage} and {root} by the store's URLs
+    std::string format;
+    std::optional<std::string> fallback;
+
+    ValueParser parser = ValueParser::PRICE;
+
+    bool Empty() const { return sources.empty() && !fallback; }
+};
+
+struct ExtractionPlan
+{
+    enum class Kind { HTML, JSON };
+
+    ExtractionPlan() = default;
+    // Patterns hold views of `strings`
+    ExtractionPlan(const ExtractionPlan& other) = delete;
+    ExtractionPlan& operator=(const ExtractionPlan& other) = delete;
+
+    Kind kind = Kind::HTML;
+
+    StreamPattern listing;
+    std::vector<StreamPattern> patterns;
+    std::deque<std::string> strings;
+
+    json::json_pointer items;
+
+    FieldPlan name, id, url, image, description, price, price_per, unit, offers;
+};
+
+// Compiles the spec of one store, or returns nullptr (with a warning) if invalid
+std::shared_ptr<const ExtractionPlan> CompilePlan(const json& spec, std::string_view store);
+
+ArenaProductList* ExecutePlan(const ExtractionPlan& plan, const Store& store,
+    std::string_view data, tb::thread_safe_memory_arena& arena, size_t depth);
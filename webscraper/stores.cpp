@@ -1,55 +1,111 @@
 #include "webscraper/stores.hpp"
 
+#include <algorithm>
+#include <cmath>
+
 #include <curl/curl.h>
 
 #include "common/util.hpp"
+#include "webscraper/extractor.hpp"
+#include "webscraper/jsonextractor.hpp"
+#include "webscraper/streamextractor.hpp"
+
+// Product URLs are kept relative to these roots, and some stores' are built from
+// product IDs alone
+static_assert(std::ranges::all_of(stores::ALL, [] (const Store* store) {
+    StoreURLRoots roots = GetStoreURLRoots(store->id);
+    return roots.page.starts_with(store->homepage)
+        && roots.page.starts_with(store->root_url)
+        && roots.page.ends_with('/') && !roots.image.empty();
+}), "Every store must have URL roots on its own site");
+
+static_assert(std::ranges::all_of(SV_OFFER_PATTERNS, IsValidOfferPattern),
+    "Store offer patterns must be valid");
+
+// Builds a DOM of only the product grid of a search page, falling back to the
+// full page if the grid cannot be located or contains no listings
+static std::optional<HTML> ParseListingRegion(std::string_view data,
+    const RegionMarkers& markers, const Selector& listing_selector,
+    Collection<Element>& listings)
+{
+    if (std::optional<std::string_view> region = FindRegion(data, markers)) {
+        std::optional<HTML> html = HTML::FromString(region.value());
+        if (html) {
+            html->Select(listings, listing_selector, Element::BODY);
+            if (listings.size()) {
+                Log(LogLevel::DEBUG, "Parsed {} of {} bytes of search page",
+                    region->size(), data.size());
+                return html;
+            }
+        }
+
+        Log(LogLevel::DEBUG, "No listings found in page region, parsing full page");
+        listings = {};
+    }
+
+    std::optional<HTML> html = HTML::FromString(data);
+    if (html) html->Select(listings, listing_selector, Element::BODY);
+
+    return html;
+}
+
+constexpr auto GRID_END_MARKERS = std::to_array<std::string_view>({ "<footer", "</main" });
 
 // SuperValu-like: See stores.md
 
+// Selectors are compiled once at startup and shared by all parsing threads
+static const Selector SVLIKE_LISTING_SELECTOR { "[class*=\"ColListing\" i]" };
+static const Selector SVLIKE_META_SELECTOR { "meta[itemprop]" };
+static const Selector SVLIKE_UNIT_PRICE_SELECTOR { "[class*=\"PdpUnitPrice-\" i]" };
+
+constexpr RegionMarkers SVLIKE_GRID_MARKERS { "ColListing", GRID_END_MARKERS };
+
 ArenaProduct* SVLike_GetProductAtURL(const Store& store, const HTML& html,
     tb::thread_safe_memory_arena& arena)
 {
-    Collection<Element> metatags = html.SearchTag("meta", Element::HEAD);
-
     ArenaProduct& result
         = *arena.allocate_object<ArenaProduct>(ArenaProduct::WithArena(arena));
 
     result.store = store.id;
     result.timestamp = Now();
 
-    for (Element e : metatags) {
-        if (!e.HasAttr("itemprop")) continue;
-
+    const StoreURLRoots roots = GetStoreURLRoots(store.id);
+    bool valid = true;
+    html.ForEach(SVLIKE_META_SELECTOR, [&] (Element e) {
         std::string_view content = e.HasAttr("content") ? e.GetAttrValue("content") : "";
         std::string_view property = e.GetAttrValue("itemprop");
 
         if (property == "name") {
             result.name = content;
         } else if (property == "image") {
-            result.image_url = e.GetAttrValue("href");
+            result.image_url = CompactURL(e.GetAttrValue("href"), roots.image);
         } else if (property == "description") {
             result.description = content;
         } else if (property == "sku") {
             result.id = std::format("{}{}", store.prefix, content);
-            result.url = std::format("{}/product/{}", store.homepage,
-                                     content);
+            // Relative to roots.page, where the store's product pages are
+            result.url = content;
         } else if (property == "price") {
             std::optional<Price> price = Price::FromString(content);
             if (!price)
-                return nullptr;
+                return valid = false;
             result.item_price = price.value();
         }
-    }
 
-    Collection<Element> priceper = html.SearchClass("PdpUnitPrice-", Element::BODY, true);
+        return true;
+    }, Element::HEAD);
+
+    if (!valid) return nullptr;
 
-    if (!priceper.size()) {
+    std::optional<Element> priceper
+        = html.SelectFirst(SVLIKE_UNIT_PRICE_SELECTOR, Element::BODY);
+
+    if (!priceper) {
         result.price_per_unit.unit = Unit::Piece;
         result.price_per_unit.price = result.item_price;
     } else {
-        Element e = priceper[0];
         result.price_per_unit
-            = PricePU::FromString(e.FirstChild().Text()).value_or(PricePU {
+            = PricePU::FromString(priceper->FirstChild().Text()).value_or(PricePU {
             .price = result.item_price,
             .unit = Unit::Piece
         });
@@ -58,7 +114,8 @@ ArenaProduct* SVLike_GetProductAtURL(const Store& store, const HTML& html,
     return &result;
 }
 
-std::string SVLike_GetProductSearchURL(const Store& store, std::string_view query_string)
+std::string SVLike_GetProductSearchURL(const Store& store, std::string_view query_string,
+    size_t page)
 {
     char* buffer = curl_easy_escape(nullptr, query_string.data(), query_string.size());
     if (!buffer) {
@@ -67,133 +124,256 @@ std::string SVLike_GetProductSearchURL(const Store& store, std::string_view quer
     }
 
     tb::scoped_guard free_buffer = [buffer] { curl_free(buffer); };
-    return std::format("{}/results?q={}&skip=0", store.homepage, buffer);
+    return std::format("{}/results?q={}&skip={}", store.homepage, buffer,
+        page * store.page_size);
+}
+
+enum SVLikeListingPattern : size_t
+{
+    SVLIKE_NAME, SVLIKE_PRICE, SVLIKE_PRICE_PER, SVLIKE_IMAGE, SVLIKE_URL,
+    SVLIKE_DS_PRICE, SVLIKE_DS_PRICE_PER, SVLIKE_DS_IMAGE,
+    SVLIKE_PROMOTION, SVLIKE_DS_CARD_CHARGES, SVLIKE_DS_PROMOTION
+};
+
+constexpr auto SVLIKE_LISTING_PATTERNS = std::to_array<AttrPattern>({
+    { "data-testid", "ProductNameTestId" },
+    { "class", "ProductCardPrice-" },
+    { "class", "ProductCardPriceInfo" },
+    { "class", "ProductCardImage-" },
+    { "class", "ProductCardHiddenLink" },
+    { "class", "ProductPrice-" },
+    { "class", "ProductUnitPrice-" },
+    { "class", "ProductImage-" },
+    { "data-testid", "promotionBadgeComponent" },
+    { "data-testid", "cardCharges" },
+    { "class", "PromotionLabelBadge", SVLIKE_DS_CARD_CHARGES }
+});
+
+// Raw fields of a search listing, read by either parser backend
+struct SVLikeListing
+{
+    std::optional<std::string_view> name, test_id, price, price_per, image, url;
+    std::array<std::string_view, Extractor::MAX_MATCHES> offers {};
+    size_t offer_count = 0;
+};
+
+static PMRProduct* SVLike_MakeProduct(const Store& store, const SVLikeListing& listing,
+    tb::thread_safe_memory_arena& arena, size_t index)
+{
+    if (!listing.name || !listing.test_id || !listing.price || !listing.image
+        || !listing.url) {
+        Log(LogLevel::WARNING,
+            "Incomplete product info for product #{} (Store: {})\n"
+            "  Name: {}, Price: {}, Price Per: {}, Image: {}, URL: {}\n",
+            index, store.name,
+            listing.name.has_value(), listing.price.has_value(),
+            listing.price_per.has_value(), listing.image.has_value(),
+            listing.url.has_value());
+        return nullptr;
+    }
+
+    std::optional<Price> price = Price::FromString(listing.price.value());
+    if (!price) {
+        Log(LogLevel::WARNING,
+            "Couldn't parse price string for product #{} (Store: {})\n"
+            "  string: {}",
+            index, store.name, listing.price.value());
+        return nullptr;
+    }
+
+    std::string_view str_id = listing.test_id.value();
+    str_id = str_id.substr(0, str_id.find('-'));
+
+    PMRProduct& pmr_product
+        = *arena.allocate_object<PMRProduct>(ArenaProduct::WithArena(arena));
+
+    ArenaProduct& product = std::get<ArenaProduct>(pmr_product);
+
+    product.name = listing.name.value();
+    const StoreURLRoots roots = GetStoreURLRoots(store.id);
+    product.image_url = CompactURL(listing.image.value(), roots.image);
+    product.url = CompactURL(listing.url.value(), roots.page);
+    product.id = std::format("{}{}", store.prefix, str_id);
+    product.offers.reserve(listing.offer_count);
+    for (size_t i = 0; i < listing.offer_count; ++i) {
+        if (auto opt = ArenaOffer::FromString(listing.offers[i], &arena,
+                store.offer_grammar))
+            product.offers.emplace_back(std::move(opt.value()));
+    }
+    product.item_price = price.value();
+    product.store = store.id;
+    product.price_per_unit = {};
+    product.timestamp = Now();
+    product.full_info = false;
+
+    if (listing.price_per) {
+        product.price_per_unit
+            = PricePU::FromString(listing.price_per.value())
+              .value_or(PricePU {
+            .price = product.item_price,
+            .unit = Unit::Piece
+        });
+    }
+
+    if (product.price_per_unit.unit == Unit::None) {
+        product.price_per_unit.unit = Unit::Piece;
+        product.price_per_unit.price = product.item_price;
+    }
+
+    return &pmr_product;
 }
 
 ArenaProductList* SVLike_ParseProductSearch(const Store& store, std::string_view data,
     tb::thread_safe_memory_arena& arena, size_t depth)
 {
-    // TODO: Reimplement reading multiple pages
-    std::optional<HTML> html_opt = HTML::FromString(data);
+    Collection<Element> item_listings;
+    std::optional<HTML> html_opt = ParseListingRegion(data, SVLIKE_GRID_MARKERS,
+        SVLIKE_LISTING_SELECTOR, item_listings);
     if (!html_opt) {
         Log(LogLevel::WARNING, "Failed to parse HTML!");
         return {};
     }
 
-    HTML& html = html_opt.value();
-
-    Collection<Element> item_listings
-        = html.SearchClass("ColListing", Element::BODY, true);
-
     ArenaProductList& results
         = *arena.allocate_object<ArenaProductList>(ArenaProductList::WithArena(arena));
     results.depth = depth;
     results.products.reserve(item_listings.size());
 
-    Collection<Element> name_c, price_c, price_per_c, image_c, url_c;
+    auto text_of = [] (std::optional<Element> e) -> std::optional<std::string_view> {
+        if (!e) return std::nullopt;
+        return e->FirstChild().Text();
+    };
+
+    auto attr_of = [] (std::optional<Element> e, std::string_view attr)
+        -> std::optional<std::string_view> {
+        if (!e) return std::nullopt;
+        return e->GetAttrValue(attr);
+    };
+
+    Extractor extractor(SVLIKE_LISTING_PATTERNS);
     for (Element e : item_listings) {
-        html.SearchAttr(name_c, "data-testid", "ProductNameTestId", e, true);
-        html.SearchClass(price_c, "ProductCardPrice-", e, true);
-        html.SearchClass(price_per_c, "ProductCardPriceInfo", e, true);
-        html.SearchClass(image_c, "ProductCardImage-", e, true);
-        html.SearchClass(url_c, "ProductCardHiddenLink", e, true);
+        extractor.Run(e);
+
+        std::optional<Element> name_e = extractor.First(SVLIKE_NAME),
+                               price_e = extractor.First(SVLIKE_PRICE),
+                               price_per_e = extractor.First(SVLIKE_PRICE_PER),
+                               image_e = extractor.First(SVLIKE_IMAGE),
+                               url_e = extractor.First(SVLIKE_URL);
 
         // For Dunnes Stores - 24/4/25
-        if (!price_c.size())
-            html.SearchClass(price_c, "ProductPrice-", e, true);
+        if (!price_e)
+            price_e = extractor.First(SVLIKE_DS_PRICE);
+
+        if (!price_per_e)
+            price_per_e = extractor.First(SVLIKE_DS_PRICE_PER);
+
+        if (!image_e)
+            image_e = extractor.First(SVLIKE_DS_IMAGE);
+
+        SVLikeListing listing {
+            .test_id = attr_of(name_e, "data-testid"),
+            .price = text_of(price_e),
+            .price_per = text_of(price_per_e),
+            .image = attr_of(image_e, "src"),
+            .url = attr_of(url_e, "href")
+        };
+
+        if (name_e) {
+            Node name_text_node = name_e->FindChildIf([] (Node n) {
+                return !n.Text().empty();
+            });
+            if (name_text_node) listing.name = name_text_node.Text();
+        }
 
-        if (!price_per_c.size())
-            html.SearchClass(price_per_c, "ProductUnitPrice-", e, true);
+        size_t offers_pattern = store.id == StoreID::SUPERVALU
+                              ? SVLIKE_PROMOTION : SVLIKE_DS_PROMOTION;
 
-        if (!image_c.size())
-            html.SearchClass(image_c, "ProductImage-", e, true);
+        listing.offer_count = extractor.Count(offers_pattern);
+        for (size_t i = 0; i < listing.offer_count; ++i)
+            listing.offers[i] = extractor.Get(offers_pattern, i).FirstChild().Text();
 
-        if (!name_c.size() || !price_c.size() || !image_c.size() || !url_c.size()) {
-            Log(LogLevel::WARNING,
-                "Incomplete product info for product #{} (Store: {})\n"
-                "  Name: {}, Price: {}, Price Per: {}, Image: {}, URL: {}\n",
-                results.products.size(), store.name,
-                name_c.size() > 0, price_c.size() > 0, price_per_c.size() > 0,
-                image_c.size() > 0, url_c.size() > 0);
-            continue;
-        }
+        PMRProduct* product = SVLike_MakeProduct(store, listing, arena,
+            results.products.size());
+        if (!product) continue;
 
-        Node name_text_node = name_c[0].FindChildIf([] (Node n) {
-            return !n.Text().empty();
-        });
+        results.products.emplace_back(
+            *product,
+            QueryResultInfo { results.products.size() }
+        );
 
-        if (!name_text_node) {
-            Log(LogLevel::WARNING,
-                "Name not found for product #{} (Store: {})",
-                results.products.size(), store.name);
-            continue;
-        }
+        if (results.products.size() >= depth) break;
+    }
 
-        std::optional<Price> price = Price::FromString(price_c[0].FirstChild().Text());
-        if (!price) {
-            Log(LogLevel::WARNING,
-                "Couldn't parse price string for product #{} (Store: {})\n"
-                "  string: {}",
-                results.products.size(), store.name, price_c[0].FirstChild().Text());
-            continue;
-        }
+    return &results;
+}
 
-        std::string_view str_id = name_c[0].GetAttrValue("data-testid");
-        str_id.remove_suffix(str_id.size() - str_id.find('-'));
+constexpr StreamPattern SVLIKE_STREAM_LISTING { { "class", "ColListing" } };
+
+constexpr auto SVLIKE_STREAM_PATTERNS = std::to_array<StreamPattern>({
+    { SVLIKE_LISTING_PATTERNS[SVLIKE_NAME], "data-testid" },
+    { SVLIKE_LISTING_PATTERNS[SVLIKE_PRICE] },
+    { SVLIKE_LISTING_PATTERNS[SVLIKE_PRICE_PER] },
+    { SVLIKE_LISTING_PATTERNS[SVLIKE_IMAGE], "src" },
+    { SVLIKE_LISTING_PATTERNS[SVLIKE_URL], "href" },
+    { SVLIKE_LISTING_PATTERNS[SVLIKE_DS_PRICE] },
+    { SVLIKE_LISTING_PATTERNS[SVLIKE_DS_PRICE_PER] },
+    { SVLIKE_LISTING_PATTERNS[SVLIKE_DS_IMAGE], "src" },
+    { SVLIKE_LISTING_PATTERNS[SVLIKE_PROMOTION] },
+    { SVLIKE_LISTING_PATTERNS[SVLIKE_DS_CARD_CHARGES] },
+    { SVLIKE_LISTING_PATTERNS[SVLIKE_DS_PROMOTION] }
+});
+
+ArenaProductList* SVLike_StreamProductSearch(const Store& store, std::string_view data,
+    tb::thread_safe_memory_arena& arena, size_t depth)
+{
+    ArenaProductList& results
+        = *arena.allocate_object<ArenaProductList>(ArenaProductList::WithArena(arena));
+    results.depth = depth;
 
-        Collection<Element> offers_html;
+    size_t offers_pattern = store.id == StoreID::SUPERVALU
+                          ? SVLIKE_PROMOTION : SVLIKE_DS_PROMOTION;
 
-        if (store.id == StoreID::SUPERVALU) {
-            html.SearchAttr(offers_html, "data-testid",
-                "promotionBadgeComponent", e, true);
-        } else {
-            Collection<Element> card_charges
-                = html.SearchAttr("data-testid", "cardCharges", e, true);
-            if (card_charges.size())
-                html.SearchClass(offers_html, "PromotionLabelBadge",
-                    card_charges[0], true);
-        }
+    StreamExtractor extractor(SVLIKE_STREAM_LISTING, SVLIKE_STREAM_PATTERNS);
+    bool ok = extractor.Run(data, [&] {
+        SVLikeListing listing {
+            .name = extractor.Text(SVLIKE_NAME),
+            .test_id = extractor.Attr(SVLIKE_NAME),
+            .price = extractor.Text(SVLIKE_PRICE),
+            .price_per = extractor.Text(SVLIKE_PRICE_PER),
+            .image = extractor.Attr(SVLIKE_IMAGE),
+            .url = extractor.Attr(SVLIKE_URL)
+        };
 
-        PMRProduct& pmr_product
-            = *arena.allocate_object<PMRProduct>(ArenaProduct::WithArena(arena));
+        // For Dunnes Stores - 24/4/25
+        if (!listing.price)
+            listing.price = extractor.Text(SVLIKE_DS_PRICE);
 
-        ArenaProduct& product = std::get<ArenaProduct>(pmr_product);
+        if (!listing.price_per)
+            listing.price_per = extractor.Text(SVLIKE_DS_PRICE_PER);
 
-        product.name = name_text_node.Text();
-        product.image_url = image_c[0].GetAttrValue("src");
-        product.url = url_c[0].GetAttrValue("href");
-        product.id = std::format("{}{}", store.prefix, str_id);
-        product.offers.reserve(offers_html.size());
-        for (Element offer : offers_html) {
-            if (auto opt = ArenaOffer::FromString(offer.FirstChild().Text(), &arena))
-                product.offers.emplace_back(std::move(opt.value()));
-        }
-        product.item_price = price.value();
-        product.store = store.id;
-        product.price_per_unit = {};
-        product.timestamp = Now();
-        product.full_info = false;
+        if (!listing.image)
+            listing.image = extractor.Attr(SVLIKE_DS_IMAGE);
 
-        if (price_per_c.size()) {
-            product.price_per_unit
-                = PricePU::FromString(price_per_c[0].FirstChild().Text())
-                  .value_or(PricePU {
-                .price = product.item_price,
-                .unit = Unit::Piece
-            });
+        for (size_t i = 0; i < extractor.Count(offers_pattern); ++i) {
+            if (std::optional<std::string_view> text = extractor.Text(offers_pattern, i))
+                listing.offers[listing.offer_count++] = text.value();
         }
 
-        if (product.price_per_unit.unit == Unit::None) {
-            product.price_per_unit.unit = Unit::Piece;
-            product.price_per_unit.price = product.item_price;
+        PMRProduct* product = SVLike_MakeProduct(store, listing, arena,
+            results.products.size());
+        if (product) {
+            results.products.emplace_back(
+                *product,
+                QueryResultInfo { results.products.size() }
+            );
         }
 
-        results.products.emplace_back(
-            pmr_product,
-            QueryResultInfo { results.products.size() }
-        );
+        return results.products.size() < depth;
+    });
 
-        if (results.products.size() >= depth) break;
+    if (!ok) {
+        Log(LogLevel::WARNING, "Failed to tokenize HTML!");
+        return {};
     }
 
     return &results;
@@ -211,9 +391,9 @@ ArenaProduct* SV_GetProductAtURL(const HTML& html, tb::thread_safe_memory_arena&
     return SVLike_GetProductAtURL(stores::SuperValu, html, arena);
 }
 
-std::string SV_GetProductSearchURL(std::string_view query_string)
+std::string SV_GetProductSearchURL(std::string_view query_string, size_t page)
 {
-    return SVLike_GetProductSearchURL(stores::SuperValu, query_string);
+    return SVLike_GetProductSearchURL(stores::SuperValu, query_string, page);
 }
 
 ArenaProductList* SV_ParseProductSearch(std::string_view data, tb::thread_safe_memory_arena& arena, size_t depth)
@@ -221,6 +401,11 @@ ArenaProductList* SV_ParseProductSearch(std::string_view data, tb::thread_safe_m
     return SVLike_ParseProductSearch(stores::SuperValu, data, arena, depth);
 }
 
+ArenaProductList* SV_StreamProductSearch(std::string_view data, tb::thread_safe_memory_arena& arena, size_t depth)
+{
+    return SVLike_StreamProductSearch(stores::SuperValu, data, arena, depth);
+}
+
 // Dunnes Stores
 
 ArenaProductList* DS_ParseProductSearch(std::string_view data, tb::thread_safe_memory_arena& arena, size_t depth)
@@ -228,9 +413,14 @@ ArenaProductList* DS_ParseProductSearch(std::string_view data, tb::thread_safe_m
     return SVLike_ParseProductSearch(stores::DunnesStores, data, arena, depth);
 }
 
-std::string DS_GetProductSearchURL(std::string_view query)
+ArenaProductList* DS_StreamProductSearch(std::string_view data, tb::thread_safe_memory_arena& arena, size_t depth)
 {
-    return SVLike_GetProductSearchURL(stores::DunnesStores, query);
+    return SVLike_StreamProductSearch(stores::DunnesStores, data, arena, depth);
+}
+
+std::string DS_GetProductSearchURL(std::string_view query, size_t page)
+{
+    return SVLike_GetProductSearchURL(stores::DunnesStores, query, page);
 }
 
 ArenaProduct* DS_GetProductAtURL(const HTML& html, tb::thread_safe_memory_arena& arena)
@@ -240,69 +430,118 @@ ArenaProduct* DS_GetProductAtURL(const HTML& html, tb::thread_safe_memory_arena&
 
 // Tesco
 
+static const Selector TE_LISTING_SELECTOR { "[class*=\"WL_DZ\" i]" };
+static const Selector TE_PRODUCT_JSON_SELECTOR { "script[type=\"application/ld+json\"]" };
+static const Selector TE_UNIT_PRICE_SELECTOR { "[class*=\"ddsweb-price__subtext\" i]" };
+
+constexpr RegionMarkers TE_GRID_MARKERS { "WL_DZ", GRID_END_MARKERS };
+
+enum TEProductField : size_t
+{
+    TE_JSON_TYPE, TE_JSON_NAME, TE_JSON_DESCRIPTION, TE_JSON_IMAGE, TE_JSON_IMAGE_SINGLE,
+    TE_JSON_SKU, TE_JSON_PRICE
+};
+
+// Relative to each object of the ld+json @graph
+constexpr auto TE_PRODUCT_FIELDS = std::to_array<std::string_view>({
+    "/@type", "/name", "/description", "/image/0", "/image", "/sku", "/offers/price"
+});
+
+enum TEListingPattern : size_t { TE_NAME, TE_IMAGE, TE_PRICE, TE_PRICE_PER };
+
+constexpr auto TE_LISTING_PATTERNS = std::to_array<AttrPattern>({
+    { "class", "titleContainer" },
+    { "class", "baseImage" },
+    { "class", "_priceText" },
+    { "class", "price__subtext" }
+});
+
+// Raw fields of a search listing, read by either parser backend
+struct TEListing
+{
+    std::optional<std::string_view> name, image, price, price_per;
+    std::string_view id;
+};
+
+static PMRProduct* TE_MakeProduct(const TEListing& listing,
+    tb::thread_safe_memory_arena& arena)
+{
+    if (!listing.name || !listing.image || !listing.price || !listing.price_per)
+        return nullptr;
+
+    std::optional<Price> price = Price::FromString(listing.price.value());
+    std::optional<PricePU> price_per = PricePU::FromString(listing.price_per.value());
+
+    if (!price) {
+        Log(LogLevel::WARNING, "Failed to parse price '{}'", listing.price.value());
+        return nullptr;
+    }
+
+    if (!price_per) {
+        Log(LogLevel::WARNING, "Failed to parse price per unit '{}'",
+            listing.price_per.value());
+        return nullptr;
+    }
+
+    PMRProduct& pmr_product
+        = *arena.allocate_object<PMRProduct>(ArenaProduct::WithArena(arena));
+
+    ArenaProduct& product = std::get<ArenaProduct>(pmr_product);
+
+    product.name = listing.name.value();
+    product.image_url = CompactURL(listing.image.value(),
+                                   GetStoreURLRoots(StoreID::TESCO).image);
+    product.url = listing.id;
+    product.id = std::format("{}{}", stores::Tesco.prefix, listing.id);
+    product.offers = {};
+    product.item_price = price.value();
+    product.store = stores::Tesco.id;
+    product.price_per_unit = price_per.value();
+    product.timestamp = Now();
+    product.full_info = false;
+
+    return &pmr_product;
+}
+
 ArenaProductList* TE_ParseProductSearch(std::string_view data, tb::thread_safe_memory_arena& arena, size_t depth)
 {
-    std::optional<HTML> html_opt = HTML::FromString(data);
+    Collection<Element> item_listings;
+    std::optional<HTML> html_opt = ParseListingRegion(data, TE_GRID_MARKERS,
+        TE_LISTING_SELECTOR, item_listings);
     if (!html_opt) {
         Log(LogLevel::WARNING, "Failed to parse HTML!");
         return {};
     }
 
-    HTML& html = html_opt.value();
-    Collection<Element> item_listings = html.SearchClass("WL_DZ",
-        Element::BODY, true);
-
     ArenaProductList& results
         = *arena.allocate_object<ArenaProductList>(ArenaProductList::WithArena(arena));
     results.depth = depth;
     results.products.reserve(item_listings.size());
-    Collection<Element> name_c, image_c, price_c, price_per_c;
-    for (Element e : item_listings) {
-        html.SearchClass(name_c, "titleContainer", e, true);
-        html.SearchClass(image_c, "baseImage", e, true);
-        html.SearchClass(price_c, "_priceText", e, true);
-        html.SearchClass(price_per_c, "price__subtext", e, true);
-
-        if (!name_c.size() || !image_c.size() || !price_c.size() || !price_per_c.size())
-            continue;
-
-        std::string_view id_text = e.GetAttrValue("data-testid");
 
-        std::optional<Price> price
-            = Price::FromString(price_c[0].FirstChild().Text(true));
-        std::optional<PricePU> price_per
-            = PricePU::FromString(price_per_c[0].FirstChild().Text(true));
-
-        if (!price) {
-            Log(LogLevel::WARNING, "Failed to parse price '{}'",
-                price_c[0].FirstChild().Text());
-            continue;
-        }
+    auto text_of = [] (std::optional<Element> e) -> std::optional<std::string_view> {
+        if (!e) return std::nullopt;
+        return e->FirstChild().Text(true);
+    };
 
-        if (!price_per) {
-            Log(LogLevel::WARNING, "Failed to parse price per unit '{}'",
-                price_per_c[0].FirstChild().Text());
-            continue;
-        }
+    Extractor extractor(TE_LISTING_PATTERNS);
+    for (Element e : item_listings) {
+        extractor.Run(e);
 
-        PMRProduct& pmr_product
-            = *arena.allocate_object<PMRProduct>(ArenaProduct::WithArena(arena));
+        std::optional<Element> image_e = extractor.First(TE_IMAGE);
 
-        ArenaProduct& product = std::get<ArenaProduct>(pmr_product);
+        TEListing listing {
+            .name = text_of(extractor.First(TE_NAME)),
+            .image = image_e ? std::optional(image_e->GetAttrValue("src")) : std::nullopt,
+            .price = text_of(extractor.First(TE_PRICE)),
+            .price_per = text_of(extractor.First(TE_PRICE_PER)),
+            .id = e.GetAttrValue("data-testid")
+        };
 
-        product.name = name_c[0].FirstChild().Text(true);
-        product.image_url = image_c[0].GetAttrValue("src");
-        product.url = std::format("{}/products/{}", stores::Tesco.homepage, id_text);
-        product.id = std::format("{}{}", stores::Tesco.prefix, id_text);
-        product.offers = {};
-        product.item_price = price.value();
-        product.store = stores::Tesco.id;
-        product.price_per_unit = price_per.value();
-        product.timestamp = Now();
-        product.full_info = false;
+        PMRProduct* product = TE_MakeProduct(listing, arena);
+        if (!product) continue;
 
         results.products.emplace_back(
-            pmr_product,
+            *product,
             QueryResultInfo { results.products.size() }
         );
 
@@ -312,7 +551,50 @@ ArenaProductList* TE_ParseProductSearch(std::string_view data, tb::thread_safe_m
     return &results;
 }
 
-std::string TE_GetProductSearchURL(std::string_view query)
+constexpr StreamPattern TE_STREAM_LISTING { { "class", "WL_DZ" }, "data-testid" };
+
+constexpr auto TE_STREAM_PATTERNS = std::to_array<StreamPattern>({
+    { TE_LISTING_PATTERNS[TE_NAME] },
+    { TE_LISTING_PATTERNS[TE_IMAGE], "src" },
+    { TE_LISTING_PATTERNS[TE_PRICE] },
+    { TE_LISTING_PATTERNS[TE_PRICE_PER] }
+});
+
+ArenaProductList* TE_StreamProductSearch(std::string_view data, tb::thread_safe_memory_arena& arena, size_t depth)
+{
+    ArenaProductList& results
+        = *arena.allocate_object<ArenaProductList>(ArenaProductList::WithArena(arena));
+    results.depth = depth;
+
+    StreamExtractor extractor(TE_STREAM_LISTING, TE_STREAM_PATTERNS);
+    bool ok = extractor.Run(data, [&] {
+        TEListing listing {
+            .name = extractor.Text(TE_NAME),
+            .image = extractor.Attr(TE_IMAGE),
+            .price = extractor.Text(TE_PRICE),
+            .price_per = extractor.Text(TE_PRICE_PER),
+            .id = extractor.ListingAttr()
+        };
+
+        if (PMRProduct* product = TE_MakeProduct(listing, arena)) {
+            results.products.emplace_back(
+                *product,
+                QueryResultInfo { results.products.size() }
+            );
+        }
+
+        return results.products.size() < depth;
+    });
+
+    if (!ok) {
+        Log(LogLevel::WARNING, "Failed to tokenize HTML!");
+        return {};
+    }
+
+    return &results;
+}
+
+std::string TE_GetProductSearchURL(std::string_view query, size_t page)
 {
     char* buffer = curl_easy_escape(nullptr, query.data(), query.size());
     if (!buffer) {
@@ -321,66 +603,87 @@ std::string TE_GetProductSearchURL(std::string_view query)
     }
 
     tb::scoped_guard free_buffer = [buffer] { curl_free(buffer); };
-    return std::format("{}/search?query={}", stores::Tesco.homepage, buffer);
+    // Tesco numbers its pages from 1
+    return std::format("{}/search?query={}&page={}", stores::Tesco.homepage, buffer,
+        page + 1);
 }
 
 ArenaProduct* TE_GetProductAtURL(const HTML& html, tb::thread_safe_memory_arena& arena)
 {
-    Collection<Element> product_json = html.SearchAttr("type", "application/ld+json",
-        Element::HEAD, false);
+    std::optional<Element> product_json
+        = html.SelectFirst(TE_PRODUCT_JSON_SELECTOR, Element::HEAD);
 
-    if (!product_json.size()) {
+    if (!product_json) {
         Log(LogLevel::WARNING, "Product information not found for Tesco product page - "
                      "element not found");
         return {};
     }
 
-    json root_json_obj;
+    ArenaProduct& result
+        = *arena.allocate_object<ArenaProduct>(ArenaProduct::WithArena(arena));
+
+    bool found = false, incomplete = false;
+    JSONExtractor extractor("/@graph", TE_PRODUCT_FIELDS);
+    bool ok = extractor.Run(product_json->FirstChild().Text(), [&] {
+        if (extractor.String(TE_JSON_TYPE) != "Product")
+            return true;
+
+        std::optional<std::string_view> name = extractor.String(TE_JSON_NAME),
+                                        sku = extractor.String(TE_JSON_SKU),
+                                        image = extractor.String(TE_JSON_IMAGE);
+        std::optional<double> price = extractor.Number(TE_JSON_PRICE);
+
+        if (!image)
+            image = extractor.String(TE_JSON_IMAGE_SINGLE);
+
+        bool valid_price = price && *price >= 0;
+        if (!name || !sku || !image || !valid_price) {
+            Log(LogLevel::WARNING,
+                "Incomplete Tesco product info, missing or invalid:{}{}{}{}",
+                name ? "" : " name", sku ? "" : " sku", image ? "" : " image",
+                valid_price ? "" : " offers.price");
+            incomplete = true;
+            return false;
+        }
 
-    try {
-         root_json_obj = json::parse(product_json[0].FirstChild().Text());
-    } catch (const json::parse_error& e) {
-        Log(LogLevel::WARNING, "Failed to parse Tesco product info: {}", e.what());
+        result.name = name.value();
+        result.description = extractor.String(TE_JSON_DESCRIPTION).value_or("");
+        result.image_url = CompactURL(image.value(), GetStoreURLRoots(StoreID::TESCO).image);
+        result.url = sku.value();
+        result.id = std::format("{}{}", stores::Tesco.prefix, sku.value());
+        result.item_price = Price {
+            Currency::EUR, static_cast<unsigned>(std::lround(*price * 100))
+        };
+        found = true;
+
+        return false;
+    });
+
+    if (!ok) {
+        Log(LogLevel::WARNING, "Failed to parse Tesco product info");
         return {};
     }
 
-    json& graph = root_json_obj["@graph"];
-    auto iterator = std::find_if(graph.begin(), graph.end(), [] (const json& j) {
-        return j["@type"].get<std::string_view>() == "Product";
-    });
+    if (incomplete)
+        return {};
 
-    if (iterator == graph.end()) {
+    if (!found) {
         Log(LogLevel::WARNING,
             "Product information not found for Tesco product page - JSON obj not found");
         return {};
     }
 
-    json& product_info = *iterator;
-
-    unsigned int price = product_info["offers"]["price"].get<float>() * 100;
-
-    auto sku = product_info["sku"].get<std::string_view>();
-
-    ArenaProduct& result
-        = *arena.allocate_object<ArenaProduct>(ArenaProduct::WithArena(arena));
-
-    result.name = product_info["name"].get<std::string_view>();
-    result.description = product_info["description"].get<std::string_view>();
-    result.image_url = product_info["image"][0].get<std::string_view>();
-    result.url = std::format("{}/products/{}", stores::Tesco.homepage, sku);
-    result.id = std::format("{}{}", stores::Tesco.prefix, sku);
-    result.item_price = Price { Currency::EUR, price };
     result.store = stores::Tesco.id;
     result.timestamp = Now();
     result.full_info = true;
 
-    Collection<Element> priceper = html.SearchClass("ddsweb-price__subtext",
-        Element::BODY, true);
+    std::optional<Element> priceper
+        = html.SelectFirst(TE_UNIT_PRICE_SELECTOR, Element::BODY);
 
-    if (!priceper.size()) {
+    if (!priceper) {
         result.price_per_unit = PricePU { result.item_price, Unit::Piece };
     } else {
-        std::string_view ppu_view = priceper[0].FirstChild().Text();
+        std::string_view ppu_view = priceper->FirstChild().Text();
         auto end_substr = ppu_view.find(' ');
         if (end_substr != std::string::npos)
             ppu_view.remove_suffix(ppu_view.size() - end_substr);
@@ -396,106 +699,106 @@ ArenaProduct* TE_GetProductAtURL(const HTML& html, tb::thread_safe_memory_arena&
 
 // Aldi
 
-ArenaProductList* AL_ParseProductSearch(std::string_view data, tb::thread_safe_memory_arena& arena, size_t depth)
+enum ALItemField : size_t
 {
-    json json_obj;
-    try {
-        json_obj = json::parse(data);
-    } catch (const json::parse_error& e) {
-        Log(LogLevel::WARNING, "Failed to parse Aldi response: {}", e.what());
-        return {};
-    }
+    AL_SKU, AL_NAME, AL_BRAND_NAME, AL_PRICE, AL_PRICE_COMPARISON, AL_SELLING_SIZE,
+    AL_IMAGE
+};
 
-    constexpr std::string_view BASE_IMAGE_URL
-        = "https://dm.emea.cms.aldi.cx/is/image/aldiprodeu/"
-          "product/jpg/scaleWidth/1296";
+constexpr auto AL_ITEM_FIELDS = std::to_array<std::string_view>({
+    "/sku", "/name", "/brandName", "/price/amount", "/price/comparison", "/sellingSize",
+    "/assets/0/url"
+});
+
+ArenaProductList* AL_ParseProductSearch(std::string_view data, tb::thread_safe_memory_arena& arena, size_t depth)
+{
     constexpr std::string_view FALLBACK_IMAGE_URL
         = "https://dm.emea.cms.aldi.cx/is/content/aldiprodeu/"
           "GB%20Fallback%20Image%203-no%20text";
 
-    json& items = json_obj["data"];
     auto& results
         = *arena.allocate_object<ArenaProductList>(ArenaProductList::WithArena(arena));
     results.depth = depth;
-    results.products.reserve(items.size());
-    size_t current_item = 0;
-    for (json& item : items) {
-        ++current_item;
-        try {
-            std::string_view brand_name
-                = item["brandName"].is_string()
-                ? item["brandName"].get<std::string_view>() : "";
-
-            auto& pmr_product
-                = *arena.allocate_object<PMRProduct>(ArenaProduct::WithArena(arena));
-
-            auto& product = std::get<ArenaProduct>(pmr_product);
-
-            product.name = std::format("{} {}", brand_name,
-                                     item["name"].get<std::string_view>()),
-            product.description = {};
-            product.url = std::format("{}/product/{}", stores::Aldi.root_url,
-                 item["sku"].get<std::string_view>());
-            product.id = std::format("{}{}", stores::Aldi.prefix,
-                 item["sku"].get<std::string_view>());
-            product.item_price = Price {
-                 Currency::EUR, item["price"]["amount"].get<unsigned>()
-            };
-            product.store = stores::Aldi.id;
-            product.timestamp = Now();
-            product.full_info = false;
-
-            if (!item["assets"].empty()) {
-                auto product_image_id = item["assets"][0]["url"].get<std::string_view>();
-                constexpr size_t suffix_size = std::string_view("\\/{slug}").size();
-                product_image_id.remove_suffix(suffix_size - 1);
-                size_t image_id_start = product_image_id.rfind('/');
-                product_image_id.remove_prefix(image_id_start + 1);
-
-                product.image_url = std::format("{}/{}", BASE_IMAGE_URL,
-                    product_image_id);
-            } else {
-                product.image_url = FALLBACK_IMAGE_URL;
-            }
 
-            // Parsing this string as a PricePU will yield the correct unit, but
-            // not the price. The actual price per unit is in /price/comparison
-
-            if (item["sellingSize"].is_string()
-                && item.contains("/price/comparison"_json_pointer)
-                && item["/price/comparison"_json_pointer].is_number()) {
-                product.price_per_unit
-                    = PricePU::FromString(item["sellingSize"].get<std::string_view>())
-                      .value_or(PricePU {
-                    .price = product.item_price,
-                    .unit = Unit::Piece
-                });
-                product.price_per_unit.price = {
-                    Currency::EUR,
-                    item["price"]["comparison"].get<unsigned>()
-                };
-            } else {
-                product.price_per_unit.unit = Unit::Piece;
-                product.price_per_unit.price = product.item_price;
-            }
+    JSONExtractor extractor("/data", AL_ITEM_FIELDS);
+    bool ok = extractor.Run(data, [&] {
+        std::optional<std::string_view> sku = extractor.String(AL_SKU),
+                                        name = extractor.String(AL_NAME);
+        std::optional<double> amount = extractor.Number(AL_PRICE);
 
-            results.products.emplace_back(
-                pmr_product,
-                QueryResultInfo { results.products.size() }
-            );
-
-            if (results.products.size() >= depth)
-                break;
-        } catch (const json::exception& e) {
+        if (!sku || !name || !amount || *amount < 0) {
             Log(LogLevel::WARNING, "Invalid JSON for item #{} whilst parsing"
-                " ALDI query: {}", current_item, e.what());
+                " ALDI query", extractor.ItemIndex() + 1);
+            return true;
+        }
+
+        auto& pmr_product
+            = *arena.allocate_object<PMRProduct>(ArenaProduct::WithArena(arena));
+
+        auto& product = std::get<ArenaProduct>(pmr_product);
+
+        product.name = std::format("{} {}",
+            extractor.String(AL_BRAND_NAME).value_or(""), name.value());
+        product.description = {};
+        product.url = sku.value();
+        product.id = std::format("{}{}", stores::Aldi.prefix, sku.value());
+        product.item_price = Price { Currency::EUR, static_cast<unsigned>(*amount) };
+        product.store = stores::Aldi.id;
+        product.timestamp = Now();
+        product.full_info = false;
+
+        if (std::optional<std::string_view> image = extractor.String(AL_IMAGE)) {
+            std::string_view product_image_id = image.value();
+            constexpr size_t suffix_size = std::string_view("\\/{slug}").size();
+            product_image_id.remove_suffix(
+                std::min(suffix_size - 1, product_image_id.size()));
+            size_t image_id_start = product_image_id.rfind('/');
+            product_image_id.remove_prefix(image_id_start + 1);
+
+            product.image_url = product_image_id;
+        } else {
+            product.image_url = FALLBACK_IMAGE_URL;
         }
+
+        // Parsing this string as a PricePU will yield the correct unit, but
+        // not the price. The actual price per unit is in /price/comparison
+
+        std::optional<std::string_view> selling_size = extractor.String(AL_SELLING_SIZE);
+        std::optional<double> comparison = extractor.Number(AL_PRICE_COMPARISON);
+
+        if (selling_size && comparison && *comparison >= 0) {
+            product.price_per_unit
+                = PricePU::FromString(selling_size.value())
+                  .value_or(PricePU {
+                .price = product.item_price,
+                .unit = Unit::Piece
+            });
+            product.price_per_unit.price = {
+                Currency::EUR,
+                static_cast<unsigned>(*comparison)
+            };
+        } else {
+            product.price_per_unit.unit = Unit::Piece;
+            product.price_per_unit.price = product.item_price;
+        }
+
+        results.products.emplace_back(
+            pmr_product,
+            QueryResultInfo { results.products.size() }
+        );
+
+        return results.products.size() < depth;
+    });
+
+    if (!ok) {
+        Log(LogLevel::WARNING, "Failed to parse Aldi response");
+        return {};
     }
 
     return &results;
 }
 
-std::string AL_GetProductSearchURL(std::string_view query)
+std::string AL_GetProductSearchURL(std::string_view query, size_t page)
 {
     char* buffer = curl_easy_escape(nullptr, query.data(), query.size());
     if (!buffer) {
@@ -506,17 +809,11 @@ std::string AL_GetProductSearchURL(std::string_view query)
     tb::scoped_guard free_buffer = [buffer] { curl_free(buffer); };
 
     return std::format(
-        "https://api.aldi.ie/v3/product-search?&q={}&limit=30&sort=relevance",
-        buffer
+        "https://api.aldi.ie/v3/product-search?&q={}&limit={}&offset={}&sort=relevance",
+        buffer, stores::Aldi.page_size, page * stores::Aldi.page_size
     );
 }
 
-ArenaProduct* AL_GetProductAtURL(const HTML& html, tb::thread_safe_memory_arena& arena)
-{
-    // TODO: Implement
-    return {};
-}
-
 CURLOptions AL_GetProductSearchCURLOptions(std::string_view query)
 {
     return {
@@ -1,24 +1,37 @@
 #pragma once
 
+#include <array>
 #include <string>
 #include <string_view>
 #include <optional>
+#include <span>
 
 #include "common/product.hpp"
 #include "webscraper/curldriver.hpp"
 #include "webscraper/html.hpp"
 
+// How search pages are read: by building a DOM, or from the tokenizer stream alone
+enum class ParserBackend { DOM, STREAM };
+
 struct Store
 {
     StoreID id;
     std::string_view name, prefix, homepage, root_url;
     Region region;
+    // Listings per search results page
+    size_t page_size;
 
     ArenaProductList* (*ParseProductSearch)(std::string_view,
         tb::thread_safe_memory_arena& arena, size_t);
-    std::string (*GetProductSearchURL)(std::string_view);
+    // Optional, used with ParserBackend::STREAM
+    ArenaProductList* (*StreamProductSearch)(std::string_view,
+        tb::thread_safe_memory_arena& arena, size_t);
+    // Pages are numbered from 0
+    std::string (*GetProductSearchURL)(std::string_view, size_t page);
     ArenaProduct* (*GetProductAtURL)(const HTML&, tb::thread_safe_memory_arena& arena);
     CURLOptions (*GetProductSearchCURLOptions)(std::string_view);
+    // OFFER_GRAMMAR, or one with forms of offer text particular to the store
+    OfferGrammar offer_grammar = OFFER_GRAMMAR;
 };
 
 // See stores.md
@@ -29,29 +42,43 @@ CURLOptions Default_GetProductSearchCURLOptions(std::string_view query);
 ArenaProductList* SV_ParseProductSearch(std::string_view data,
     tb::thread_safe_memory_arena& arena,
     size_t depth=SEARCH_DEPTH_INDEFINITE);
-std::string SV_GetProductSearchURL(std::string_view query);
+ArenaProductList* SV_StreamProductSearch(std::string_view data,
+    tb::thread_safe_memory_arena& arena,
+    size_t depth=SEARCH_DEPTH_INDEFINITE);
+std::string SV_GetProductSearchURL(std::string_view query, size_t page);
 ArenaProduct* SV_GetProductAtURL(const HTML& html, tb::thread_safe_memory_arena& arena);
 
+constexpr auto SV_OFFER_PATTERNS = std::to_array<OfferPattern>({
+    { "only {price}", OfferType::REDUCED_PRICE_ABSOLUTE, false, "real rewards" }
+});
+
+constexpr auto SV_OFFER_GRAMMAR = MakeOfferGrammar<SV_OFFER_PATTERNS, OFFER_PATTERNS>();
+
 // Tesco
 ArenaProductList* TE_ParseProductSearch(std::string_view data,
     tb::thread_safe_memory_arena& arena,
     size_t depth=SEARCH_DEPTH_INDEFINITE);
-std::string TE_GetProductSearchURL(std::string_view query);
+ArenaProductList* TE_StreamProductSearch(std::string_view data,
+    tb::thread_safe_memory_arena& arena,
+    size_t depth=SEARCH_DEPTH_INDEFINITE);
+std::string TE_GetProductSearchURL(std::string_view query, size_t page);
 ArenaProduct* TE_GetProductAtURL(const HTML& html, tb::thread_safe_memory_arena& arena);
 
 // Dunnes Stores
 ArenaProductList* DS_ParseProductSearch(std::string_view data,
     tb::thread_safe_memory_arena& arena,
     size_t depth=SEARCH_DEPTH_INDEFINITE);
-std::string DS_GetProductSearchURL(std::string_view query);
+ArenaProductList* DS_StreamProductSearch(std::string_view data,
+    tb::thread_safe_memory_arena& arena,
+    size_t depth=SEARCH_DEPTH_INDEFINITE);
+std::string DS_GetProductSearchURL(std::string_view query, size_t page);
 ArenaProduct* DS_GetProductAtURL(const HTML& html, tb::thread_safe_memory_arena& arena);
 
 // Aldi
 ArenaProductList* AL_ParseProductSearch(std::string_view data,
     tb::thread_safe_memory_arena& arena,
     size_t depth=SEARCH_DEPTH_INDEFINITE);
-std::string AL_GetProductSearchURL(std::string_view query);
-ArenaProduct* AL_GetProductAtURL(const HTML& html, tb::thread_safe_memory_arena& arena);
+std::string AL_GetProductSearchURL(std::string_view query, size_t page);
 CURLOptions AL_GetProductSearchCURLOptions(std::string_view query);
 
 namespace stores
@@ -59,47 +86,65 @@ namespace stores
 
 constexpr Store SuperValu =
 {
-    .id = StoreID::SUPERVALU, .name = "SuperValu", .prefix = "SV",
-    .homepage = "https://shop.supervalu.ie/sm/delivery/rsid/5550",
-    .root_url = "https://shop.supervalu.ie",
+    .id = StoreID::SUPERVALU, .name = "SuperValu",
+    .prefix = GetStorePrefix(StoreID::SUPERVALU),
+    .homepage = GetStoreSite(StoreID::SUPERVALU).homepage,
+    .root_url = GetStoreSite(StoreID::SUPERVALU).root_url,
     .region = Region::IE,
+    .page_size = 30,
     .ParseProductSearch = SV_ParseProductSearch,
+    .StreamProductSearch = SV_StreamProductSearch,
     .GetProductSearchURL = SV_GetProductSearchURL,
     .GetProductAtURL = SV_GetProductAtURL,
-    .GetProductSearchCURLOptions = Default_GetProductSearchCURLOptions
+    .GetProductSearchCURLOptions = Default_GetProductSearchCURLOptions,
+    .offer_grammar = SV_OFFER_GRAMMAR
 };
 
 constexpr Store Tesco = {
-    .id = StoreID::TESCO, .name = "Tesco", .prefix = "TE",
-    .homepage = "https://www.tesco.ie/shop/en-IE",
-    .root_url = "https://www.tesco.ie",
+    .id = StoreID::TESCO, .name = "Tesco",
+    .prefix = GetStorePrefix(StoreID::TESCO),
+    .homepage = GetStoreSite(StoreID::TESCO).homepage,
+    .root_url = GetStoreSite(StoreID::TESCO).root_url,
     .region = Region::IE,
+    .page_size = 24,
     .ParseProductSearch = TE_ParseProductSearch,
+    .StreamProductSearch = TE_StreamProductSearch,
     .GetProductSearchURL = TE_GetProductSearchURL,
     .GetProductAtURL = TE_GetProductAtURL,
     .GetProductSearchCURLOptions = Default_GetProductSearchCURLOptions
 };
 
 constexpr Store DunnesStores = {
-    .id = StoreID::DUNNES_STORES, .name = "Dunnes Stores", .prefix = "DS",
-    .homepage = "https://www.dunnesstoresgrocery.com",
-    .root_url = "https://www.dunnesstoresgrocery.com",
+    .id = StoreID::DUNNES_STORES, .name = "Dunnes Stores",
+    .prefix = GetStorePrefix(StoreID::DUNNES_STORES),
+    .homepage = GetStoreSite(StoreID::DUNNES_STORES).homepage,
+    .root_url = GetStoreSite(StoreID::DUNNES_STORES).root_url,
     .region = Region::IE,
+    .page_size = 30,
     .ParseProductSearch = DS_ParseProductSearch,
+    .StreamProductSearch = DS_StreamProductSearch,
     .GetProductSearchURL = DS_GetProductSearchURL,
     .GetProductAtURL = DS_GetProductAtURL,
     .GetProductSearchCURLOptions = Default_GetProductSearchCURLOptions
 };
 
 constexpr Store Aldi = {
-    .id = StoreID::ALDI, .name = "Aldi", .prefix = "AL",
-    .homepage = "https://aldi.ie",
-    .root_url = "https://aldi.ie",
+    .id = StoreID::ALDI, .name = "Aldi",
+    .prefix = GetStorePrefix(StoreID::ALDI),
+    .homepage = GetStoreSite(StoreID::ALDI).homepage,
+    .root_url = GetStoreSite(StoreID::ALDI).root_url,
     .region = Region::IE,
+    .page_size = 30,
     .ParseProductSearch = AL_ParseProductSearch,
+    .StreamProductSearch = nullptr,
     .GetProductSearchURL = AL_GetProductSearchURL,
-    .GetProductAtURL = AL_GetProductAtURL,
+    // Product pages are not parsed yet
+    .GetProductAtURL = nullptr,
     .GetProductSearchCURLOptions = AL_GetProductSearchCURLOptions
 };
 
+constexpr auto ALL = std::to_array<const Store*>({
+    &SuperValu, &Tesco, &DunnesStores, &Aldi
+});
+
 }
@@ -0,0 +1,315 @@
+#include "webscraper/streamextractor.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+
+#include <lexbor/html/tokenizer/state_rawtext.h>
+#include <lexbor/html/tokenizer/state_rcdata.h>
+#include <lexbor/html/tokenizer/state_script.h>
+
+#include "common/util.hpp"
+
+static lxb_html_tokenizer_t* ThreadTokenizer()
+{
+    struct Tokenizer
+    {
+        lxb_html_tokenizer_t* ptr = lxb_html_tokenizer_create();
+
+        Tokenizer()
+        {
+            if (!ptr || lxb_html_tokenizer_init(ptr) != LXB_STATUS_OK)
+                Abort_AllocFailed();
+        }
+
+        ~Tokenizer() { lxb_html_tokenizer_destroy(ptr); }
+    };
+
+    thread_local Tokenizer tokenizer;
+    return tokenizer.ptr;
+}
+
+static bool IsVoidElement(lxb_tag_id_t tag)
+{
+    switch (tag) {
+    case LXB_TAG_AREA: case LXB_TAG_BASE: case LXB_TAG_BR: case LXB_TAG_COL:
+    case LXB_TAG_EMBED: case LXB_TAG_HR: case LXB_TAG_IMG: case LXB_TAG_INPUT:
+    case LXB_TAG_LINK: case LXB_TAG_META: case LXB_TAG_PARAM: case LXB_TAG_SOURCE:
+    case LXB_TAG_TRACK: case LXB_TAG_WBR:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool IsBlank(std::string_view text)
+{
+    return std::all_of(text.begin(), text.end(), [] (char c) {
+        return isspace(static_cast<unsigned char>(c));
+    });
+}
+
+static bool EqualIgnoreCase(std::string_view a, std::string_view b)
+{
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(),
+        [] (char x, char y) {
+            return tolower(static_cast<unsigned char>(x))
+                == tolower(static_cast<unsigned char>(y));
+        });
+}
+
+static std::string_view View(const lxb_char_t* begin, const lxb_char_t* end)
+{
+    if (!begin || !end) return {};
+    return { reinterpret_cast<const char*>(begin), static_cast<size_t>(end - begin) };
+}
+
+static std::optional<std::string_view> FindAttr(const lxb_html_token_t* token,
+    std::string_view name)
+{
+    for (const lxb_html_token_attr_t* attr = token->attr_first; attr; attr = attr->next) {
+        if (EqualIgnoreCase(View(attr->name_begin, attr->name_end), name))
+            return View(attr->value_begin, attr->value_end);
+    }
+
+    return std::nullopt;
+}
+
+static bool Matches(const AttrPattern& pattern, const lxb_html_token_t* token)
+{
+    for (const lxb_html_token_attr_t* attr = token->attr_first; attr; attr = attr->next) {
+        if (EqualIgnoreCase(View(attr->name_begin, attr->name_end), pattern.attr)
+            && ContainsIgnoreCase(View(attr->value_begin, attr->value_end), pattern.value))
+            return true;
+    }
+
+    return false;
+}
+
+StreamExtractor::StreamExtractor(StreamPattern l, std::span<const StreamPattern> p)
+    : listing(l), patterns(p)
+{
+    if (patterns.size() > MAX_PATTERNS)
+        throw std::runtime_error { "Too many stream extractor patterns" };
+}
+
+std::string_view StreamExtractor::ListingAttr() const { return listing_attr; }
+
+size_t StreamExtractor::Count(size_t pattern) const { return counts[pattern]; }
+
+std::optional<std::string_view> StreamExtractor::Text(size_t pattern, size_t index) const
+{
+    if (index >= counts[pattern] || !captures[pattern][index].has_text)
+        return std::nullopt;
+    return captures[pattern][index].text;
+}
+
+std::optional<std::string_view> StreamExtractor::Attr(size_t pattern, size_t index) const
+{
+    if (index >= counts[pattern] || !captures[pattern][index].has_attr)
+        return std::nullopt;
+    return captures[pattern][index].attr;
+}
+
+bool StreamExtractor::RunImpl(std::string_view data, ListingCallback cb, void* ctx)
+{
+    callback = cb;
+    callback_ctx = ctx;
+    ResetListing();
+
+    lxb_html_tokenizer_t* tkz = ThreadTokenizer();
+    lxb_html_tokenizer_clean(tkz);
+    lxb_html_tokenizer_callback_token_done_set(tkz, OnToken, this);
+
+    if (lxb_html_tokenizer_begin(tkz) != LXB_STATUS_OK) {
+        Log(LogLevel::WARNING, "Failed to begin tokenizing page");
+        return false;
+    }
+
+    lxb_status_t status = lxb_html_tokenizer_chunk(tkz,
+        reinterpret_cast<const lxb_char_t*>(data.data()), data.size());
+
+    if (status == LXB_STATUS_OK)
+        status = lxb_html_tokenizer_end(tkz);
+
+    if (status != LXB_STATUS_OK && status != LXB_STATUS_STOP) {
+        Log(LogLevel::WARNING, "Tokenizer failed with code {}", status);
+        return false;
+    }
+
+    return true;
+}
+
+lxb_html_token_t* StreamExtractor::OnToken(lxb_html_tokenizer_t* tkz,
+    lxb_html_token_t* token, void* ctx)
+{
+    if (static_cast<StreamExtractor*>(ctx)->HandleToken(tkz, token))
+        return token;
+
+    // Returning null ends the current chunk with our status
+    tkz->status = LXB_STATUS_STOP;
+    return nullptr;
+}
+
+bool StreamExtractor::HandleToken(lxb_html_tokenizer_t* tkz, lxb_html_token_t* token)
+{
+    lxb_tag_id_t tag = token->tag_id;
+
+    if (tag == LXB_TAG__TEXT) {
+        if (awaiting_frames)
+            CaptureText(View(token->text_start, token->text_end));
+        return true;
+    }
+
+    if (tag == LXB_TAG__EM_COMMENT || tag == LXB_TAG__EM_DOCTYPE
+        || tag == LXB_TAG__END_OF_FILE)
+        return true;
+
+    if (token->type & LXB_HTML_TOKEN_TYPE_CLOSE)
+        return depth ? Close(tag) : true;
+
+    // Without a tree builder the tokenizer must be told about raw text elements,
+    // otherwise markup inside scripts and styles would be read as tags
+    switch (tag) {
+    case LXB_TAG_SCRIPT:
+        lxb_html_tokenizer_tmp_tag_id_set(tkz, tag);
+        lxb_html_tokenizer_state_set(tkz, lxb_html_tokenizer_state_script_data_before);
+        break;
+    case LXB_TAG_STYLE: case LXB_TAG_XMP: case LXB_TAG_IFRAME:
+    case LXB_TAG_NOEMBED: case LXB_TAG_NOFRAMES:
+        lxb_html_tokenizer_tmp_tag_id_set(tkz, tag);
+        lxb_html_tokenizer_state_set(tkz, lxb_html_tokenizer_state_rawtext_before);
+        break;
+    case LXB_TAG_TITLE: case LXB_TAG_TEXTAREA:
+        lxb_html_tokenizer_tmp_tag_id_set(tkz, tag);
+        lxb_html_tokenizer_state_set(tkz, lxb_html_tokenizer_state_rcdata_before);
+        break;
+    default:
+        break;
+    }
+
+    bool is_void = IsVoidElement(tag) || (token->type & LXB_HTML_TOKEN_TYPE_CLOSE_SELF);
+
+    if (depth) {
+        Open(token, is_void);
+        return true;
+    }
+
+    if (is_void || !Matches(listing.match, token))
+        return true;
+
+    ResetListing();
+    if (!listing.capture_attr.empty()) {
+        if (std::optional<std::string_view> value = FindAttr(token, listing.capture_attr))
+            listing_attr.assign(value.value());
+    }
+
+    stack[0] = { .tag = tag, .matched = 0, .awaiting_text = 0 };
+    depth = 1;
+
+    return true;
+}
+
+void StreamExtractor::Open(lxb_html_token_t* token, bool is_void)
+{
+    if (depth == MAX_DEPTH) {
+        Log(LogLevel::DEBUG, "Listing nested too deeply, skipping");
+        ResetListing();
+        return;
+    }
+
+    Frame& frame = stack[depth];
+    frame = { .tag = token->tag_id, .matched = 0, .awaiting_text = 0 };
+
+    for (size_t i = 0; i < patterns.size(); ++i) {
+        const StreamPattern& pattern = patterns[i];
+        size_t scope = pattern.match.within;
+
+        if (counts[i] == MAX_MATCHES) continue;
+        if (scope != AttrPattern::NO_SCOPE && !(open_scopes & (1u << scope))) continue;
+        if (!Matches(pattern.match, token)) continue;
+
+        size_t index = counts[i]++;
+        Capture& capture = captures[i][index];
+        capture.text.clear();
+        capture.attr.clear();
+        capture.has_text = false;
+        capture.has_attr = false;
+
+        if (!pattern.capture_attr.empty()) {
+            if (std::optional<std::string_view> value
+                    = FindAttr(token, pattern.capture_attr)) {
+                capture.attr.assign(value.value());
+                capture.has_attr = true;
+            }
+        }
+
+        if (is_void) continue;
+
+        // Scopes are the first match of a pattern, for as long as it is open
+        if (index == 0) open_scopes |= 1u << i;
+        frame.matched |= 1u << i;
+        frame.awaiting_text |= 1u << i;
+        frame.index[i] = index;
+    }
+
+    if (is_void) return;
+
+    if (frame.awaiting_text) ++awaiting_frames;
+    ++depth;
+}
+
+bool StreamExtractor::Close(lxb_tag_id_t tag)
+{
+    // Find the matching open element, implicitly closing anything left open inside it
+    size_t match = depth;
+    while (match > 0 && stack[match - 1].tag != tag) --match;
+    if (match == 0) return true;
+
+    while (depth >= match) {
+        const Frame& frame = stack[--depth];
+        if (frame.awaiting_text) --awaiting_frames;
+
+        for (size_t i = 0; i < patterns.size(); ++i) {
+            if ((frame.matched & (1u << i)) && frame.index[i] == 0)
+                open_scopes &= ~(1u << i);
+        }
+    }
+
+    if (depth) return true;
+
+    bool keep_going = callback(callback_ctx);
+    ResetListing();
+
+    return keep_going;
+}
+
+void StreamExtractor::CaptureText(std::string_view text)
+{
+    if (IsBlank(text)) return;
+
+    for (size_t d = 0; d < depth; ++d) {
+        Frame& frame = stack[d];
+        if (!frame.awaiting_text) continue;
+
+        for (size_t i = 0; i < patterns.size(); ++i) {
+            if (!(frame.awaiting_text & (1u << i))) continue;
+
+            Capture& capture = captures[i][frame.index[i]];
+            capture.text.assign(text);
+            capture.has_text = true;
+        }
+
+        frame.awaiting_text = 0;
+        --awaiting_frames;
+    }
+}
+
+void StreamExtractor::ResetListing()
+{
+    depth = 0;
+    awaiting_frames = 0;
+    open_scopes = 0;
+    counts.fill(0);
+    listing_attr.clear();
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include <lexbor/html/tokenizer.h>
+
+#include "webscraper/extractor.hpp"
+
+// Pattern for StreamExtractor. Matches like AttrPattern, and additionally records the
+// value of `capture_attr` (if not empty) and the first non-blank text inside the
+// matched element.
+struct StreamPattern
+{
+    AttrPattern match;
+    std::string_view capture_attr {};
+};
+
+// Extracts listings from a page with lexbor's tokenizer alone, without building a
+// DOM. Elements matching `listing` begin a listing; `patterns` are matched against
+// the elements inside it and the listing is handed to the callback when its element
+// closes. The page is read in a single pass, which ends early once the callback
+// returns false. Captures live in fixed per-pattern slots, so memory does not grow
+// with the size of the page.
+class StreamExtractor
+{
+public:
+    constexpr static size_t MAX_PATTERNS = Extractor::MAX_PATTERNS;
+    constexpr static size_t MAX_MATCHES = Extractor::MAX_MATCHES;
+    // Listings nested deeper than this are abandoned
+    constexpr static size_t MAX_DEPTH = 128;
+
+    StreamExtractor(StreamPattern listing, std::span<const StreamPattern> patterns);
+
+    // Calls `on_listing()` for each complete listing until it returns false.
+    // Returns false if the tokenizer failed.
+    template<typename Callable>
+    bool Run(std::string_view data, Callable&& on_listing)
+    {
+        using CallableT = std::remove_cvref_t<Callable>;
+        return RunImpl(data, [] (void* ctx) -> bool {
+            return (*static_cast<CallableT*>(ctx))();
+        }, const_cast<CallableT*>(std::addressof(on_listing)));
+    }
+
+    // Only valid during the callback
+    std::string_view ListingAttr() const;
+    size_t Count(size_t pattern) const;
+    std::optional<std::string_view> Text(size_t pattern, size_t index = 0) const;
+    std::optional<std::string_view> Attr(size_t pattern, size_t index = 0) const;
+
+private:
+    struct Capture
+    {
+        std::string text, attr;
+        bool has_text = false, has_attr = false;
+    };
+
+    struct Frame
+    {
+        lxb_tag_id_t tag;
+        uint16_t matched, awaiting_text;
+        std::array<uint8_t, MAX_PATTERNS> index;
+    };
+
+    using ListingCallback = bool (*)(void*);
+
+    bool RunImpl(std::string_view data, ListingCallback callback, void* ctx);
+
+    static lxb_html_token_t* OnToken(lxb_html_tokenizer_t* tkz,
+                                     lxb_html_token_t* token, void* ctx);
+    bool HandleToken(lxb_html_tokenizer_t* tkz, lxb_html_token_t* token);
+
+    void Open(lxb_html_token_t* token, bool is_void);
+    // Returns false if the listing's callback asked to stop
+    bool Close(lxb_tag_id_t tag);
+    void CaptureText(std::string_view text);
+    void ResetListing();
+
+    StreamPattern listing;
+    std::span<const StreamPattern> patterns;
+
+    ListingCallback callback = nullptr;
+    void* callback_ctx = nullptr;
+
+    std::string listing_attr;
+    std::array<std::array<Capture, MAX_MATCHES>, MAX_PATTERNS> captures;
+    std::array<size_t, MAX_PATTERNS> counts {};
+    uint16_t open_scopes = 0;
+
+    std::array<Frame, MAX_DEPTH> stack;
+    size_t depth = 0;
+    size_t awaiting_frames = 0;
+};
@@ -3,15 +3,31 @@
 #include <curl/curl.h>
 #include <nlohmann/json.hpp>
 
+#include "common/codec.hpp"
 #include "common/util.hpp"
 #include "webserver/queryhandler.hpp"
+#include "webserver/results.hpp"
 
 #include <chrono>
-#include <ranges>
+#include <optional>
 
 namespace bux = buxtehude;
 using namespace std::chrono_literals;
 
+constexpr auto SEARCH_TIMEOUT = 5s;
+// Enough for the decoded products, sort order and rendered page of a search
+constexpr size_t REQUEST_MEMORY_SIZE = 4 * 1024 * 1024;
+
+// Everything a search request decodes and renders is allocated here, and released in
+// one step once the response has been built
+struct RequestArena
+{
+    tb::dynamically_allocated_array<std::byte, REQUEST_MEMORY_SIZE> memory {};
+    tb::thread_safe_memory_arena arena = std::span { memory.begin(), memory.end() };
+};
+
+static thread_local RequestArena request_arena;
+
 void RetryConnection(bux::Client& client)
 {
     constexpr static auto BASE_WAIT_TIME = 5s;
@@ -33,30 +49,6 @@ void RetryConnection(bux::Client& client)
     reconnect_thread.detach();
 }
 
-std::string_view GetStoreLogo(StoreID store_id)
-{
-    switch (store_id) {
-    case StoreID::SUPERVALU:     return "/static/images/logos/supervalu.png";
-    case StoreID::LIDL:          return "/static/images/logos/lidl.png";
-    case StoreID::TESCO:         return "/static/images/logos/tesco.png";
-    case StoreID::ALDI:          return "/static/images/logos/aldi.png";
-    case StoreID::DUNNES_STORES: return "/static/images/logos/dunnes.png";
-    }
-    return {};
-}
-
-std::string_view GetStoreName(StoreID store_id)
-{
-    switch (store_id) {
-    case StoreID::SUPERVALU:     return "SuperValu";
-    case StoreID::LIDL:          return "LIDL";
-    case StoreID::TESCO:         return "Tesco";
-    case StoreID::ALDI:          return "Aldi";
-    case StoreID::DUNNES_STORES: return "Dunnes Stores";
-    }
-    return {};
-}
-
 int main()
 {
     crow::SimpleApp crow_app;
@@ -85,12 +77,20 @@ int main()
 
     QueryHandler query_handler(bclient, "webscraper");
 
+    std::optional<ResultsTemplates> results_templates = ResultsTemplates::Compile(
+        crow::mustache::load_text("results.html"),
+        crow::mustache::load_text("listing.html"));
+    if (!results_templates) {
+        Log(LogLevel::SEVERE, "Failed to compile results templates");
+        return 1;
+    }
+
     CROW_ROUTE(crow_app, "/")([] () {
         return crow::mustache::load("index.html").render();
     });
 
     CROW_ROUTE(crow_app, "/search/<string>")
-    ([&query_handler] (const std::string& term) {
+    ([&query_handler, &results_templates] (const std::string& term) {
         int unescaped_len;
         char* curl_str = curl_easy_unescape(nullptr, term.data(), term.size(),
             &unescaped_len);
@@ -105,57 +105,36 @@ int main()
 
         std::string_view unescaped_term(curl_str, unescaped_len);
 
-        std::future<QueryResultsMap> future = query_handler.SendQuery(unescaped_term);
-        std::future_status status = future.wait_for(5s);
+        Deadline deadline = PreciseNow() + SEARCH_TIMEOUT;
+        PendingQuery query = query_handler.SendQuery(unescaped_term, deadline);
+        std::future_status status = query.results.wait_until(deadline);
 
         if (status == std::future_status::timeout) {
+            query_handler.Cancel(query.id);
             crow::mustache::context ctx {{
                 { "message", "Error - search timed out" }
             }};
             return crow::response(crow::mustache::load("error.html").render(ctx));
         }
 
-        QueryResultsMap result_map = future.get();
-        std::vector<Product>& products = result_map.at(unescaped_term.data());
-
-        std::ranges::sort(products,
-            [] (auto& a, auto& b) {
-                std::partial_ordering cmp = a.price_per_unit <=> b.price_per_unit;
-                if (cmp == std::partial_ordering::unordered)
-                    return a.item_price < b.item_price;
-                return a.price_per_unit < b.price_per_unit;
-            }
-        );
-
-        crow::json::wvalue::list names;
-        names.reserve(products.size());
-
-        for (Product& p : products) {
-            names.emplace_back(crow::json::wvalue {
-                { "name", crow::json::wvalue(std::move(p.name)) },
-                { "img", crow::json::wvalue(std::move(p.image_url)) },
-                { "price", crow::json::wvalue(p.item_price.ToString()) },
-                { "ppu", crow::json::wvalue(p.price_per_unit.ToString()) },
-                { "url", crow::json::wvalue(std::move(p.url)) },
-                { "logo_url", crow::json::wvalue(GetStoreLogo(p.store).data()) },
-                { "store", crow::json::wvalue(GetStoreName(p.store).data()) },
-                { "has_offers", crow::json::wvalue(p.offers.size() > 0) },
-                { "offers", crow::json::wvalue(
-                    p.offers | std::views::transform([] (const Offer& o) {
-                        return o.ToString();
-                    }) | tb::range_to<std::vector<crow::json::wvalue>>()
-                ) }
-            });
-        }
+        QueryResultsMap result_map = query.results.get();
 
-        crow::mustache::context ctx {{
-            { "term", std::move(non_lowercase) },
-            { "item_listings", names },
-            { "item_count", static_cast<uint64_t>(names.size()) }
-        }};
+        tb::thread_safe_memory_arena& arena = request_arena.arena;
+        tb::scoped_guard release_arena = [&arena] { arena.reset(); };
+
+        std::optional<tb::arena_vector<ArenaProduct>> products
+            = DecodeProducts(result_map.at(unescaped_term.data()), arena);
+        if (!products) {
+            Log(LogLevel::WARNING, "Invalid products in results for '{}'",
+                unescaped_term);
+            crow::mustache::context ctx {{
+                { "message", "Error - invalid search results" }
+            }};
+            return crow::response(crow::mustache::load("error.html").render(ctx));
+        }
 
-        crow::mustache::template_t page = crow::mustache::load("results.html");
-        return crow::response(page.render(ctx));
+        return crow::response(std::string(RenderResults(arena, *results_templates,
+                                                        non_lowercase, *products)));
     });
 
     crow_app.port(8080).multithreaded().run();
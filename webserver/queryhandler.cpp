@@ -4,6 +4,7 @@
 
 #include <nlohmann/json.hpp>
 
+#include "common/codec.hpp"
 #include "common/validate.hpp"
 #include "common/product.hpp"
 #include "common/util.hpp"
@@ -22,15 +23,14 @@ QueryHandler::QueryHandler(bux::Client& bclient, std::string_view webscraper)
         unsigned id = msg.content["request-id"];
         std::string term = msg.content["term"];
 
+        std::scoped_lock lock(pending_queries_mutex);
+
         auto iterator = pending_queries.find(id);
         if (iterator == pending_queries.end()) return;
 
+        // Decoded by the request, since products are only valid as long as its arena
         RequestInfo& request_info = iterator->second;
-        request_info.results[term].reserve(msg.content["items"].size());
-
-        for (const json& j : msg.content["items"]) {
-            request_info.results[term].emplace_back(j.get<Product>());
-        }
+        request_info.results[term] = msg.content["items"].get_binary();
 
         if (request_info.results.size() >= request_info.expecting) {
             request_info.promise.set_value(std::move(request_info.results));
@@ -39,15 +39,21 @@ QueryHandler::QueryHandler(bux::Client& bclient, std::string_view webscraper)
     });
 }
 
-std::future<QueryResultsMap> QueryHandler::SendQuery(std::string_view query)
+PendingQuery QueryHandler::SendQuery(std::string_view query, Deadline deadline)
 {
-    auto [iterator, success] = pending_queries.emplace(request_id++, RequestInfo {
-        .expecting = 1
-    });
+    unsigned id = request_id++;
+    std::future<QueryResultsMap> results;
 
-    auto& [id, request_info] = *iterator;
+    {
+        std::scoped_lock lock(pending_queries_mutex);
+        auto [iterator, success] = pending_queries.emplace(id, RequestInfo {
+            .expecting = 1
+        });
 
-    request_info.results.emplace(query, std::vector<Product> {});
+        RequestInfo& request_info = iterator->second;
+        request_info.results.emplace(query, ByteBuffer {});
+        results = request_info.promise.get_future();
+    }
 
     StoreSelection stores = StoreID::SUPERVALU | StoreID::DUNNES_STORES
                           | StoreID::TESCO | StoreID::ALDI;
@@ -59,12 +65,19 @@ std::future<QueryResultsMap> QueryHandler::SendQuery(std::string_view query)
             { "request-id", id },
             { "depth", 10 },
             { "stores", stores },
-            { "force-refresh", false }
+            { "force-refresh", false },
+            { "deadline", deadline.time_since_epoch().count() }
         },
         .only_first = true
     }).if_err([] (bux::WriteError) {
         Log(LogLevel::WARNING, "Failed to write request");
     });
 
-    return request_info.promise.get_future();
+    return { id, std::move(results) };
+}
+
+void QueryHandler::Cancel(unsigned id)
+{
+    std::scoped_lock lock(pending_queries_mutex);
+    pending_queries.erase(id);
 }
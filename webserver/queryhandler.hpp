@@ -1,15 +1,20 @@
 #pragma once
 
 #include <atomic>
+#include <future>
+#include <mutex>
 #include <unordered_map>
 
 #include <buxtehude/buxtehude.hpp>
 
 #include <crow.h>
 
+#include "common/codec.hpp"
 #include "common/product.hpp"
 
-using QueryResultsMap = std::unordered_map<std::string, std::vector<Product>>;
+// Products for each term, still encoded so that they can be decoded straight into the
+// arena of the request that asked for them
+using QueryResultsMap = std::unordered_map<std::string, ByteBuffer>;
 
 namespace bux = buxtehude;
 
@@ -20,6 +25,12 @@ struct RequestInfo
     unsigned expecting;
 };
 
+struct PendingQuery
+{
+    unsigned id;
+    std::future<QueryResultsMap> results;
+};
+
 class QueryHandler
 {
 public:
@@ -27,9 +38,14 @@ public:
 
     // Crow currently does not allow asynchronous request handling. For now, the
     // route lambdas block and wait on the future returned by this function.
-    std::future<QueryResultsMap> SendQuery(std::string_view query);
+    // The webscraper skips any work that cannot finish before `deadline`.
+    PendingQuery SendQuery(std::string_view query, Deadline deadline);
+    // Forgets a query that is no longer waited on, so that late results are dropped
+    void Cancel(unsigned id);
 
 private:
+    // Results are handled on the buxtehude client's thread
+    std::mutex pending_queries_mutex;
     std::unordered_map<unsigned, RequestInfo> pending_queries;
     bux::Client& bclient;
     std::string webscraper_name;
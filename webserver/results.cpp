@@ -0,0 +1,124 @@
+#include "webserver/results.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <tuple>
+
+// Rough size of the fields of one listing, for reserving the page up front
+constexpr size_t LISTING_VALUES_SIZE_HINT = 512;
+
+constexpr auto RESULTS_FIELDS = std::to_array<std::string_view>({
+    "term", "item_count", "listings"
+});
+
+enum ResultsField { RESULTS_TERM, RESULTS_ITEM_COUNT, RESULTS_LISTINGS };
+
+enum ListingField
+{
+    LISTING_NAME, LISTING_IMG_ROOT, LISTING_IMG, LISTING_PRICE, LISTING_PPU,
+    LISTING_URL_ROOT, LISTING_URL, LISTING_LOGO_URL, LISTING_STORE, LISTING_HAS_OFFERS,
+    LISTING_FIELD_COUNT
+};
+
+constexpr auto LISTING_FIELDS = std::to_array<std::string_view>({
+    "name", "img_root", "img", "price", "ppu", "url_root", "url", "logo_url", "store",
+    "has_offers"
+});
+
+static_assert(RESULTS_FIELDS.size() == RESULTS_LISTINGS + 1);
+static_assert(LISTING_FIELDS.size() == LISTING_FIELD_COUNT);
+
+auto ResultsTemplates::Compile(std::string_view page_source,
+    std::string_view listing_source) -> std::optional<ResultsTemplates>
+{
+    std::optional<PageTemplate> page = PageTemplate::Compile(page_source, RESULTS_FIELDS);
+    std::optional<PageTemplate> listing
+        = PageTemplate::Compile(listing_source, LISTING_FIELDS);
+    if (!page || !listing) return std::nullopt;
+
+    return ResultsTemplates { std::move(*page), std::move(*listing) };
+}
+
+std::string_view GetStoreLogo(StoreID store_id)
+{
+    switch (store_id) {
+    case StoreID::SUPERVALU:     return "/static/images/logos/supervalu.png";
+    case StoreID::LIDL:          return "/static/images/logos/lidl.png";
+    case StoreID::TESCO:         return "/static/images/logos/tesco.png";
+    case StoreID::ALDI:          return "/static/images/logos/aldi.png";
+    case StoreID::DUNNES_STORES: return "/static/images/logos/dunnes.png";
+    }
+    return {};
+}
+
+std::string_view GetStoreName(StoreID store_id)
+{
+    switch (store_id) {
+    case StoreID::SUPERVALU:     return "SuperValu";
+    case StoreID::LIDL:          return "LIDL";
+    case StoreID::TESCO:         return "Tesco";
+    case StoreID::ALDI:          return "Aldi";
+    case StoreID::DUNNES_STORES: return "Dunnes Stores";
+    }
+    return {};
+}
+
+static void RenderListing(tb::arena_string& out, const PageTemplate& listing,
+    const ArenaProduct& p)
+{
+    std::array<char, Price::MAX_STRING_SIZE> price;
+    std::array<char, PricePU::MAX_STRING_SIZE> ppu;
+    StoreURLRoots roots = GetStoreURLRoots(p.store);
+
+    std::array<std::string_view, LISTING_FIELD_COUNT> values;
+    values[LISTING_NAME] = p.name;
+    values[LISTING_IMG_ROOT] = ExpansionRoot(p.image_url, roots.image);
+    values[LISTING_IMG] = p.image_url;
+    values[LISTING_PRICE] = { price.data(), p.item_price.ToChars(price) };
+    values[LISTING_PPU] = { ppu.data(), p.price_per_unit.ToChars(ppu) };
+    values[LISTING_URL_ROOT] = ExpansionRoot(p.url, roots.page);
+    values[LISTING_URL] = p.url;
+    values[LISTING_LOGO_URL] = GetStoreLogo(p.store);
+    values[LISTING_STORE] = GetStoreName(p.store);
+    values[LISTING_HAS_OFFERS] = p.offers.empty() ? "" : "true";
+
+    listing.Render(out, values);
+}
+
+std::string_view RenderResults(tb::thread_safe_memory_arena& arena,
+    const ResultsTemplates& templates, std::string_view term,
+    const tb::arena_vector<ArenaProduct>& products)
+{
+    // Sorting pointers leaves the products where they were decoded
+    auto& sorted = *arena.allocate_object<tb::arena_vector<const ArenaProduct*>>(arena);
+    sorted.reserve(products.size());
+    for (const ArenaProduct& p : products) sorted.push_back(&p);
+
+    std::ranges::sort(sorted, {}, [] (const ArenaProduct* p) {
+        const EffectivePrices& prices = p->effective_prices;
+        return std::tuple { prices.unit, prices.bulk, prices.normal };
+    });
+
+    auto& listings = *arena.allocate_object<tb::arena_string>(arena);
+    listings.reserve(sorted.size()
+                     * (templates.listing.TextSize() + LISTING_VALUES_SIZE_HINT));
+    for (const ArenaProduct* p : sorted)
+        RenderListing(listings, templates.listing, *p);
+
+    std::array<char, 20> item_count;
+    char* item_count_end = std::to_chars(item_count.data(),
+        item_count.data() + item_count.size(), sorted.size()).ptr;
+
+    std::array<std::string_view, RESULTS_FIELDS.size()> values;
+    values[RESULTS_TERM] = term;
+    values[RESULTS_ITEM_COUNT] = { item_count.data(), item_count_end };
+    values[RESULTS_LISTINGS] = listings;
+
+    // Escaping can make the term up to six times longer
+    auto& page = *arena.allocate_object<tb::arena_string>(arena);
+    page.reserve(templates.page.TextSize() + term.size() * 6 + listings.size());
+    templates.page.Render(page, values);
+
+    return page;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <optional>
+#include <string_view>
+
+#include <tb/tb.h>
+
+#include "common/product.hpp"
+#include "webserver/template.hpp"
+
+// results.html, with one listing.html for each product
+struct ResultsTemplates
+{
+    PageTemplate page, listing;
+
+    static std::optional<ResultsTemplates> Compile(std::string_view page_source,
+        std::string_view listing_source);
+};
+
+std::string_view GetStoreLogo(StoreID store_id);
+std::string_view GetStoreName(StoreID store_id);
+
+// Sorts `products` by unit, then by the best price available without membership, and
+// renders the results page for them. Everything, including the page, is allocated in
+// `arena`.
+std::string_view RenderResults(tb::thread_safe_memory_arena& arena,
+    const ResultsTemplates& templates, std::string_view term,
+    const tb::arena_vector<ArenaProduct>& products);
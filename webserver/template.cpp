@@ -0,0 +1,158 @@
+#include "webserver/template.hpp"
+
+#include <algorithm>
+
+#include "common/util.hpp"
+
+constexpr std::string_view TrimTag(std::string_view tag)
+{
+    size_t start = tag.find_first_not_of(" \t\n");
+    if (start == std::string_view::npos) return {};
+    return tag.substr(start, tag.find_last_not_of(" \t\n") + 1 - start);
+}
+
+auto PageTemplate::Compile(std::string_view source,
+    std::span<const std::string_view> fields) -> std::optional<PageTemplate>
+{
+    PageTemplate result;
+    result.source = source;
+
+    struct OpenSection { std::string_view name; size_t segment; };
+    std::vector<OpenSection> open_sections;
+
+    auto find_field = [fields] (std::string_view name) -> std::optional<size_t> {
+        auto it = std::ranges::find(fields, name);
+        if (it == fields.end()) {
+            Log(LogLevel::SEVERE, "Unknown template field '{}'", name);
+            return std::nullopt;
+        }
+        return it - fields.begin();
+    };
+
+    size_t position = 0;
+    while (position < source.size()) {
+        size_t tag_start = source.find("{{", position);
+        size_t text_end = std::min(tag_start, source.size());
+
+        if (text_end > position) {
+            result.segments.push_back({
+                .type = SegmentType::TEXT,
+                .text_offset = position, .text_size = text_end - position
+            });
+            result.text_size += text_end - position;
+        }
+
+        if (tag_start == std::string_view::npos) break;
+
+        bool raw = source.substr(tag_start).starts_with("{{{");
+        std::string_view closing = raw ? "}}}" : "}}";
+        size_t content_start = tag_start + closing.size();
+        size_t tag_end = source.find(closing, content_start);
+        if (tag_end == std::string_view::npos) {
+            Log(LogLevel::SEVERE, "Unterminated template tag at offset {}", tag_start);
+            return std::nullopt;
+        }
+
+        std::string_view tag = TrimTag(source.substr(content_start,
+                                                     tag_end - content_start));
+        position = tag_end + closing.size();
+
+        if (raw) {
+            std::optional<size_t> field = find_field(tag);
+            if (!field) return std::nullopt;
+            result.segments.push_back({ .type = SegmentType::RAW, .field = *field });
+            continue;
+        }
+
+        switch (tag.empty() ? '\0' : tag.front()) {
+        case '!':
+            break;
+        case '#': {
+            std::string_view name = TrimTag(tag.substr(1));
+            std::optional<size_t> field = find_field(name);
+            if (!field) return std::nullopt;
+            open_sections.push_back({ name, result.segments.size() });
+            result.segments.push_back({ .type = SegmentType::SECTION, .field = *field });
+            break;
+        }
+        case '/': {
+            std::string_view name = TrimTag(tag.substr(1));
+            if (open_sections.empty() || open_sections.back().name != name) {
+                Log(LogLevel::SEVERE, "Unexpected end of template section '{}'", name);
+                return std::nullopt;
+            }
+            result.segments[open_sections.back().segment].section_end
+                = result.segments.size();
+            open_sections.pop_back();
+            break;
+        }
+        case '&': {
+            std::optional<size_t> field = find_field(TrimTag(tag.substr(1)));
+            if (!field) return std::nullopt;
+            result.segments.push_back({ .type = SegmentType::RAW, .field = *field });
+            break;
+        }
+        default: {
+            std::optional<size_t> field = find_field(tag);
+            if (!field) return std::nullopt;
+            result.segments.push_back({ .type = SegmentType::ESCAPED, .field = *field });
+        }
+        }
+    }
+
+    if (!open_sections.empty()) {
+        Log(LogLevel::SEVERE, "Template section '{}' is not closed",
+            open_sections.back().name);
+        return std::nullopt;
+    }
+
+    return result;
+}
+
+void PageTemplate::Render(tb::arena_string& out,
+    std::span<const std::string_view> values) const
+{
+    std::string_view text = source;
+
+    for (size_t i = 0; i < segments.size();) {
+        const Segment& segment = segments[i];
+        switch (segment.type) {
+        case SegmentType::TEXT:
+            out.append(text.substr(segment.text_offset, segment.text_size));
+            break;
+        case SegmentType::ESCAPED:
+            AppendEscapedHTML(out, values[segment.field]);
+            break;
+        case SegmentType::RAW:
+            out.append(values[segment.field]);
+            break;
+        case SegmentType::SECTION:
+            if (values[segment.field].empty()) {
+                i = segment.section_end;
+                continue;
+            }
+            break;
+        }
+        ++i;
+    }
+}
+
+size_t PageTemplate::TextSize() const { return text_size; }
+
+void AppendEscapedHTML(tb::arena_string& out, std::string_view text)
+{
+    while (!text.empty()) {
+        size_t special = text.find_first_of("&<>\"'");
+        out.append(text.substr(0, special));
+        if (special == std::string_view::npos) return;
+
+        switch (text[special]) {
+        case '&':  out.append("&amp;");  break;
+        case '<':  out.append("&lt;");   break;
+        case '>':  out.append("&gt;");   break;
+        case '"':  out.append("&quot;"); break;
+        case '\'': out.append("&#39;");  break;
+        }
+        text.remove_prefix(special + 1);
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <tb/tb.h>
+
+// A subset of mustache, compiled once so that pages can be rendered into an arena
+// without allocating. Supported tags are {{ field }} (HTML-escaped), {{{ field }}}
+// (raw) and {{#field}}...{{/field}}, which keeps its content if the field is not empty.
+// Fields are named when compiling and given by index when rendering.
+class PageTemplate
+{
+public:
+    // Logs and returns nothing if `source` has a tag it does not support, a field not
+    // in `fields` or unbalanced sections
+    static std::optional<PageTemplate> Compile(std::string_view source,
+        std::span<const std::string_view> fields);
+
+    // `values` is indexed as the `fields` the template was compiled with
+    void Render(tb::arena_string& out, std::span<const std::string_view> values) const;
+
+    // Source text, not counting fields
+    size_t TextSize() const;
+
+private:
+    enum class SegmentType { TEXT, ESCAPED, RAW, SECTION };
+
+    struct Segment
+    {
+        SegmentType type;
+        size_t text_offset = 0, text_size = 0; // Into `source`, for text segments
+        size_t field = 0;
+        size_t section_end = 0; // Index of the segment after a section
+    };
+
+    PageTemplate() = default;
+
+    std::string source;
+    std::vector<Segment> segments;
+    size_t text_size = 0;
+};
+
+void AppendEscapedHTML(tb::arena_string& out, std::string_view text);